@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+};
+
+struct Arena {
+    const char* name;
+    struct ArenaChunk* chunks;   // newest first; only the newest is bumped
+    ArenaStats stats;
+    Arena* parent;
+    Arena* children;
+    Arena* next_sibling;
+};
+
+static const char* node_names[ARENA_KINDS] = {
+    "program", "decl", "stmt", "expr", "type", "param", "symbol", "string", "body",
+};
+
+static _Thread_local Arena* node_arena = NULL;
+static _Thread_local Arena* default_arena = NULL;
+
+Arena* arena_create(const char* name) {
+    Arena* arena = calloc(1, sizeof(Arena));
+    if (!arena) {
+        fprintf(stderr, "Error: Failed to allocate arena %s\n", name);
+        return NULL;
+    }
+    arena->name = name;
+    return arena;
+}
+
+Arena* arena_create_child(Arena* parent, const char* name) {
+    Arena* arena = arena_create(name);
+    if (!arena || !parent) return arena;
+
+    arena->parent = parent;
+    arena->next_sibling = parent->children;
+    parent->children = arena;
+    return arena;
+}
+
+// A large allocation gets a chunk of its own, kept behind the one being
+// bumped so the space left in that is not given up.
+static struct ArenaChunk* add_chunk(Arena* arena, size_t size) {
+    bool large = size > ARENA_CHUNK_SIZE / 4;
+    size_t capacity = large ? size : ARENA_CHUNK_SIZE;
+    struct ArenaChunk* chunk = malloc(sizeof(struct ArenaChunk) + capacity);
+    if (!chunk) return NULL;
+
+    struct ArenaChunk** link = large && arena->chunks ? &arena->chunks->next : &arena->chunks;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    chunk->next = *link;
+    *link = chunk;
+    arena->stats.chunks++;
+    arena->stats.bytes_reserved += capacity;
+    return chunk;
+}
+
+void* arena_alloc(Arena* arena, size_t size, ArenaNode kind) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    struct ArenaChunk* chunk = arena->chunks;
+    if (!chunk || chunk->capacity - chunk->used < size) {
+        chunk = add_chunk(arena, size);
+        if (!chunk) {
+            fprintf(stderr, "Error: Failed to grow arena %s\n", arena->name);
+            return NULL;
+        }
+    }
+
+    void* node = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->stats.bytes_used += size;
+    arena->stats.nodes[kind]++;
+    return node;
+}
+
+char* arena_strdup(Arena* arena, const char* text) {
+    size_t length = strlen(text);
+    char* copy = arena_alloc(arena, length + 1, ARENA_STRING);
+    if (copy) memcpy(copy, text, length + 1);
+    return copy;
+}
+
+void arena_free(Arena* arena) {
+    if (!arena) return;
+
+    while (arena->children) {
+        arena_free(arena->children);
+    }
+
+    if (arena->parent) {
+        Arena** link = &arena->parent->children;
+        while (*link != arena) link = &(*link)->next_sibling;
+        *link = arena->next_sibling;
+    }
+
+    struct ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        struct ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    if (node_arena == arena) node_arena = NULL;
+    if (default_arena == arena) default_arena = NULL;
+    free(arena);
+}
+
+const char* arena_name(const Arena* arena) {
+    return arena->name;
+}
+
+const ArenaStats* get_arena_stats(const Arena* arena) {
+    return &arena->stats;
+}
+
+static void print_arena(FILE* out, const Arena* arena, int depth) {
+    fprintf(out, "%*sarena %s: %zu bytes used of %zu in %zu chunks", depth * 2, "", arena->name,
+        arena->stats.bytes_used, arena->stats.bytes_reserved, arena->stats.chunks);
+    for (int kind = 0; kind < ARENA_KINDS; kind++) {
+        if (arena->stats.nodes[kind]) fprintf(out, ", %zu %s", arena->stats.nodes[kind], node_names[kind]);
+    }
+    fprintf(out, "\n");
+
+    for (const Arena* child = arena->children; child; child = child->next_sibling) {
+        print_arena(out, child, depth + 1);
+    }
+}
+
+void print_arena_stats(FILE* out, const Arena* arena) {
+    if (arena) print_arena(out, arena, 0);
+}
+
+Arena* set_node_arena(Arena* arena) {
+    Arena* previous = node_arena;
+    node_arena = arena;
+    return previous;
+}
+
+Arena* get_node_arena() {
+    if (node_arena) return node_arena;
+    if (!default_arena) default_arena = arena_create("default");
+    return default_arena;
+}
+
+void* node_alloc(size_t size, ArenaNode kind) {
+    Arena* arena = get_node_arena();
+    return arena ? arena_alloc(arena, size, kind) : NULL;
+}
+
+void free_default_arena() {
+    arena_free(default_arena);
+}
@@ -0,0 +1,57 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define ARENA_CHUNK_SIZE 65536
+// Every node holds pointers, so pointer alignment suits them all.
+#define ARENA_ALIGNMENT sizeof(void*)
+
+// What an allocation is, for the per-arena counts.
+typedef enum {
+    ARENA_PROGRAM,
+    ARENA_DECL,
+    ARENA_STMT,
+    ARENA_EXPR,
+    ARENA_TYPE,
+    ARENA_PARAM,
+    ARENA_SYMBOL,
+    ARENA_STRING,
+    ARENA_BODY,
+    ARENA_KINDS
+} ArenaNode;
+
+typedef struct {
+    size_t chunks;
+    size_t bytes_reserved;   // chunk capacity
+    size_t bytes_used;       // handed out, alignment padding included
+    size_t nodes[ARENA_KINDS];
+} ArenaStats;
+
+// Bump allocator for front-end nodes. Nothing is freed on its own: an arena
+// and its sub-arenas are released together, whatever points where inside
+// them. A sub-arena can be released earlier on its own.
+typedef struct Arena Arena;
+
+Arena* arena_create(const char* name);
+// A sub-arena, say for one phase, released along with parent.
+Arena* arena_create_child(Arena* parent, const char* name);
+void* arena_alloc(Arena* arena, size_t size, ArenaNode kind);
+char* arena_strdup(Arena* arena, const char* text);
+void arena_free(Arena* arena);
+
+const char* arena_name(const Arena* arena);
+const ArenaStats* get_arena_stats(const Arena* arena);
+// One line per arena, sub-arenas indented under their parent.
+void print_arena_stats(FILE* out, const Arena* arena);
+
+// The arena the node constructors allocate from on the calling thread;
+// returns the one it replaces. With none set they use a default arena that
+// lives until free_default_arena().
+Arena* set_node_arena(Arena* arena);
+Arena* get_node_arena();
+void* node_alloc(size_t size, ArenaNode kind);
+void free_default_arena();
+
+#endif
@@ -3,21 +3,35 @@
 #define STACK_SIZE 100
 
 #include "lexer.h"
+#include "arena.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
 
 struct decl {
-    char* name;
+    const char* name;
+    uint32_t name_id;
     struct type* type;
     struct expr* value;
     struct stmt* code;
+    struct lazy_body* lazy;    // set while code is still unparsed; see decl_code()
     struct decl* next;
     struct symbol* symbol;
     int reg;
 };
 
+// A function body build_ast() skipped: the source bytes from the token after
+// its '{' through the matching '}', parsed into arena when first asked for.
+// line is where that first token sits.
+struct lazy_body {
+    char* source;
+    int offset;
+    int length;
+    int line;
+    Arena* arena;
+};
+
 // FOR STATEMENTS // 
 typedef enum {
     STMT_DECL,
@@ -98,7 +112,8 @@ struct expr {
 
     int integer_value;
     char ch_expr;
-    char* name;
+    const char* name;
+    uint32_t name_id;
     char* string_literal;
     struct symbol* symbol;
     int reg;
@@ -129,7 +144,8 @@ struct type {
 };
 
 struct param_list {
-    char* name;
+    const char* name;
+    uint32_t name_id;
     struct type* type;
     struct param_list* next;
     struct symbol* symbol;
@@ -137,6 +153,7 @@ struct param_list {
 
 struct program {
     struct decl* declaration;
+    Arena* arena;    // holds the whole tree, symbols and types included
 };
 
 typedef enum {
@@ -148,7 +165,8 @@ typedef enum {
 struct symbol {
     symbol_t kind;
     struct type* type;
-    char* name;
+    const char* name;
+    uint32_t name_id;
     struct symbol* next;
 
     struct {
@@ -182,20 +200,20 @@ struct expr* expr_create_string_literal( char* str );
 struct expr* expr_create(expr_t kind, struct expr* L, struct expr* R );
 
 
-struct expr* parse_additive(Token* tokens, int* tokenIdx);
-struct expr* parse_factor(Token* tokens, int* tokenIdx);
-struct expr* parse_term(Token* tokens, int* tokenIdx);
-struct expr* parse_expression(Token* tokens, int* tokenIdx);
-struct stmt* parse_block(Token* tokens, int* tokenIdx); 
-struct stmt* parse_statement(Token* tokens, int* tokenIdx);
-struct param_list* parse_parameters(Token* tokens, int* tokenIdx);
-struct decl* parse_function(Token* tokens, int* tokenIdx, char* name, struct type* return_type);
-struct decl* parse_array(Token* tokens, int* tokenIdx, char* name, struct type* element_type);
-struct expr* parse_array_init_list(Token* tokens, int* tokenIdx);
+struct expr* parse_factor(Lexer* lexer);
+struct expr* parse_expression(Lexer* lexer);
+struct stmt* parse_block(Lexer* lexer); 
+struct stmt* parse_statement(Lexer* lexer);
+struct param_list* parse_parameters(Lexer* lexer);
+struct decl* parse_function(Lexer* lexer, uint32_t name_id, struct type* return_type);
+struct decl* parse_array(Lexer* lexer, uint32_t name_id, struct type* element_type);
+struct expr* parse_array_init_list(Lexer* lexer);
 // TODO
-struct expr* parse_struct_members(Token* tokens, int* tokenIdx);
-struct decl* parse_struct(Token* tokens, int* tokenIdx);
-struct decl* parse_declaration(Token* tokens, int* tokenIdx);
+struct expr* parse_struct_members(Lexer* lexer);
+struct decl* parse_struct(Lexer* lexer);
+struct decl* parse_declaration(Lexer* lexer);
+// Top-level declarations up to TOKEN_EOF, linked in order into *head.
+bool parse_declarations(Lexer* lexer, struct decl** head);
 
 
 struct stmt* stmt_create(stmt_t kind, struct decl* decl,
@@ -204,13 +222,24 @@ struct stmt* stmt_create(stmt_t kind, struct decl* decl,
     struct stmt* else_body, struct stmt* next );
 
 
-struct decl* decl_create(char* name, struct type* type,
+struct decl* decl_create(uint32_t name_id, struct type* type,
     struct expr* value, struct stmt* code, 
     struct decl* next );
 
-struct program* build_ast(Token* tokens);
+struct program* build_ast(Lexer* lexer);
+// Lexes source in parallel, splits the tokens at top-level declaration
+// boundaries found by brace depth and parses the runs on up to `threads`
+// workers, each into its own sub-arena of the program's. The tree is the one
+// build_ast() makes; small inputs and threads <= 1 parse on the caller.
+#define PARALLEL_PARSE_MIN_TOKENS 16384
+struct program* build_ast_parallel(char* source, size_t length, int threads);
+// Off by default. When on, build_ast() only brace-matches function bodies,
+// so the source buffer must outlive the program, and a syntax error in a
+// body is reported by the decl_code() call that parses it.
+void set_lazy_function_bodies(bool enabled);
+// The body of a function, parsed on first use when it was deferred.
+struct stmt* decl_code(struct decl* d);
 void free_ast(struct program* root);
-void free_node(struct decl* declaration);
 void print_type(struct type* type, int indent);
 void print_expr(struct expr* expr, int indent);
 void print_stmt(struct stmt* stmt, int indent);
@@ -226,16 +255,15 @@ bool is_empty(struct stack* stack);
 int scope_level(struct stack* stack);
 
 void insert_symbol(struct symbol_table* table, struct symbol* symbol);
-bool is_symbol_redeclared(struct symbol_table* table, char* name);
+bool is_symbol_redeclared(struct symbol_table* table, uint32_t name_id);
 struct symbol_table* copy_symbol_table(struct symbol_table* original); 
 void free_stack(struct stack* stack);
-void free_symbol(struct symbol* symbol);
 
 void debug_print_scope_stack(struct stack* stack, const char* location);
 struct stack* create_stack();
-struct symbol* create_symbol(symbol_t kind, struct type* type, char* name);
-struct symbol* scope_lookup(struct stack* stack, char* name, int* found_scope);
-struct symbol* scope_lookup_current(struct stack* stack, char* name);
+struct symbol* create_symbol(symbol_t kind, struct type* type, uint32_t name_id);
+struct symbol* scope_lookup(struct stack* stack, uint32_t name_id, int* found_scope);
+struct symbol* scope_lookup_current(struct stack* stack, uint32_t name_id);
 
 void print_symbol_table(struct stack* stack);
 
@@ -249,11 +277,65 @@ void param_list_resolve(struct param_list* params, struct stack* stack);
 
 struct type* type_create(type_t kind, struct type* subtype, struct param_list* params);
 bool type_equals(struct type* a, struct type* b);
-void type_delete(struct type* t);
 struct type* expr_typecheck(struct expr* e, struct stack* stack);
 void decl_typecheck(struct decl* d, struct stack* stack);
 void stmt_typecheck(struct stmt* s, struct stack* stack);
 void program_typecheck(struct program* p, struct stack* stack);
 struct type* type_copy(struct type* t); // FOR Compound types
 
+// COMPACT AST //
+// A parsed program lowered into parallel arrays. A node is a 32-bit index
+// into the arrays of its group and COMPACT_NONE (0) stands for no node, so a
+// leaf costs its kind and one value. Kind-specific payloads live in side
+// tables: names, string literals, and the rarely used statement fields.
+// Types are shared with the program it was built from. It is a copy for
+// measuring layout; resolution, typechecking and codegen use the program.
+#define COMPACT_NONE 0
+
+struct compact_stmt_extra {
+    uint32_t decl;
+    uint32_t init_expr;
+    uint32_t next_expr;
+    uint32_t else_body;
+};
+
+struct compact_ast {
+    // EXPR_NAME, EXPR_ARRAY and EXPR_CALL: expr_value indexes names;
+    // EXPR_STRING: strings; EXPR_CHARACTER: the character; others the integer
+    uint8_t* expr_kind;
+    uint32_t* expr_left;
+    uint32_t* expr_right;
+    uint32_t* expr_value;
+    uint32_t expr_count;
+
+    uint32_t* name_id;
+    uint32_t name_count;
+
+    char** strings;
+    uint32_t string_count;
+
+    uint8_t* stmt_kind;
+    uint32_t* stmt_expr;
+    uint32_t* stmt_body;
+    uint32_t* stmt_next;
+    uint32_t* stmt_extra;    // into stmt_extras, COMPACT_NONE when all are empty
+    uint32_t stmt_count;
+
+    struct compact_stmt_extra* stmt_extras;
+    uint32_t stmt_extra_count;
+
+    uint32_t* decl_name_id;
+    struct type** decl_type;
+    uint32_t* decl_value;
+    uint32_t* decl_code;
+    uint32_t* decl_next;
+    uint32_t decl_count;
+
+    uint32_t declaration;    // the first top-level declaration
+};
+
+struct compact_ast* compact_program(struct program* program);
+size_t compact_ast_bytes(const struct compact_ast* ast);
+void free_compact_ast(struct compact_ast* ast);
+
 #endif
\ No newline at end of file
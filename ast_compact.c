@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+// Nodes are numbered in preorder, so a function's statements and
+// expressions sit next to each other and a parent comes before its
+// children. Every array is sized by a counting pass first.
+
+typedef struct {
+    uint32_t exprs;
+    uint32_t names;
+    uint32_t strings;
+    uint32_t stmts;
+    uint32_t stmt_extras;
+    uint32_t decls;
+} CompactCounts;
+
+static bool has_name(expr_t kind) {
+    return kind == EXPR_NAME || kind == EXPR_ARRAY || kind == EXPR_CALL;
+}
+
+static void count_decls(CompactCounts* counts, struct decl* d);
+
+static void count_expr(CompactCounts* counts, struct expr* e) {
+    while (e) {
+        counts->exprs++;
+        if (has_name(e->kind)) counts->names++;
+        if (e->kind == EXPR_STRING) counts->strings++;
+        count_expr(counts, e->left);
+        e = e->right;
+    }
+}
+
+static void count_stmts(CompactCounts* counts, struct stmt* s) {
+    for (; s; s = s->next) {
+        counts->stmts++;
+        if (s->decl || s->init_expr || s->next_expr || s->else_body) counts->stmt_extras++;
+        count_decls(counts, s->decl);
+        count_expr(counts, s->init_expr);
+        count_expr(counts, s->expr);
+        count_expr(counts, s->next_expr);
+        count_stmts(counts, s->body);
+        count_stmts(counts, s->else_body);
+    }
+}
+
+static void count_decls(CompactCounts* counts, struct decl* d) {
+    for (; d; d = d->next) {
+        counts->decls++;
+        count_expr(counts, d->value);
+        count_stmts(counts, decl_code(d));
+    }
+}
+
+static uint32_t lower_decls(struct compact_ast* ast, struct decl* d);
+
+static uint32_t lower_expr(struct compact_ast* ast, struct expr* e) {
+    if (!e) return COMPACT_NONE;
+
+    uint32_t index = ++ast->expr_count;
+    ast->expr_kind[index] = e->kind;
+
+    if (has_name(e->kind)) {
+        uint32_t name = ++ast->name_count;
+        ast->name_id[name] = e->name_id;
+        ast->expr_value[index] = name;
+    } else if (e->kind == EXPR_STRING) {
+        uint32_t string = ++ast->string_count;
+        ast->strings[string] = e->string_literal;
+        ast->expr_value[index] = string;
+    } else if (e->kind == EXPR_CHARACTER) {
+        ast->expr_value[index] = (unsigned char)e->ch_expr;
+    } else {
+        ast->expr_value[index] = (uint32_t)e->integer_value;
+    }
+
+    ast->expr_left[index] = lower_expr(ast, e->left);
+    ast->expr_right[index] = lower_expr(ast, e->right);
+    return index;
+}
+
+static uint32_t lower_stmts(struct compact_ast* ast, struct stmt* s) {
+    uint32_t first = COMPACT_NONE;
+    uint32_t previous = COMPACT_NONE;
+
+    for (; s; s = s->next) {
+        uint32_t index = ++ast->stmt_count;
+        if (previous) {
+            ast->stmt_next[previous] = index;
+        } else {
+            first = index;
+        }
+        previous = index;
+
+        ast->stmt_kind[index] = s->kind;
+        ast->stmt_next[index] = COMPACT_NONE;
+        ast->stmt_extra[index] = COMPACT_NONE;
+        if (s->decl || s->init_expr || s->next_expr || s->else_body) {
+            uint32_t extra = ++ast->stmt_extra_count;
+            ast->stmt_extra[index] = extra;
+            ast->stmt_extras[extra].decl = lower_decls(ast, s->decl);
+            ast->stmt_extras[extra].init_expr = lower_expr(ast, s->init_expr);
+        }
+
+        ast->stmt_expr[index] = lower_expr(ast, s->expr);
+        if (ast->stmt_extra[index]) {
+            ast->stmt_extras[ast->stmt_extra[index]].next_expr = lower_expr(ast, s->next_expr);
+        }
+        ast->stmt_body[index] = lower_stmts(ast, s->body);
+        if (ast->stmt_extra[index]) {
+            ast->stmt_extras[ast->stmt_extra[index]].else_body = lower_stmts(ast, s->else_body);
+        }
+    }
+    return first;
+}
+
+static uint32_t lower_decls(struct compact_ast* ast, struct decl* d) {
+    uint32_t first = COMPACT_NONE;
+    uint32_t previous = COMPACT_NONE;
+
+    for (; d; d = d->next) {
+        uint32_t index = ++ast->decl_count;
+        if (previous) {
+            ast->decl_next[previous] = index;
+        } else {
+            first = index;
+        }
+        previous = index;
+
+        ast->decl_name_id[index] = d->name_id;
+        ast->decl_type[index] = d->type;
+        ast->decl_next[index] = COMPACT_NONE;
+        ast->decl_value[index] = lower_expr(ast, d->value);
+        ast->decl_code[index] = lower_stmts(ast, decl_code(d));
+    }
+    return first;
+}
+
+static void* compact_array(uint32_t count, size_t size, bool* ok) {
+    // index 0 is COMPACT_NONE, so every array has one slot more
+    void* array = calloc((size_t)count + 1, size);
+    if (!array) *ok = false;
+    return array;
+}
+
+struct compact_ast* compact_program(struct program* program) {
+    if (!program) return NULL;
+
+    CompactCounts counts = {0};
+    count_decls(&counts, program->declaration);
+
+    struct compact_ast* ast = calloc(1, sizeof(struct compact_ast));
+    if (!ast) {
+        fprintf(stderr, "Error: Failed to allocate compact AST\n");
+        return NULL;
+    }
+
+    bool ok = true;
+    ast->expr_kind = compact_array(counts.exprs, sizeof(uint8_t), &ok);
+    ast->expr_left = compact_array(counts.exprs, sizeof(uint32_t), &ok);
+    ast->expr_right = compact_array(counts.exprs, sizeof(uint32_t), &ok);
+    ast->expr_value = compact_array(counts.exprs, sizeof(uint32_t), &ok);
+    ast->name_id = compact_array(counts.names, sizeof(uint32_t), &ok);
+    ast->strings = compact_array(counts.strings, sizeof(char*), &ok);
+    ast->stmt_kind = compact_array(counts.stmts, sizeof(uint8_t), &ok);
+    ast->stmt_expr = compact_array(counts.stmts, sizeof(uint32_t), &ok);
+    ast->stmt_body = compact_array(counts.stmts, sizeof(uint32_t), &ok);
+    ast->stmt_next = compact_array(counts.stmts, sizeof(uint32_t), &ok);
+    ast->stmt_extra = compact_array(counts.stmts, sizeof(uint32_t), &ok);
+    ast->stmt_extras = compact_array(counts.stmt_extras, sizeof(struct compact_stmt_extra), &ok);
+    ast->decl_name_id = compact_array(counts.decls, sizeof(uint32_t), &ok);
+    ast->decl_type = compact_array(counts.decls, sizeof(struct type*), &ok);
+    ast->decl_value = compact_array(counts.decls, sizeof(uint32_t), &ok);
+    ast->decl_code = compact_array(counts.decls, sizeof(uint32_t), &ok);
+    ast->decl_next = compact_array(counts.decls, sizeof(uint32_t), &ok);
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to allocate compact AST\n");
+        free_compact_ast(ast);
+        return NULL;
+    }
+
+    ast->declaration = lower_decls(ast, program->declaration);
+    return ast;
+}
+
+size_t compact_ast_bytes(const struct compact_ast* ast) {
+    if (!ast) return 0;
+
+    size_t expr_bytes = sizeof(uint8_t) + 3 * sizeof(uint32_t);
+    size_t name_bytes = sizeof(uint32_t);
+    size_t stmt_bytes = sizeof(uint8_t) + 4 * sizeof(uint32_t);
+    size_t decl_bytes = 4 * sizeof(uint32_t) + sizeof(struct type*);
+
+    return sizeof(struct compact_ast) +
+        (ast->expr_count + 1) * expr_bytes +
+        (ast->name_count + 1) * name_bytes +
+        (ast->string_count + 1) * sizeof(char*) +
+        (ast->stmt_count + 1) * stmt_bytes +
+        (ast->stmt_extra_count + 1) * sizeof(struct compact_stmt_extra) +
+        (ast->decl_count + 1) * decl_bytes;
+}
+
+void free_compact_ast(struct compact_ast* ast) {
+    if (!ast) return;
+
+    free(ast->expr_kind);
+    free(ast->expr_left);
+    free(ast->expr_right);
+    free(ast->expr_value);
+    free(ast->name_id);
+    free(ast->strings);
+    free(ast->stmt_kind);
+    free(ast->stmt_expr);
+    free(ast->stmt_body);
+    free(ast->stmt_next);
+    free(ast->stmt_extra);
+    free(ast->stmt_extras);
+    free(ast->decl_name_id);
+    free(ast->decl_type);
+    free(ast->decl_value);
+    free(ast->decl_code);
+    free(ast->decl_next);
+    free(ast);
+}
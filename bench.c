@@ -0,0 +1,1042 @@
+// Front-end micro benchmarks.
+// Build: cc -O2 -pthread -o bench bench.c lexer.c lexer_simd.c lexer_parallel.c intern.c source.c
+//        parser.c parser_parallel.c semantics_other.c arena.c ast_compact.c
+// Usage: ./bench [identifiers]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "lexer.h"
+#include "ast.h"
+#include "source.h"
+
+#define DEFAULT_IDENTIFIERS 1000000
+#define PROGRAM_BYTES (16 * 1024 * 1024)
+#define BENCH_RUNS 5
+#define MAX_LEX_THREADS 8
+#define RELEX_LINES 100000
+#define RELEX_RANDOM_EDITS 200000
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Identifier-heavy input: mostly user names, with a keyword every few words.
+static char* generate_identifier_source(int count, size_t* out_length) {
+    static const char* words[] = {"int", "char", "boolean", "if", "else", "for", "while", "return", "void",
+                                  "struct", "break", "continue"};
+    static const char* names[] = {"counter", "index", "value", "i", "buffer_length", "result", "tmp",
+                                  "node", "in", "form", "whiles", "returned", "x1", "total_bytes"};
+    int num_words = sizeof(words) / sizeof(words[0]);
+    int num_names = sizeof(names) / sizeof(names[0]);
+
+    size_t capacity = (size_t)count * 16 + 1;
+    char* source = malloc(capacity);
+    if (!source) return NULL;
+
+    size_t length = 0;
+    unsigned int seed = 12345;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        const char* word = (seed >> 16) % 4 == 0 ? words[(seed >> 8) % num_words] : names[(seed >> 8) % num_names];
+        length += snprintf(source + length, capacity - length, "%s%c", word, i % 8 == 7 ? '\n' : ' ');
+    }
+
+    *out_length = length;
+    return source;
+}
+
+// Program-shaped input: functions with declarations, loops and arithmetic.
+static char* generate_program_source(size_t target_bytes, size_t* out_length) {
+    size_t capacity = target_bytes + 1024;
+    char* source = malloc(capacity);
+    if (!source) return NULL;
+
+    size_t length = 0;
+    int function = 0;
+    while (length < target_bytes) {
+        length += snprintf(source + length, capacity - length,
+            "int function_%d(int left_value, int right_value) {\n"
+            "    int accumulator_%d = left_value * 42 + right_value;\n"
+            "    while (accumulator_%d < 1000) {\n"
+            "        accumulator_%d += (left_value - 3) / 2;\n"
+            "    }\n"
+            "    if (accumulator_%d >= right_value) {\n"
+            "        return accumulator_%d;\n"
+            "    }\n"
+            "    return -1;\n"
+            "}\n\n",
+            function, function, function, function, function, function);
+        function++;
+        if (capacity - length < 512) break;
+    }
+
+    *out_length = length;
+    return source;
+}
+
+// Expression-dense input: long operator chains over every precedence level.
+static char* generate_expression_source(size_t target_bytes, size_t* out_length) {
+    size_t capacity = target_bytes + 1024;
+    char* source = malloc(capacity);
+    if (!source) return NULL;
+
+    size_t length = 0;
+    int function = 0;
+    while (length < target_bytes && capacity - length > 1024) {
+        length += snprintf(source + length, capacity - length,
+            "int expression_%d(int a, int b) {\n"
+            "    a += b * 3 - (a + 7) / 2 * b + a * a - %d / (b + 1) * 5 - 9;\n"
+            "    b = a -= (b - a * 2 + 3) * (a / 4 - b) + 11 * a - b / 6;\n"
+            "    while (a * 2 + b / 3 - 1 < b - a * (a + %d) == a + b * 4 - 8 >= 0) {\n"
+            "        b *= a + b - 1 * (2 + a) / (b - 3) + a * b * 4 - 5;\n"
+            "    }\n"
+            "    return a * b + (a - b) / 2 - b * 3 + %d;\n"
+            "}\n\n",
+            function, function, function, function);
+        function++;
+    }
+
+    *out_length = length;
+    return source;
+}
+
+// Generated-code shape: deep indentation and long identifiers.
+static char* generate_wide_source(size_t target_bytes, size_t* out_length) {
+    size_t capacity = target_bytes + 1024;
+    char* source = malloc(capacity);
+    if (!source) return NULL;
+
+    size_t length = 0;
+    int line = 0;
+    while (length < target_bytes && capacity - length > 512) {
+        length += snprintf(source + length, capacity - length,
+            "                        generated_accumulator_for_stage_%d_of_pipeline += "
+            "generated_input_value_from_previous_stage_%d * 1000000007;\n\n",
+            line, line);
+        line++;
+    }
+
+    *out_length = length;
+    return source;
+}
+
+static void bench_keyword_lookup(char* source) {
+    const char* starts[64];
+    int lengths[64];
+    long total = 0;
+    long hits_old = 0;
+    long hits_new = 0;
+
+    double old_time = 0;
+    double new_time = 0;
+    char* cursor = source;
+
+    // Classify the lexemes in batches so both paths see the same cache state.
+    while (*cursor) {
+        int batch = 0;
+        while (*cursor && batch < 64) {
+            while (*cursor == ' ' || *cursor == '\n') cursor++;
+            if (!*cursor) break;
+            starts[batch] = cursor;
+            while (*cursor && *cursor != ' ' && *cursor != '\n') cursor++;
+            lengths[batch] = cursor - starts[batch];
+            batch++;
+        }
+
+        double start = now_seconds();
+        for (int i = 0; i < batch; i++) {
+            char* text = strndup(starts[i], lengths[i]);
+            keyword_t keyword_type = get_keyword_type(text);
+            if (keyword_type != KEYWORD_UNKNOWN) {
+                Keyword word = { .type = keyword_type, .name = text };
+                if (keyword_to_token(&word) != TOKEN_ID) hits_old++;
+            }
+            free(text);
+        }
+        old_time += now_seconds() - start;
+
+        start = now_seconds();
+        for (int i = 0; i < batch; i++) {
+            if (lookup_keyword(starts[i], lengths[i]) != TOKEN_ID) hits_new++;
+        }
+        new_time += now_seconds() - start;
+
+        total += batch;
+    }
+
+    if (hits_old != hits_new) {
+        fprintf(stderr, "Error: keyword lookups disagree (%ld vs %ld)\n", hits_old, hits_new);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("keyword lookup: %ld lexemes, %ld keywords\n", total, hits_new);
+    printf("  linear strcmp: %8.2f ns/lexeme\n", old_time * 1e9 / total);
+    printf("  perfect hash:  %8.2f ns/lexeme\n", new_time * 1e9 / total);
+}
+
+static bool same_tokens(Token* expected, Token* actual) {
+    for (int i = 0; ; i++) {
+        if (expected[i].type != actual[i].type || expected[i].offset != actual[i].offset ||
+            expected[i].length != actual[i].length || expected[i].line != actual[i].line ||
+            expected[i].column != actual[i].column ||
+            expected[i].value.integer_value != actual[i].value.integer_value) {
+            fprintf(stderr, "Error: token %d differs (type %d/%d, offset %d/%d, line %d/%d, column %d/%d)\n",
+                i, expected[i].type, actual[i].type, expected[i].offset, actual[i].offset,
+                expected[i].line, actual[i].line, expected[i].column, actual[i].column);
+            return false;
+        }
+        if (expected[i].type == TOKEN_EOF) return true;
+    }
+}
+
+// Differential check: every supported SIMD kernel must produce the scalar token stream.
+static bool verify_scan_kernels(char* source) {
+    scan_kernel_t selected = get_scan_kernel();
+    bool ok = true;
+
+    set_scan_kernel(SCAN_KERNEL_SCALAR);
+    Token* expected = lexical_analysis(source);
+
+    for (scan_kernel_t kind = SCAN_KERNEL_SSE2; kind <= SCAN_KERNEL_AVX2; kind++) {
+        if (!set_scan_kernel(kind)) continue;
+
+        Token* actual = lexical_analysis(source);
+        if (!same_tokens(expected, actual)) {
+            fprintf(stderr, "Error: %s scanner disagrees with scalar scanner\n", scan_kernel_name(kind));
+            ok = false;
+        }
+        free_tokens(actual);
+    }
+
+    free_tokens(expected);
+    set_scan_kernel(selected);
+    return ok;
+}
+
+static bool verify_scan_kernel_edges() {
+    static const char* cases[] = {
+        "",
+        "x",
+        "   \n\n\t  ",
+        "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789 x",
+        "int x = 123456789012345678901234567890123;",
+        "a\n \n  \n   \n    \n     \n      \n       \n        \n         \n          b",
+        "                                                                 end",
+        "while(x1_<=-42){y+=x1_;}\r\n\v\f\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\nz",
+        "name_ending_exactly_at_sixteen_",
+        "q\x80\xff{}@`[]^~",
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char* copy = strdup(cases[i]);
+        bool ok = verify_scan_kernels(copy);
+        free(copy);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void bench_lexical_analysis(const char* label, char* source, size_t length) {
+    double best = 0;
+    int count = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now_seconds();
+        Token* tokens = lexical_analysis(source);
+        double elapsed = now_seconds() - start;
+        if (run == 0 || elapsed < best) best = elapsed;
+
+        count = 0;
+        while (tokens[count].type != TOKEN_EOF) count++;
+        free_tokens(tokens);
+    }
+
+    printf("lexical_analysis (%s, %.1f MB): %d tokens, %.2f MB/s\n", label, length / 1e6, count,
+        length / best / 1e6);
+}
+
+static void bench_scan_kernels(const char* input, char* source, size_t length) {
+    scan_kernel_t selected = get_scan_kernel();
+
+    for (scan_kernel_t kind = SCAN_KERNEL_SCALAR; kind <= SCAN_KERNEL_AVX2; kind++) {
+        if (!set_scan_kernel(kind)) continue;
+
+        char label[64];
+        snprintf(label, sizeof(label), "%s, %s", input, scan_kernel_name(kind));
+        bench_lexical_analysis(label, source, length);
+    }
+
+    set_scan_kernel(selected);
+}
+
+static int count_tokens(Token* tokens) {
+    int count = 1;
+    while (tokens[count - 1].type != TOKEN_EOF) count++;
+    return count;
+}
+
+// The parallel lexer must reproduce the serial token array byte for byte,
+// including identifier ids, so both start from an empty interner.
+static bool verify_parallel_lexing(char* source, size_t length) {
+    for (int threads = 2; threads <= MAX_LEX_THREADS; threads *= 2) {
+        free_interner();
+        Token* actual = lexical_analysis_parallel(source, length, threads);
+        free_interner();
+        Token* expected = lexical_analysis_range(source, length);
+
+        int count = count_tokens(expected);
+        bool ok = actual && count_tokens(actual) == count && same_tokens(expected, actual) &&
+            memcmp(expected, actual, sizeof(Token) * count) == 0;
+        free_tokens(expected);
+        free_tokens(actual);
+        if (!ok) {
+            fprintf(stderr, "Error: parallel lexer with %d threads disagrees with serial lexer\n", threads);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bench_parallel_lexing(const char* label, char* source, size_t length) {
+    double serial = 0;
+
+    for (int threads = 1; threads <= MAX_LEX_THREADS; threads *= 2) {
+        double best = 0;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            double start = now_seconds();
+            Token* tokens = lexical_analysis_parallel(source, length, threads);
+            double elapsed = now_seconds() - start;
+            if (run == 0 || elapsed < best) best = elapsed;
+            free_tokens(tokens);
+        }
+        if (threads == 1) serial = best;
+
+        printf("parallel lexing (%s, %d threads): %.2f MB/s, %.2fx\n", label, threads, length / best / 1e6,
+            serial / best);
+    }
+}
+
+static bool verify_token_table(char* source, size_t length) {
+    Token* tokens = lexical_analysis_range(source, length);
+    TokenTable* table = lexical_analysis_compact(source, length);
+    Lexer* replay = table ? init_lexer_table(table) : NULL;
+    bool ok = tokens && replay && table->count == count_tokens(tokens);
+
+    for (int i = 0; ok && i < table->count; i++) {
+        Token random = token_table_get(table, i);
+        Token sequential = next_token(replay);
+        // replay leaves the position to be looked up, as a diagnostic would
+        ok = sequential.line == 0 && sequential.column == 0 &&
+            token_table_position(table, i, &sequential.line, &sequential.column);
+        ok = ok && memcmp(&tokens[i], &random, sizeof(Token)) == 0 && memcmp(&tokens[i], &sequential, sizeof(Token)) == 0;
+        if (!ok) fprintf(stderr, "Error: token table differs from token array at token %d\n", i);
+    }
+
+    free_lexer(replay);
+    free_token_table(table);
+    free_tokens(tokens);
+    return ok;
+}
+
+static int brace_depth_tokens(Token* tokens) {
+    int depth = 0;
+    int deepest = 0;
+    for (int i = 0; tokens[i].type != TOKEN_EOF; i++) {
+        if (tokens[i].type == TOKEN_LEFT_BRACE && ++depth > deepest) deepest = depth;
+        if (tokens[i].type == TOKEN_RIGHT_BRACE) depth--;
+    }
+    return deepest;
+}
+
+static int brace_depth_table(const TokenTable* table) {
+    int depth = 0;
+    int deepest = 0;
+    for (int i = 0; i < table->count; i++) {
+        if (table->kinds[i] == TOKEN_LEFT_BRACE && ++depth > deepest) deepest = depth;
+        if (table->kinds[i] == TOKEN_RIGHT_BRACE) depth--;
+    }
+    return deepest;
+}
+
+static void bench_token_table(const char* label, char* source, size_t length) {
+    double best_array = 0;
+    double best_table = 0;
+    double scan_array = 0;
+    double scan_table = 0;
+    size_t array_bytes = 0;
+    size_t table_bytes = 0;
+    int depth_array = 0;
+    int depth_table = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now_seconds();
+        Token* tokens = lexical_analysis_range(source, length);
+        double built = now_seconds();
+        depth_array = brace_depth_tokens(tokens);
+        double scanned = now_seconds();
+        if (run == 0 || built - start < best_array) best_array = built - start;
+        if (run == 0 || scanned - built < scan_array) scan_array = scanned - built;
+        array_bytes = count_tokens(tokens) * sizeof(Token);
+        free_tokens(tokens);
+
+        start = now_seconds();
+        TokenTable* table = lexical_analysis_compact(source, length);
+        built = now_seconds();
+        depth_table = brace_depth_table(table);
+        scanned = now_seconds();
+        if (run == 0 || built - start < best_table) best_table = built - start;
+        if (run == 0 || scanned - built < scan_table) scan_table = scanned - built;
+
+        // A single diagnostic pays for the line index.
+        int line, column;
+        token_table_position(table, table->count - 1, &line, &column);
+        table_bytes = token_table_bytes(table);
+        free_token_table(table);
+    }
+
+    if (depth_array != depth_table) {
+        fprintf(stderr, "Error: token table scan disagrees with token array scan\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("token storage (%s): array %.1f MB, table %.1f MB with line index (%.1fx smaller)\n", label,
+        array_bytes / 1e6, table_bytes / 1e6, (double)array_bytes / table_bytes);
+    printf("  lex: array %.2f ms, table %.2f ms; kind scan: array %.2f ms, table %.2f ms\n",
+        best_array * 1e3, best_table * 1e3, scan_array * 1e3, scan_table * 1e3);
+}
+
+// Operands must group by precedence: a += b - c is a += (b - c), and
+// assignments nest to the right.
+static bool verify_expression_grouping() {
+    char source[] = "int f(int a, int b) { a = b += a - b * 2; return a; }";
+    Lexer* lexer = init_lexer_range(source, strlen(source));
+    struct program* ast = build_ast(lexer);
+    struct expr* e = ast && ast->declaration ? ast->declaration->code->expr : NULL;
+
+    bool grouped = e && e->kind == EXPR_ASSIGNMENT &&
+        e->right->kind == EXPR_ADD_AND_ASSIGN &&
+        e->right->right->kind == EXPR_SUB &&
+        e->right->right->right->kind == EXPR_MUL;
+    if (!grouped) fprintf(stderr, "Error: Expression operands grouped wrongly\n");
+
+    free_ast(ast);
+    free_lexer(lexer);
+    return grouped;
+}
+
+// build_ast() takes every node from one arena and free_ast() releases it whole.
+static void bench_parsing(const char* label, char* source, size_t length) {
+    double best_parse = 0;
+    double best_free = 0;
+    size_t nodes = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        Lexer* lexer = init_lexer_range(source, length);
+        double start = now_seconds();
+        struct program* ast = build_ast(lexer);
+        double built = now_seconds();
+
+        const ArenaStats* stats = get_arena_stats(ast->arena);
+        nodes = 0;
+        for (int kind = 0; kind < ARENA_KINDS; kind++) nodes += stats->nodes[kind];
+        if (run == BENCH_RUNS - 1) print_arena_stats(stdout, ast->arena);
+
+        double freeing = now_seconds();
+        free_ast(ast);
+        double freed = now_seconds();
+        free_lexer(lexer);
+
+        if (run == 0 || built - start < best_parse) best_parse = built - start;
+        if (run == 0 || freed - freeing < best_free) best_free = freed - freeing;
+    }
+
+    printf("parsing (%s, %.1f MB): %zu nodes, build_ast %.2f ms (%.2f MB/s), free_ast %.3f ms\n", label,
+        length / 1e6, nodes, best_parse * 1e3, length / best_parse / 1e6, best_free * 1e3);
+}
+
+// Structural equality of two trees parsed from the same source, so names
+// compare by id and types by shape.
+static bool same_type(struct type* a, struct type* b) {
+    if (!a || !b) return !a && !b;
+    if (a->kind != b->kind || !same_type(a->subtype, b->subtype)) return false;
+
+    struct param_list* p = a->params;
+    struct param_list* q = b->params;
+    for (; p && q; p = p->next, q = q->next) {
+        if (p->name_id != q->name_id || !same_type(p->type, q->type)) return false;
+    }
+    return !p && !q;
+}
+
+static bool same_expr(struct expr* a, struct expr* b) {
+    if (!a || !b) return !a && !b;
+    if (a->kind != b->kind || a->integer_value != b->integer_value || a->ch_expr != b->ch_expr ||
+        a->name_id != b->name_id) {
+        return false;
+    }
+    if ((a->string_literal || b->string_literal) &&
+        (!a->string_literal || !b->string_literal || strcmp(a->string_literal, b->string_literal) != 0)) {
+        return false;
+    }
+    return same_expr(a->left, b->left) && same_expr(a->right, b->right);
+}
+
+static bool same_decls(struct decl* a, struct decl* b);
+
+static bool same_stmts(struct stmt* a, struct stmt* b) {
+    for (; a && b; a = a->next, b = b->next) {
+        if (a->kind != b->kind || !same_decls(a->decl, b->decl) || !same_expr(a->init_expr, b->init_expr) ||
+            !same_expr(a->expr, b->expr) || !same_expr(a->next_expr, b->next_expr) ||
+            !same_stmts(a->body, b->body) || !same_stmts(a->else_body, b->else_body)) {
+            return false;
+        }
+    }
+    return !a && !b;
+}
+
+static bool same_decls(struct decl* a, struct decl* b) {
+    for (; a && b; a = a->next, b = b->next) {
+        if (a->name_id != b->name_id || !same_type(a->type, b->type) || !same_expr(a->value, b->value) ||
+            !same_stmts(decl_code(a), decl_code(b))) {
+            return false;
+        }
+    }
+    return !a && !b;
+}
+
+// With lazy bodies on, build_ast() only brace-matches each function and
+// decl_code() parses a body on first use; "all bodies" is the case where a
+// later phase asks for every one of them.
+static bool verify_lazy_parsing(char* source, size_t length) {
+    Lexer* eager_lexer = init_lexer_range(source, length);
+    struct program* eager = build_ast(eager_lexer);
+    set_lazy_function_bodies(true);
+    Lexer* lazy_lexer = init_lexer_range(source, length);
+    struct program* lazy = build_ast(lazy_lexer);
+    set_lazy_function_bodies(false);
+
+    bool same = same_decls(eager->declaration, lazy->declaration);
+    if (!same) fprintf(stderr, "Error: lazily parsed bodies differ from the eager parse\n");
+
+    free_ast(lazy);
+    free_lexer(lazy_lexer);
+    free_ast(eager);
+    free_lexer(eager_lexer);
+    return same;
+}
+
+static void bench_lazy_parsing(const char* label, char* source, size_t length) {
+    double best_parse[2] = {0, 0};
+    double best_bodies = 0;
+    size_t bytes[2] = {0, 0};
+    size_t bytes_bodies = 0;
+
+    for (int lazy = 0; lazy < 2; lazy++) {
+        set_lazy_function_bodies(lazy);
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            Lexer* lexer = init_lexer_range(source, length);
+            double start = now_seconds();
+            struct program* ast = build_ast(lexer);
+            double built = now_seconds();
+            bytes[lazy] = get_arena_stats(ast->arena)->bytes_used;
+
+            if (lazy) {
+                for (struct decl* d = ast->declaration; d; d = d->next) decl_code(d);
+                double parsed = now_seconds();
+                bytes_bodies = get_arena_stats(ast->arena)->bytes_used;
+                if (run == 0 || parsed - built < best_bodies) best_bodies = parsed - built;
+            }
+
+            free_ast(ast);
+            free_lexer(lexer);
+            if (run == 0 || built - start < best_parse[lazy]) best_parse[lazy] = built - start;
+        }
+    }
+    set_lazy_function_bodies(false);
+
+    printf("lazy parsing (%s, %.1f MB): build_ast eager %.2f ms, %.1f MB; lazy %.2f ms, %.1f MB\n", label,
+        length / 1e6, best_parse[0] * 1e3, bytes[0] / 1e6, best_parse[1] * 1e3, bytes[1] / 1e6);
+    printf("  all bodies parsed later: %.2f ms more, %.1f MB\n", best_bodies * 1e3, bytes_bodies / 1e6);
+}
+
+// build_ast_parallel() must give build_ast()'s tree at every thread count.
+static bool verify_parallel_parsing(char* source, size_t length) {
+    Lexer* lexer = init_lexer_range(source, length);
+    struct program* serial = build_ast(lexer);
+    bool same = true;
+
+    for (int threads = 1; threads <= MAX_LEX_THREADS && same; threads *= 2) {
+        struct program* parallel = build_ast_parallel(source, length, threads);
+        same = parallel && same_decls(serial->declaration, parallel->declaration);
+        if (!same) fprintf(stderr, "Error: parallel parse with %d threads differs from the serial one\n", threads);
+        free_ast(parallel);
+    }
+
+    free_ast(serial);
+    free_lexer(lexer);
+    return same;
+}
+
+static void bench_parallel_parsing(const char* label, char* source, size_t length) {
+    double serial = 0;
+    int functions = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        Lexer* lexer = init_lexer_range(source, length);
+        double start = now_seconds();
+        struct program* ast = build_ast(lexer);
+        double elapsed = now_seconds() - start;
+        if (run == 0 || elapsed < serial) serial = elapsed;
+
+        functions = 0;
+        for (struct decl* d = ast->declaration; d; d = d->next) functions += d->type->kind == TYPE_FUNCTION;
+        free_ast(ast);
+        free_lexer(lexer);
+    }
+    printf("parallel parsing (%s, %.1f MB, %d functions): build_ast %.2f ms\n", label, length / 1e6,
+        functions, serial * 1e3);
+
+    for (int threads = 1; threads <= MAX_LEX_THREADS; threads *= 2) {
+        double best = 0;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            double start = now_seconds();
+            struct program* ast = build_ast_parallel(source, length, threads);
+            double elapsed = now_seconds() - start;
+            free_ast(ast);
+            if (run == 0 || elapsed < best) best = elapsed;
+        }
+        printf("  %d threads: %.2f ms (%.2fx)\n", threads, best * 1e3, serial / best);
+    }
+}
+
+static bool same_compact_decls(struct decl* d, const struct compact_ast* ast, uint32_t index);
+
+static bool same_compact_expr(struct expr* e, const struct compact_ast* ast, uint32_t index) {
+    if (!e || !index) return !e && !index;
+    if (ast->expr_kind[index] != e->kind) return false;
+
+    uint32_t value = ast->expr_value[index];
+    if (e->kind == EXPR_NAME || e->kind == EXPR_ARRAY || e->kind == EXPR_CALL) {
+        if (ast->name_id[value] != e->name_id) return false;
+    } else if (e->kind == EXPR_STRING) {
+        if (strcmp(ast->strings[value], e->string_literal) != 0) return false;
+    } else if (e->kind == EXPR_CHARACTER) {
+        if (value != (unsigned char)e->ch_expr) return false;
+    } else if ((int)value != e->integer_value) {
+        return false;
+    }
+
+    return same_compact_expr(e->left, ast, ast->expr_left[index]) &&
+        same_compact_expr(e->right, ast, ast->expr_right[index]);
+}
+
+static bool same_compact_stmts(struct stmt* s, const struct compact_ast* ast, uint32_t index) {
+    for (; s && index; s = s->next, index = ast->stmt_next[index]) {
+        struct compact_stmt_extra extra = {0};
+        if (ast->stmt_extra[index]) extra = ast->stmt_extras[ast->stmt_extra[index]];
+
+        if (ast->stmt_kind[index] != s->kind ||
+            !same_compact_decls(s->decl, ast, extra.decl) ||
+            !same_compact_expr(s->init_expr, ast, extra.init_expr) ||
+            !same_compact_expr(s->expr, ast, ast->stmt_expr[index]) ||
+            !same_compact_expr(s->next_expr, ast, extra.next_expr) ||
+            !same_compact_stmts(s->body, ast, ast->stmt_body[index]) ||
+            !same_compact_stmts(s->else_body, ast, extra.else_body)) {
+            return false;
+        }
+    }
+    return !s && !index;
+}
+
+static bool same_compact_decls(struct decl* d, const struct compact_ast* ast, uint32_t index) {
+    for (; d && index; d = d->next, index = ast->decl_next[index]) {
+        if (ast->decl_name_id[index] != d->name_id || ast->decl_type[index] != d->type ||
+            !same_compact_expr(d->value, ast, ast->decl_value[index]) ||
+            !same_compact_stmts(decl_code(d), ast, ast->decl_code[index])) {
+            return false;
+        }
+    }
+    return !d && !index;
+}
+
+// The same fold over both forms: what a pass pays just to visit every node.
+static long walk_pointer_expr(struct expr* e) {
+    long sum = 0;
+    for (; e; e = e->right) sum += e->kind + e->integer_value + walk_pointer_expr(e->left);
+    return sum;
+}
+
+static long walk_pointer_stmts(struct stmt* s) {
+    long sum = 0;
+    for (; s; s = s->next) {
+        sum += s->kind + walk_pointer_expr(s->expr) + walk_pointer_stmts(s->body);
+        if (s->decl) sum += walk_pointer_expr(s->decl->value);
+    }
+    return sum;
+}
+
+static long walk_compact_expr(const struct compact_ast* ast, uint32_t e) {
+    long sum = 0;
+    for (; e; e = ast->expr_right[e]) {
+        int value = ast->expr_kind[e] == EXPR_NAME ? 0 : (int)ast->expr_value[e];
+        sum += ast->expr_kind[e] + value + walk_compact_expr(ast, ast->expr_left[e]);
+    }
+    return sum;
+}
+
+static long walk_compact_stmts(const struct compact_ast* ast, uint32_t s) {
+    long sum = 0;
+    for (; s; s = ast->stmt_next[s]) {
+        sum += ast->stmt_kind[s] + walk_compact_expr(ast, ast->stmt_expr[s]) + walk_compact_stmts(ast, ast->stmt_body[s]);
+        if (ast->stmt_extra[s]) {
+            uint32_t d = ast->stmt_extras[ast->stmt_extra[s]].decl;
+            if (d) sum += walk_compact_expr(ast, ast->decl_value[d]);
+        }
+    }
+    return sum;
+}
+
+static bool compact_and_verify(struct program* program, struct compact_ast** compact) {
+    *compact = compact_program(program);
+    if (!*compact || !same_compact_decls(program->declaration, *compact, (*compact)->declaration)) {
+        fprintf(stderr, "Error: compact AST disagrees with the pointer AST\n");
+        return false;
+    }
+    return true;
+}
+
+static void bench_compact_ast(const char* label, char* source, size_t length) {
+    Lexer* lexer = init_lexer_range(source, length);
+    struct program* program = build_ast(lexer);
+    struct compact_ast* compact;
+    if (!compact_and_verify(program, &compact)) exit(EXIT_FAILURE);
+
+    const ArenaStats* stats = get_arena_stats(program->arena);
+    size_t pointer_bytes = stats->nodes[ARENA_EXPR] * sizeof(struct expr) +
+        stats->nodes[ARENA_STMT] * sizeof(struct stmt) + stats->nodes[ARENA_DECL] * sizeof(struct decl);
+
+    double lower = 0;
+    double walk_pointer = 0;
+    double walk_compact = 0;
+    long sums[2] = {0, 0};
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now_seconds();
+        struct compact_ast* lowered = compact_program(program);
+        double elapsed = now_seconds() - start;
+        free_compact_ast(lowered);
+        if (run == 0 || elapsed < lower) lower = elapsed;
+
+        start = now_seconds();
+        sums[0] = 0;
+        for (struct decl* d = program->declaration; d; d = d->next) sums[0] += walk_pointer_stmts(d->code);
+        double middle = now_seconds();
+        sums[1] = 0;
+        for (uint32_t d = compact->declaration; d; d = compact->decl_next[d]) {
+            sums[1] += walk_compact_stmts(compact, compact->decl_code[d]);
+        }
+        double end = now_seconds();
+
+        if (run == 0 || middle - start < walk_pointer) walk_pointer = middle - start;
+        if (run == 0 || end - middle < walk_compact) walk_compact = end - middle;
+    }
+
+    if (sums[0] != sums[1]) {
+        fprintf(stderr, "Error: compact AST walk disagrees with the pointer AST walk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("compact AST (%s): %u expr, %u stmt, %u decl nodes\n", label, compact->expr_count,
+        compact->stmt_count, compact->decl_count);
+    printf("  node bytes: expr %zu -> %zu, stmt %zu -> %zu; tree %.1f MB -> %.1f MB\n", sizeof(struct expr),
+        sizeof(uint8_t) + 3 * sizeof(uint32_t), sizeof(struct stmt), sizeof(uint8_t) + 4 * sizeof(uint32_t),
+        pointer_bytes / 1e6, compact_ast_bytes(compact) / 1e6);
+    // the compact form is lowered from the pointer tree, so a pass over it pays for both
+    printf("  lower %.2f ms; walk: pointer %.2f ms, compact %.2f ms, %.2f ms with lowering\n", lower * 1e3,
+        walk_pointer * 1e3, walk_compact * 1e3, (lower + walk_compact) * 1e3);
+
+    free_compact_ast(compact);
+    free_ast(program);
+    free_lexer(lexer);
+}
+
+// Returns the offset of the start of line `line` (1-based).
+static size_t line_offset(const char* source, size_t length, int line) {
+    size_t offset = 0;
+    for (int current = 1; current < line && offset < length; current++) {
+        const char* newline = memchr(source + offset, '\n', length - offset);
+        if (!newline) return length;
+        offset = newline - source + 1;
+    }
+    return offset;
+}
+
+static void bench_relex_edit(const char* label, char* source, size_t length, Token* tokens, SourceEdit edit) {
+    size_t edited_length = 0;
+    char* edited = apply_source_edit(source, length, &edit, &edited_length);
+    if (!edited) exit(EXIT_FAILURE);
+
+    double best_full = 0;
+    double best_incremental = 0;
+    Token* full = NULL;
+    Token* incremental = NULL;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        free_tokens(full);
+        free_tokens(incremental);
+
+        double start = now_seconds();
+        full = lexical_analysis_range(edited, edited_length);
+        double elapsed = now_seconds() - start;
+        if (run == 0 || elapsed < best_full) best_full = elapsed;
+
+        // relex_tokens() updates its input in place, so give it a copy.
+        int count = count_tokens(tokens);
+        incremental = malloc(sizeof(Token) * count);
+        memcpy(incremental, tokens, sizeof(Token) * count);
+
+        start = now_seconds();
+        incremental = relex_tokens(incremental, &count, edited, edited_length, &edit);
+        elapsed = now_seconds() - start;
+        if (run == 0 || elapsed < best_incremental) best_incremental = elapsed;
+    }
+
+    int count = count_tokens(full);
+    if (!incremental || count_tokens(incremental) != count || memcmp(full, incremental, sizeof(Token) * count) != 0) {
+        fprintf(stderr, "Error: incremental re-lex of %s disagrees with a full re-lex\n", label);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("  %-26s full %8.3f ms, incremental %8.3f ms, %6.1fx\n", label, best_full * 1e3,
+        best_incremental * 1e3, best_full / best_incremental);
+
+    free_tokens(full);
+    free_tokens(incremental);
+    free(edited);
+}
+
+// Pieces that meet at every kind of token boundary: names and keywords,
+// numbers and negative literals, one- and two-byte operators, blanks and
+// line breaks, and bytes the scanner does not know.
+static const char* relex_fragments[] = {
+    "a", "x1", "_b", "if", "while", "int", "accumulator_0", "0", "7", "42", "-", "-3",
+    "+", "+=", "++", "--", "=", "==", "!", "!=", "<", "<=", ">", "*", "/", "(", ")",
+    "{", "}", "[", "]", ";", ",", " ", "  ", "\t", "\n", "\n\n", "\r\n", "@", "\x80",
+};
+
+static size_t append_fragments(char* buffer, int count, unsigned int* seed) {
+    int num_fragments = sizeof(relex_fragments) / sizeof(relex_fragments[0]);
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        *seed = *seed * 1103515245 + 12345;
+        const char* fragment = relex_fragments[(*seed >> 16) % num_fragments];
+        memcpy(buffer + length, fragment, strlen(fragment));
+        length += strlen(fragment);
+    }
+    return length;
+}
+
+// Differential check: random edits to random inputs must re-lex to exactly
+// what a full re-lex of the edited input gives.
+static bool verify_relex_edits() {
+    char source[512];
+    char inserted[64];
+    unsigned int seed = 12345;
+
+    for (int i = 0; i < RELEX_RANDOM_EDITS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t length = append_fragments(source, 1 + (seed >> 16) % 24, &seed);
+        source[length] = '\0';
+
+        SourceEdit edit = { .inserted = inserted };
+        seed = seed * 1103515245 + 12345;
+        edit.offset = (seed >> 16) % (length + 1);
+        seed = seed * 1103515245 + 12345;
+        edit.removed_length = (seed >> 16) % ((length - edit.offset < 6 ? length - edit.offset : 6) + 1);
+        seed = seed * 1103515245 + 12345;
+        edit.inserted_length = append_fragments(inserted, (seed >> 16) % 4, &seed);
+
+        size_t edited_length = 0;
+        char* edited = apply_source_edit(source, length, &edit, &edited_length);
+        Token* tokens = lexical_analysis_range(source, length);
+        int count = tokens ? count_tokens(tokens) : 0;
+        Token* incremental = edited && tokens ? relex_tokens(tokens, &count, edited, edited_length, &edit) : NULL;
+        Token* full = edited ? lexical_analysis_range(edited, edited_length) : NULL;
+
+        bool ok = incremental && full && count == count_tokens(full) &&
+            memcmp(incremental, full, sizeof(Token) * count) == 0;
+        if (!ok) {
+            fprintf(stderr, "Error: incremental re-lex disagrees with a full re-lex at edit %d\n", i);
+        }
+
+        free_tokens(full);
+        free_tokens(incremental ? incremental : tokens);
+        free(edited);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void bench_incremental_lexing() {
+    size_t length = 0;
+    char* source = generate_program_source(PROGRAM_BYTES / 2, &length);
+    if (!source) exit(EXIT_FAILURE);
+    length = line_offset(source, length, RELEX_LINES + 1);
+    source[length] = '\0';
+
+    Token* tokens = lexical_analysis_range(source, length);
+    printf("incremental re-lex (%d lines, %.1f MB, %d tokens):\n", RELEX_LINES, length / 1e6,
+        count_tokens(tokens));
+
+    size_t middle = line_offset(source, length, RELEX_LINES / 2 + 2);
+    const char* name = strstr(source + middle, "accumulator_");
+    bench_relex_edit("rename identifier (middle)", source, length, tokens,
+        (SourceEdit){ .offset = name - source, .removed_length = 11, .inserted = "acc", .inserted_length = 3 });
+
+    const char* statement = "        accumulator_0 += 7 * right_value;\n";
+    bench_relex_edit("insert line (middle)", source, length, tokens,
+        (SourceEdit){ .offset = middle, .removed_length = 0, .inserted = statement,
+            .inserted_length = strlen(statement) });
+
+    size_t second = line_offset(source, length, 2);
+    size_t third = line_offset(source, length, 3);
+    bench_relex_edit("delete line (start)", source, length, tokens,
+        (SourceEdit){ .offset = second, .removed_length = third - second, .inserted = "", .inserted_length = 0 });
+
+    size_t last = line_offset(source, length, RELEX_LINES - 20);
+    bench_relex_edit("change literal (end)", source, length, tokens,
+        (SourceEdit){ .offset = strstr(source + last, "1000") - source, .removed_length = 4, .inserted = "2048",
+            .inserted_length = 4 });
+
+    free_tokens(tokens);
+    free(source);
+}
+
+// Loads a file through read() and through mmap, lexing it in place each time,
+// so the difference is the copy that mapping avoids.
+static void bench_source_loading(const char* source, size_t length) {
+    char path[] = "/tmp/zcc-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to create benchmark file\n");
+        return;
+    }
+    FILE* file = fdopen(fd, "wb");
+    fwrite(source, 1, length, file);
+    fclose(file);
+
+    double best[2] = {0, 0};
+    for (int mapped = 0; mapped <= 1; mapped++) {
+        set_source_mapping(mapped);
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            double start = now_seconds();
+            SourceFile* loaded = load_source(path);
+            if (!loaded) break;
+            Token* tokens = lexical_analysis_range(loaded->data, loaded->length);
+            double elapsed = now_seconds() - start;
+            if (run == 0 || elapsed < best[mapped]) best[mapped] = elapsed;
+
+            free_tokens(tokens);
+            free_source(loaded);
+        }
+    }
+    set_source_mapping(true);
+    unlink(path);
+
+    const SourceStats* stats = get_source_stats();
+    printf("source loading (%.1f MB): read %.2f ms, mmap %.2f ms, %.2f ms saved\n", length / 1e6,
+        best[0] * 1e3, best[1] * 1e3, (best[0] - best[1]) * 1e3);
+    printf("  %zu files mapped (%zu bytes), %zu files read (%zu bytes)\n", stats->files_mapped,
+        stats->bytes_mapped, stats->files_read, stats->bytes_read);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : DEFAULT_IDENTIFIERS;
+    if (count <= 0) {
+        fprintf(stderr, "Error: identifier count must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t length = 0;
+    char* source = generate_identifier_source(count, &length);
+    if (!source) {
+        fprintf(stderr, "Error: Failed to allocate benchmark source\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!verify_scan_kernel_edges() || !verify_scan_kernels(source)) {
+        return EXIT_FAILURE;
+    }
+
+    bench_keyword_lookup(source);
+    bench_lexical_analysis("identifiers", source, length);
+    free(source);
+
+    source = generate_program_source(PROGRAM_BYTES, &length);
+    if (!source) {
+        fprintf(stderr, "Error: Failed to allocate benchmark source\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!verify_scan_kernels(source)) {
+        return EXIT_FAILURE;
+    }
+
+    bench_scan_kernels("program", source, length);
+    bench_source_loading(source, length);
+
+    if (!verify_parallel_lexing(source, length)) {
+        return EXIT_FAILURE;
+    }
+    bench_parallel_lexing("program", source, length);
+
+    if (!verify_token_table(source, length)) {
+        return EXIT_FAILURE;
+    }
+    bench_token_table("program", source, length);
+    bench_parsing("program", source, length);
+    if (!verify_lazy_parsing(source, length)) {
+        return EXIT_FAILURE;
+    }
+    bench_lazy_parsing("program", source, length);
+    if (!verify_parallel_parsing(source, length)) {
+        return EXIT_FAILURE;
+    }
+    bench_parallel_parsing("program", source, length);
+    bench_compact_ast("program", source, length);
+    free(source);
+
+    if (!verify_expression_grouping()) {
+        return EXIT_FAILURE;
+    }
+    source = generate_expression_source(PROGRAM_BYTES, &length);
+    if (!source) {
+        fprintf(stderr, "Error: Failed to allocate benchmark source\n");
+        return EXIT_FAILURE;
+    }
+    bench_parsing("expression", source, length);
+    free(source);
+
+    if (!verify_relex_edits()) {
+        return EXIT_FAILURE;
+    }
+    bench_incremental_lexing();
+
+    source = generate_wide_source(PROGRAM_BYTES, &length);
+    if (!source) {
+        fprintf(stderr, "Error: Failed to allocate benchmark source\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!verify_scan_kernels(source)) {
+        return EXIT_FAILURE;
+    }
+
+    bench_scan_kernels("wide", source, length);
+    free(source);
+
+    return EXIT_SUCCESS;
+}
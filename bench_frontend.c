@@ -0,0 +1,684 @@
+// Front-end throughput harness: generates a deterministic Z program, then
+// times preprocess() and lexical_analysis() separately, then the fused
+// preprocess_tokens() pass against the pair, and prints JSON.
+// Before timing, it checks that headers which only look include-guarded come
+// out the same on a second include.
+// --macro-depth adds a stack of nested function-like macros and calls to them,
+// and times preprocess() once more with call memoization turned off.
+// --inactive wraps that fraction of the functions in an #if that is false.
+// --include-dirs spreads the included files over that many -I directories and
+// includes them as <name>, then times preprocess() once more with the include
+// resolver's caches turned off and counts the syscalls each way.
+// Build: cc -O2 -o bench_frontend bench_frontend.c preprocessor.c preprocessor_macro.c
+//        preprocessor_conditional.c preprocessor_cache.c preprocessor_snapshot.c preprocessor_include.c
+//        lexer.c lexer_simd.c lexer_fused.c intern.c source.c
+// Usage: ./bench_frontend [--size bytes] [--identifier-density 0..1] [--nesting depth]
+//                         [--defines count] [--includes count] [--include-dirs count] [--macro-depth n]
+//                         [--inactive 0..1] [--seed n] [--runs n]
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "preprocessor.h"
+#include "lexer.h"
+#include "source.h"
+
+#define DEFAULT_SOURCE_BYTES (8 * 1024 * 1024)
+#define DEFAULT_IDENTIFIER_DENSITY 0.6
+#define DEFAULT_NESTING 4
+#define DEFAULT_DEFINES 200
+#define DEFAULT_INCLUDES 8
+#define DEFAULT_INCLUDE_DIRS 0
+// opendir(), two getdents64() and closedir() for a small directory
+#define DIRECTORY_READ_SYSCALLS 4
+#define DEFAULT_MACRO_DEPTH 0
+#define MACRO_CALL_CHANCE 0.1
+#define MACRO_ARGUMENT_VALUES 8
+#define DEFAULT_INACTIVE 0.0
+#define DEFAULT_SEED 1
+#define DEFAULT_RUNS 5
+#define INCLUDE_FILE_BYTES 4096
+
+typedef struct {
+    size_t size;
+    double identifier_density;
+    int nesting;
+    int defines;
+    int includes;
+    int include_dirs;
+    int macro_depth;
+    double inactive;
+    unsigned int seed;
+    int runs;
+} GeneratorOptions;
+
+typedef struct {
+    double best_seconds;
+    double total_seconds;
+    size_t allocations;
+    size_t allocated_bytes;
+    long peak_rss_kb;
+} PhaseResult;
+
+// Allocation counting. Defining malloc and friends here interposes them for
+// the whole process, libc's own strdup() included.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+extern void __libc_free(void* pointer);
+
+static size_t allocation_count = 0;
+static size_t allocated_bytes = 0;
+
+void* malloc(size_t size) {
+    allocation_count++;
+    allocated_bytes += size;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocation_count++;
+    allocated_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    allocation_count++;
+    allocated_bytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) {
+    __libc_free(pointer);
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Linux lets the high-water mark be reset, which gives a per-phase peak.
+// Elsewhere this falls back to the process-wide maximum.
+static void reset_peak_rss() {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (!file) return;
+    fputs("5", file);
+    fclose(file);
+}
+
+static long peak_rss_kb() {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file) {
+        char line[256];
+        long peak = -1;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "VmHWM: %ld kB", &peak) == 1) break;
+        }
+        fclose(file);
+        if (peak >= 0) return peak;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static unsigned int next_random(unsigned int* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7FFF;
+}
+
+static bool chance(unsigned int* seed, double probability) {
+    return next_random(seed) < probability * 0x8000;
+}
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void append(Buffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append(Buffer* buffer, const char* format, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, format);
+        int written = vsnprintf(buffer->data + buffer->length, buffer->capacity - buffer->length, format, args);
+        va_end(args);
+
+        if (written >= 0 && (size_t)written < buffer->capacity - buffer->length) {
+            buffer->length += written;
+            return;
+        }
+
+        char* grown = realloc(buffer->data, buffer->capacity * 2);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to grow generator buffer\n");
+            exit(EXIT_FAILURE);
+        }
+        buffer->data = grown;
+        buffer->capacity *= 2;
+    }
+}
+
+static void append_indent(Buffer* buffer, int depth) {
+    append(buffer, "%*s", depth * 4, "");
+}
+
+// A call into the macro stack. Arguments come from a small pool, so the same
+// calls come up again and again, as they do in generated code.
+static void append_macro_call(Buffer* buffer, const GeneratorOptions* options, unsigned int* seed) {
+    int level = next_random(seed) % options->macro_depth;
+    append(buffer, "CALL_%d(value_%u, ", level, next_random(seed) % MACRO_ARGUMENT_VALUES);
+    if (level > 0 && chance(seed, 0.5)) {
+        append(buffer, "CALL_%d(value_%u, 1))", level - 1, next_random(seed) % MACRO_ARGUMENT_VALUES);
+    } else {
+        append(buffer, "%u)", next_random(seed) % MACRO_ARGUMENT_VALUES);
+    }
+}
+
+static void append_operand(Buffer* buffer, const GeneratorOptions* options, unsigned int* seed) {
+    if (options->macro_depth > 0 && chance(seed, MACRO_CALL_CHANCE)) {
+        append_macro_call(buffer, options, seed);
+    } else if (!chance(seed, options->identifier_density)) {
+        append(buffer, "%u", next_random(seed) % 1000);
+    } else if (options->defines > 0 && chance(seed, 0.25)) {
+        append(buffer, "MACRO_%u", next_random(seed) % options->defines);
+    } else {
+        append(buffer, "value_%u", next_random(seed) % 64);
+    }
+}
+
+static void append_statement(Buffer* buffer, const GeneratorOptions* options, unsigned int* seed, int depth) {
+    static const char* operators[] = {"+", "-", "*", "/"};
+
+    append_indent(buffer, depth);
+    append(buffer, "value_%u += ", next_random(seed) % 64);
+    append_operand(buffer, options, seed);
+    append(buffer, " %s ", operators[next_random(seed) % 4]);
+    append_operand(buffer, options, seed);
+    append(buffer, ";\n");
+}
+
+static void append_block(Buffer* buffer, const GeneratorOptions* options, unsigned int* seed, int depth) {
+    int statements = 1 + next_random(seed) % 3;
+    for (int i = 0; i < statements; i++) {
+        append_statement(buffer, options, seed, depth);
+    }
+
+    if (depth <= options->nesting) {
+        append_indent(buffer, depth);
+        append(buffer, "%s (value_%u < ", chance(seed, 0.5) ? "while" : "if", next_random(seed) % 64);
+        append_operand(buffer, options, seed);
+        append(buffer, ") {\n");
+        append_block(buffer, options, seed, depth + 1);
+        append_indent(buffer, depth);
+        append(buffer, "}\n");
+    }
+}
+
+static char* generate_source(const GeneratorOptions* options, const char* directory, size_t* out_length) {
+    unsigned int seed = options->seed;
+    Buffer buffer = { .data = malloc(options->size + 4096), .length = 0, .capacity = options->size + 4096 };
+    if (!buffer.data) return NULL;
+
+    for (int i = 0; i < options->includes; i++) {
+        if (options->include_dirs > 0) {
+            append(&buffer, "#include <bench_include_%d.z>\n", i);
+        } else {
+            append(&buffer, "#include \"%s/bench_include_%d.z\"\n", directory, i);
+        }
+    }
+    for (int i = 0; i < options->defines; i++) {
+        append(&buffer, "#define MACRO_%d %u\n", i, next_random(&seed) % 1000);
+    }
+    // each level calls the one below twice, one call nested in the other's arguments
+    for (int i = 0; i < options->macro_depth; i++) {
+        if (i == 0) {
+            append(&buffer, "#define CALL_0(a, b) ((a) + (b))\n");
+        } else {
+            append(&buffer, "#define CALL_%d(a, b) CALL_%d(CALL_%d(a, b), b)\n", i, i - 1, i - 1);
+        }
+    }
+
+    if (options->inactive > 0) {
+        append(&buffer, "#define FEATURE_LEVEL 2\n");
+    }
+
+    int function = 0;
+    while (buffer.length < options->size) {
+        bool inactive = options->inactive > 0 && chance(&seed, options->inactive);
+        if (inactive) {
+            append(&buffer, "#if FEATURE_LEVEL > 2 && !defined(FEATURE_%d)\n", function);
+        }
+        append(&buffer, "int function_%d(int value_0, int value_1) {\n", function++);
+        append_block(&buffer, options, &seed, 1);
+        append(&buffer, "    return value_0;\n}\n");
+        append(&buffer, inactive ? "#endif\n\n" : "\n");
+    }
+
+    *out_length = buffer.length;
+    return buffer.data;
+}
+
+static bool write_file(const char* path, const char* data, size_t length) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && ok;
+}
+
+static void include_directory_path(const char* directory, int index, char* path, size_t size) {
+    snprintf(path, size, "%s/include_%d", directory, index);
+}
+
+// Include i lives in -I directory i % include_dirs, so finding it probes
+// every directory before that one first.
+static void include_file_path(const GeneratorOptions* options, const char* directory, int i, char* path, size_t size) {
+    if (options->include_dirs > 0) {
+        snprintf(path, size, "%s/include_%d/bench_include_%d.z", directory, i % options->include_dirs, i);
+    } else {
+        snprintf(path, size, "%s/bench_include_%d.z", directory, i);
+    }
+}
+
+static bool write_include_files(const GeneratorOptions* options, const char* directory) {
+    char path[4096];
+    for (int i = 0; i < options->include_dirs; i++) {
+        include_directory_path(directory, i, path, sizeof(path));
+        if (mkdir(path, 0700) != 0) return false;
+    }
+
+    for (int i = 0; i < options->includes; i++) {
+        GeneratorOptions include_options = *options;
+        include_options.size = INCLUDE_FILE_BYTES;
+        include_options.includes = 0;
+        include_options.defines = 0;
+        include_options.macro_depth = 0;
+        include_options.seed = options->seed + i + 1;
+
+        size_t length = 0;
+        char* source = generate_source(&include_options, directory, &length);
+        if (!source) return false;
+
+        include_file_path(options, directory, i, path, sizeof(path));
+        bool ok = write_file(path, source, length);
+        free(source);
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void remove_files(const GeneratorOptions* options, const char* directory, const char* main_path) {
+    char path[4096];
+    for (int i = 0; i < options->includes; i++) {
+        include_file_path(options, directory, i, path, sizeof(path));
+        unlink(path);
+    }
+    for (int i = 0; i < options->include_dirs; i++) {
+        include_directory_path(directory, i, path, sizeof(path));
+        rmdir(path);
+    }
+    unlink(main_path);
+    rmdir(directory);
+}
+
+static void begin_phase(double* start) {
+    reset_peak_rss();
+    allocation_count = 0;
+    allocated_bytes = 0;
+    *start = now_seconds();
+}
+
+static void end_phase(PhaseResult* result, double start, int run) {
+    double elapsed = now_seconds() - start;
+    if (run == 0 || elapsed < result->best_seconds) result->best_seconds = elapsed;
+    result->total_seconds += elapsed;
+    result->allocations = allocation_count;
+    result->allocated_bytes = allocated_bytes;
+    result->peak_rss_kb = peak_rss_kb();
+}
+
+static void print_phase(const char* name, const PhaseResult* result, size_t bytes, long tokens, int runs,
+    bool last) {
+    printf("  \"%s\": {\n", name);
+    printf("    \"best_seconds\": %.6f,\n", result->best_seconds);
+    printf("    \"mean_seconds\": %.6f,\n", result->total_seconds / runs);
+    printf("    \"input_bytes\": %zu,\n", bytes);
+    printf("    \"mb_per_s\": %.2f,\n", bytes / result->best_seconds / 1e6);
+    if (tokens >= 0) {
+        printf("    \"tokens\": %ld,\n", tokens);
+        printf("    \"tokens_per_s\": %.0f,\n", tokens / result->best_seconds);
+    }
+    printf("    \"allocations\": %zu,\n", result->allocations);
+    printf("    \"allocated_bytes\": %zu,\n", result->allocated_bytes);
+    printf("    \"peak_rss_kb\": %ld\n", result->peak_rss_kb);
+    printf("  }%s\n", last ? "" : ",");
+}
+
+// The fused pass must give the same token types and values as lexing the
+// preprocessed text; positions differ by design.
+// Adds what happened between before and after to total.
+static void add_resolver_stats(IncludeResolverStats* total, const IncludeResolverStats* before,
+        const IncludeResolverStats* after) {
+    total->lookups += after->lookups - before->lookups;
+    total->probes += after->probes - before->probes;
+    total->stat_calls += after->stat_calls - before->stat_calls;
+    total->directory_reads += after->directory_reads - before->directory_reads;
+    total->realpath_calls += after->realpath_calls - before->realpath_calls;
+    total->realpath_hits += after->realpath_hits - before->realpath_hits;
+}
+
+static bool same_tokens(const Token* expected, const Token* actual, int count) {
+    for (int i = 0; i < count; i++) {
+        if (expected[i].type != actual[i].type) return false;
+        if (expected[i].type == TOKEN_ID && expected[i].value.id != actual[i].value.id) return false;
+        if (expected[i].type == TOKEN_INT_LITERAL && expected[i].value.integer_value != actual[i].value.integer_value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Each header is included twice, and marker_i must come out exactly once.
+// Only the first really is guarded, so the others must be rescanned.
+static const char* guard_fixtures[] = {
+    "#ifndef GUARD_0\n#define GUARD_0\n#if 1\nint marker_0;\n#else\n#endif\n#endif\n",
+    "#ifndef GUARD_1\n#define GUARD_1\nint first_1;\n#else\nint marker_1;\n#endif\n",
+    "#ifndef GUARD_2\n#define GUARD_2\n#elif 1\nint marker_2;\n#endif\n",
+};
+
+static size_t count_text(const char* data, size_t length, const char* text) {
+    size_t count = 0;
+    size_t text_length = strlen(text);
+    for (size_t i = 0; i + text_length <= length; i++) {
+        if (memcmp(data + i, text, text_length) == 0) count++;
+    }
+    return count;
+}
+
+static bool check_include_guards(const char* directory) {
+    int fixtures = sizeof(guard_fixtures) / sizeof(guard_fixtures[0]);
+    char path[4096];
+    char main_text[8192];
+    size_t main_length = 0;
+    bool ok = true;
+
+    for (int i = 0; i < fixtures; i++) {
+        snprintf(path, sizeof(path), "%s/guard_%d.z", directory, i);
+        ok = ok && write_file(path, guard_fixtures[i], strlen(guard_fixtures[i]));
+        for (int repeat = 0; repeat < 2; repeat++) {
+            main_length += snprintf(main_text + main_length, sizeof(main_text) - main_length, "#include \"%s\"\n", path);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/guard_main.z", directory);
+    Preprocessor* preprocessor = ok ? preprocess(path, main_text, main_length) : NULL;
+    ok = preprocessor && preprocessor->output;
+    for (int i = 0; ok && i < fixtures; i++) {
+        char marker[32];
+        snprintf(marker, sizeof(marker), "int marker_%d;", i);
+        if (count_text(preprocessor->output, preprocessor->output_length, marker) != 1) {
+            fprintf(stderr, "Error: guard_%d.z included twice gave the wrong output\n", i);
+            ok = false;
+        }
+    }
+    free_preprocessor(preprocessor);
+
+    for (int i = 0; i < fixtures; i++) {
+        snprintf(path, sizeof(path), "%s/guard_%d.z", directory, i);
+        unlink(path);
+    }
+    return ok;
+}
+
+static bool parse_options(int argc, char** argv, GeneratorOptions* options) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Error: %s expects a value\n", argv[i]);
+            return false;
+        }
+
+        const char* value = argv[++i];
+        if (strcmp(argv[i - 1], "--size") == 0) {
+            options->size = strtoull(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--identifier-density") == 0) {
+            options->identifier_density = atof(value);
+        } else if (strcmp(argv[i - 1], "--nesting") == 0) {
+            options->nesting = atoi(value);
+        } else if (strcmp(argv[i - 1], "--defines") == 0) {
+            options->defines = atoi(value);
+        } else if (strcmp(argv[i - 1], "--includes") == 0) {
+            options->includes = atoi(value);
+        } else if (strcmp(argv[i - 1], "--include-dirs") == 0) {
+            options->include_dirs = atoi(value);
+        } else if (strcmp(argv[i - 1], "--macro-depth") == 0) {
+            options->macro_depth = atoi(value);
+        } else if (strcmp(argv[i - 1], "--inactive") == 0) {
+            options->inactive = atof(value);
+        } else if (strcmp(argv[i - 1], "--seed") == 0) {
+            options->seed = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i - 1], "--runs") == 0) {
+            options->runs = atoi(value);
+        } else {
+            fprintf(stderr, "Error: Unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+
+    if (options->size == 0 || options->runs <= 0 || options->nesting < 0 || options->defines < 0 ||
+        options->includes < 0 || options->include_dirs < 0 || options->macro_depth < 0 || options->identifier_density < 0 || options->identifier_density > 1 ||
+        options->inactive < 0 || options->inactive > 1) {
+        fprintf(stderr, "Error: Invalid benchmark options\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options = {
+        .size = DEFAULT_SOURCE_BYTES,
+        .identifier_density = DEFAULT_IDENTIFIER_DENSITY,
+        .nesting = DEFAULT_NESTING,
+        .defines = DEFAULT_DEFINES,
+        .includes = DEFAULT_INCLUDES,
+        .include_dirs = DEFAULT_INCLUDE_DIRS,
+        .macro_depth = DEFAULT_MACRO_DEPTH,
+        .inactive = DEFAULT_INACTIVE,
+        .seed = DEFAULT_SEED,
+        .runs = DEFAULT_RUNS,
+    };
+    if (!parse_options(argc, argv, &options)) return EXIT_FAILURE;
+
+    char directory[] = "/tmp/zcc-frontend-XXXXXX";
+    if (!mkdtemp(directory)) {
+        fprintf(stderr, "Error: Failed to create benchmark directory\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t length = 0;
+    char* generated = generate_source(&options, directory, &length);
+    char main_path[4096];
+    snprintf(main_path, sizeof(main_path), "%s/bench_main.z", directory);
+    if (!generated || !write_file(main_path, generated, length) || !write_include_files(&options, directory)) {
+        fprintf(stderr, "Error: Failed to write benchmark sources\n");
+        remove_files(&options, directory, main_path);
+        return EXIT_FAILURE;
+    }
+    free(generated);
+
+    if (!check_include_guards(directory)) {
+        remove_files(&options, directory, main_path);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < options.include_dirs; i++) {
+        char path[4096];
+        include_directory_path(directory, i, path, sizeof(path));
+        add_include_path(path);
+    }
+
+    SourceFile* source = load_source(main_path);
+    if (!source) {
+        remove_files(&options, directory, main_path);
+        return EXIT_FAILURE;
+    }
+
+    PhaseResult preprocess_result = {0};
+    PhaseResult lex_result = {0};
+    PhaseResult fused_result = {0};
+    PhaseResult unmemoized_result = {0};
+    PhaseResult uncached_resolver_result = {0};
+    IncludeResolverStats cached_resolver = {0};
+    IncludeResolverStats uncached_resolver = {0};
+    size_t macro_calls = 0;
+    size_t memo_hits = 0;
+    size_t output_length = 0;
+    long token_count = 0;
+
+    for (int run = 0; run < options.runs; run++) {
+        double start;
+        IncludeResolverStats before = *get_include_resolver_stats();
+        begin_phase(&start);
+        Preprocessor* preprocessor = preprocess(main_path, source->data, source->length);
+        end_phase(&preprocess_result, start, run);
+        add_resolver_stats(&cached_resolver, &before, get_include_resolver_stats());
+
+        if (!preprocessor || !preprocessor->output) {
+            fprintf(stderr, "Error: preprocess failed\n");
+            return EXIT_FAILURE;
+        }
+        output_length = preprocessor->output_length;
+        macro_calls = preprocessor->expander.calls;
+        memo_hits = preprocessor->expander.memo_hits;
+
+        begin_phase(&start);
+        Token* tokens = lexical_analysis_range(preprocessor->output, output_length);
+        end_phase(&lex_result, start, run);
+
+        if (!tokens) {
+            fprintf(stderr, "Error: lexical_analysis failed\n");
+            return EXIT_FAILURE;
+        }
+        token_count = 0;
+        while (tokens[token_count].type != TOKEN_EOF) token_count++;
+        free_preprocessor(preprocessor);
+
+        begin_phase(&start);
+        int fused_count = 0;
+        Token* fused_tokens = preprocess_tokens(main_path, source->data, source->length, &fused_count);
+        end_phase(&fused_result, start, run);
+
+        if (!fused_tokens || fused_count != token_count + 1 || !same_tokens(tokens, fused_tokens, fused_count)) {
+            fprintf(stderr, "Error: preprocess_tokens does not match preprocess + lexical_analysis\n");
+            return EXIT_FAILURE;
+        }
+
+        free_tokens(fused_tokens);
+        free_tokens(tokens);
+
+        if (options.macro_depth > 0) {
+            set_macro_memoization(false);
+            begin_phase(&start);
+            Preprocessor* unmemoized = preprocess(main_path, source->data, source->length);
+            end_phase(&unmemoized_result, start, run);
+            set_macro_memoization(true);
+
+            if (!unmemoized || unmemoized->output_length != output_length) {
+                fprintf(stderr, "Error: preprocess without memoization gave different output\n");
+                return EXIT_FAILURE;
+            }
+            free_preprocessor(unmemoized);
+        }
+
+        if (options.include_dirs > 0) {
+            set_include_resolver_caching(false);
+            before = *get_include_resolver_stats();
+            begin_phase(&start);
+            Preprocessor* uncached = preprocess(main_path, source->data, source->length);
+            end_phase(&uncached_resolver_result, start, run);
+            add_resolver_stats(&uncached_resolver, &before, get_include_resolver_stats());
+            set_include_resolver_caching(true);
+
+            if (!uncached || uncached->output_length != output_length) {
+                fprintf(stderr, "Error: preprocess without resolver caching gave different output\n");
+                return EXIT_FAILURE;
+            }
+            free_preprocessor(uncached);
+        }
+    }
+
+    printf("{\n");
+    printf("  \"generator\": {\n");
+    printf("    \"bytes\": %zu,\n", source->length);
+    printf("    \"identifier_density\": %.3f,\n", options.identifier_density);
+    printf("    \"nesting\": %d,\n", options.nesting);
+    printf("    \"defines\": %d,\n", options.defines);
+    printf("    \"includes\": %d,\n", options.includes);
+    printf("    \"include_dirs\": %d,\n", options.include_dirs);
+    printf("    \"macro_depth\": %d,\n", options.macro_depth);
+    printf("    \"inactive\": %.3f,\n", options.inactive);
+    printf("    \"seed\": %u\n", options.seed);
+    printf("  },\n");
+    printf("  \"runs\": %d,\n", options.runs);
+    printf("  \"scan_kernel\": \"%s\",\n", scan_kernel_name(get_scan_kernel()));
+    print_phase("preprocess", &preprocess_result, source->length, -1, options.runs, false);
+    print_phase("lexical_analysis", &lex_result, output_length, token_count, options.runs, false);
+    print_phase("fused", &fused_result, source->length, token_count, options.runs, false);
+    if (options.macro_depth > 0) {
+        print_phase("preprocess_unmemoized", &unmemoized_result, source->length, -1, options.runs, false);
+        printf("  \"macro_expansion\": {\n");
+        printf("    \"calls\": %zu,\n", macro_calls);
+        printf("    \"memo_hits\": %zu,\n", memo_hits);
+        printf("    \"memo_speedup\": %.2f\n", unmemoized_result.best_seconds / preprocess_result.best_seconds);
+        printf("  },\n");
+    }
+
+    if (options.include_dirs > 0) {
+        // realpath() is counted as one syscall, though it makes one per path component
+        size_t cached_syscalls = cached_resolver.stat_calls + cached_resolver.realpath_calls +
+            cached_resolver.directory_reads * DIRECTORY_READ_SYSCALLS;
+        size_t uncached_syscalls = uncached_resolver.stat_calls + uncached_resolver.realpath_calls;
+
+        print_phase("preprocess_uncached_resolver", &uncached_resolver_result, source->length, -1, options.runs, false);
+        printf("  \"include_resolver\": {\n");
+        printf("    \"lookups\": %zu,\n", cached_resolver.lookups);
+        printf("    \"probes\": %zu,\n", cached_resolver.probes);
+        printf("    \"stat_calls\": %zu,\n", cached_resolver.stat_calls);
+        printf("    \"directory_reads\": %zu,\n", cached_resolver.directory_reads);
+        printf("    \"realpath_calls\": %zu,\n", cached_resolver.realpath_calls);
+        printf("    \"uncached_stat_calls\": %zu,\n", uncached_resolver.stat_calls);
+        printf("    \"uncached_realpath_calls\": %zu,\n", uncached_resolver.realpath_calls);
+        printf("    \"syscalls_saved\": %zd\n", (ssize_t)uncached_syscalls - (ssize_t)cached_syscalls);
+        printf("  },\n");
+    }
+
+    double two_stage_seconds = preprocess_result.best_seconds + lex_result.best_seconds;
+    printf("  \"end_to_end\": {\n");
+    printf("    \"two_stage_best_seconds\": %.6f,\n", two_stage_seconds);
+    printf("    \"fused_best_seconds\": %.6f,\n", fused_result.best_seconds);
+    printf("    \"speedup\": %.2f\n", two_stage_seconds / fused_result.best_seconds);
+    printf("  },\n");
+
+    // The cache lives for the whole process, so runs after the first hit it.
+    const IncludeCacheStats* cache = get_include_cache_stats();
+    printf("  \"include_cache\": {\n");
+    printf("    \"hits\": %zu,\n", cache->hits);
+    printf("    \"misses\": %zu,\n", cache->misses);
+    printf("    \"skipped\": %zu,\n", cache->skipped);
+    printf("    \"replayed\": %zu\n", cache->replayed);
+    printf("  }\n");
+    printf("}\n");
+
+    free_include_cache();
+    free_include_resolver();
+    free_source(source);
+    remove_files(&options, directory, main_path);
+    return EXIT_SUCCESS;
+}
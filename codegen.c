@@ -190,7 +190,8 @@ char* symbol_codegen(struct symbol* sym) {
 			return buffer;
 
 		case SYMBOL_GLOBAL:
-			return sym->name;
+			snprintf(buffer, sizeof(buffer), "%s", sym->name);
+			return buffer;
 
 	}
 }
@@ -661,7 +662,7 @@ void decl_codegen(struct RegisterTable* sregs, struct AsmWriter* writer, struct
                         func_bodies->symbol->s.total_local_bytes);
                 asm_to_write_section(writer, buffer, TEXT_DIRECTIVE);
                 
-                if (func_bodies->code) {
+                if (decl_code(func_bodies)) {
                     stmt_codegen(sregs, writer, func_bodies->code);
                 }
             }
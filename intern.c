@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+
+struct InternChunk {
+    struct InternChunk* next;
+    size_t used;
+    size_t capacity;
+    char data[];
+};
+
+typedef struct {
+    uint32_t* slots;        // open addressing, holds ids; 0 marks an empty slot
+    size_t slot_capacity;
+
+    const char** names;     // indexed by id
+    uint32_t* lengths;
+    uint32_t* hashes;
+    size_t count;
+    size_t capacity;
+
+    struct InternChunk* chunks;
+} Interner;
+
+static Interner interner = {0};
+
+static uint32_t hash_name(const char* text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Names live in fixed chunks so the pointers handed out never move.
+static char* store_name(const char* text, size_t length) {
+    struct InternChunk* chunk = interner.chunks;
+    if (!chunk || chunk->used + length + 1 > chunk->capacity) {
+        size_t capacity = length + 1 > INTERN_CHUNK_SIZE ? length + 1 : INTERN_CHUNK_SIZE;
+        chunk = malloc(sizeof(struct InternChunk) + capacity);
+        if (!chunk) return NULL;
+
+        chunk->next = interner.chunks;
+        chunk->used = 0;
+        chunk->capacity = capacity;
+        interner.chunks = chunk;
+    }
+
+    char* name = chunk->data + chunk->used;
+    memcpy(name, text, length);
+    name[length] = '\0';
+    chunk->used += length + 1;
+    return name;
+}
+
+static bool grow_slots() {
+    size_t new_capacity = interner.slot_capacity ? interner.slot_capacity * 2 : INTERN_INITIAL_SLOTS;
+    uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+    if (!slots) return false;
+
+    size_t mask = new_capacity - 1;
+    for (size_t id = 1; id <= interner.count; id++) {
+        size_t idx = interner.hashes[id] & mask;
+        while (slots[idx]) idx = (idx + 1) & mask;
+        slots[idx] = id;
+    }
+
+    free(interner.slots);
+    interner.slots = slots;
+    interner.slot_capacity = new_capacity;
+    return true;
+}
+
+static bool grow_names() {
+    size_t new_capacity = interner.capacity ? interner.capacity * 2 : INTERN_INITIAL_SLOTS / 2;
+    const char** names = realloc(interner.names, new_capacity * sizeof(char*));
+    if (!names) return false;
+    interner.names = names;
+
+    uint32_t* lengths = realloc(interner.lengths, new_capacity * sizeof(uint32_t));
+    if (!lengths) return false;
+    interner.lengths = lengths;
+
+    uint32_t* hashes = realloc(interner.hashes, new_capacity * sizeof(uint32_t));
+    if (!hashes) return false;
+    interner.hashes = hashes;
+
+    interner.capacity = new_capacity;
+    return true;
+}
+
+// Returns the id stored for text, or INTERN_NONE with *slot set to the empty
+// slot where it belongs.
+static uint32_t probe(const char* text, size_t length, uint32_t hash, size_t* slot) {
+    size_t mask = interner.slot_capacity - 1;
+    size_t idx = hash & mask;
+
+    while (interner.slots[idx]) {
+        uint32_t id = interner.slots[idx];
+        if (interner.hashes[id] == hash && interner.lengths[id] == length &&
+            memcmp(interner.names[id], text, length) == 0) {
+            return id;
+        }
+        idx = (idx + 1) & mask;
+    }
+    *slot = idx;
+    return INTERN_NONE;
+}
+
+uint32_t intern_find(const char* text, size_t length) {
+    if (!interner.slots) return INTERN_NONE;
+
+    size_t idx;
+    return probe(text, length, hash_name(text, length), &idx);
+}
+
+uint32_t intern(const char* text, size_t length) {
+    if ((interner.count + 1) * 2 > interner.slot_capacity && !grow_slots()) {
+        fprintf(stderr, "Error: Failed to grow identifier table\n");
+        return INTERN_NONE;
+    }
+
+    uint32_t hash = hash_name(text, length);
+    size_t idx;
+    uint32_t found = probe(text, length, hash, &idx);
+    if (found != INTERN_NONE) return found;
+
+    // names[] is indexed by id and id 0 is reserved
+    if (interner.count + 2 > interner.capacity && !grow_names()) {
+        fprintf(stderr, "Error: Failed to grow identifier table\n");
+        return INTERN_NONE;
+    }
+
+    char* name = store_name(text, length);
+    if (!name) {
+        fprintf(stderr, "Error: Failed to store identifier\n");
+        return INTERN_NONE;
+    }
+
+    uint32_t id = ++interner.count;
+    interner.names[id] = name;
+    interner.lengths[id] = length;
+    interner.hashes[id] = hash;
+    interner.slots[idx] = id;
+    return id;
+}
+
+uint32_t intern_cstr(const char* text) {
+    return intern(text, strlen(text));
+}
+
+const char* intern_name(uint32_t id) {
+    if (id == INTERN_NONE || id > interner.count) return NULL;
+    return interner.names[id];
+}
+
+size_t intern_length(uint32_t id) {
+    if (id == INTERN_NONE || id > interner.count) return 0;
+    return interner.lengths[id];
+}
+
+size_t intern_count() {
+    return interner.count;
+}
+
+void free_interner() {
+    struct InternChunk* chunk = interner.chunks;
+    while (chunk) {
+        struct InternChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(interner.slots);
+    free(interner.names);
+    free(interner.lengths);
+    free(interner.hashes);
+    memset(&interner, 0, sizeof(interner));
+}
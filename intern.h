@@ -0,0 +1,22 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define INTERN_NONE 0
+#define INTERN_INITIAL_SLOTS 1024
+#define INTERN_CHUNK_SIZE 65536
+
+// Compiler-wide identifier table. Each distinct name is stored once and
+// gets a stable 32-bit id; INTERN_NONE (0) is never handed out.
+uint32_t intern(const char* text, size_t length);
+uint32_t intern_cstr(const char* text);
+// Looks a name up without adding it; INTERN_NONE if it was never interned.
+uint32_t intern_find(const char* text, size_t length);
+const char* intern_name(uint32_t id);
+size_t intern_length(uint32_t id);
+size_t intern_count();
+void free_interner();
+
+#endif
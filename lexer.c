@@ -1,8 +1,46 @@
 #include "lexer.h"
-#define NUM_KEYWORDS 9
+#define NUM_KEYWORDS 12
+#define MIN_KEYWORD_LENGTH 2
+#define MAX_KEYWORD_LENGTH 8
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_SLOT(length, c0, c1) ((((length) * 3) + (unsigned char)(c0) + (unsigned char)(c1)) & (KEYWORD_TABLE_SIZE - 1))
 
 const char* keywords[] = {"int", "char", "boolean", "if", "else", "for", "while", "return", "void", "struct",
                     "break", "continue"};
+
+typedef struct {
+    const char* name;
+    int length;
+    TokenType type;
+} KeywordEntry;
+
+// Perfect hash over (length, first char, second char); every keyword lands in its own slot.
+static const KeywordEntry keyword_table[KEYWORD_TABLE_SIZE] = {
+    [KEYWORD_SLOT(3, 'i', 'n')] = {"int", 3, TOKEN_INT},
+    [KEYWORD_SLOT(4, 'c', 'h')] = {"char", 4, TOKEN_CHAR},
+    [KEYWORD_SLOT(7, 'b', 'o')] = {"boolean", 7, TOKEN_BOOLEAN},
+    [KEYWORD_SLOT(2, 'i', 'f')] = {"if", 2, TOKEN_IF},
+    [KEYWORD_SLOT(4, 'e', 'l')] = {"else", 4, TOKEN_ELSE},
+    [KEYWORD_SLOT(3, 'f', 'o')] = {"for", 3, TOKEN_FOR},
+    [KEYWORD_SLOT(5, 'w', 'h')] = {"while", 5, TOKEN_WHILE},
+    [KEYWORD_SLOT(6, 'r', 'e')] = {"return", 6, TOKEN_RETURN},
+    [KEYWORD_SLOT(4, 'v', 'o')] = {"void", 4, TOKEN_VOID},
+    [KEYWORD_SLOT(6, 's', 't')] = {"struct", 6, TOKEN_STRUCT},
+    [KEYWORD_SLOT(5, 'b', 'r')] = {"break", 5, TOKEN_BREAK},
+    [KEYWORD_SLOT(8, 'c', 'o')] = {"continue", 8, TOKEN_CONTINUE},
+};
+
+TokenType lookup_keyword(const char* text, int length) {
+    if (length < MIN_KEYWORD_LENGTH || length > MAX_KEYWORD_LENGTH) return TOKEN_ID;
+
+    const KeywordEntry* entry = &keyword_table[KEYWORD_SLOT(length, text[0], text[1])];
+    if (entry->length == length && memcmp(entry->name, text, length) == 0) {
+        return entry->type;
+    }
+    return TOKEN_ID;
+}
+
+// Linear reference lookup, kept for comparison against lookup_keyword().
 keyword_t get_keyword_type(char* str) {
     for (int i = 0; i < NUM_KEYWORDS; i++) {
         if (strcmp(str, keywords[i]) == 0) {
@@ -23,6 +61,9 @@ TokenType keyword_to_token(Keyword* word) {
         case KEYWORD_WHILE: return TOKEN_WHILE;
         case KEYWORD_RETURN: return TOKEN_RETURN;
         case KEYWORD_VOID: return TOKEN_VOID;
+        case KEYWORD_STRUCT: return TOKEN_STRUCT;
+        case KEYWORD_BREAK: return TOKEN_BREAK;
+        case KEYWORD_CONTINUE: return TOKEN_CONTINUE;
         default:
             fprintf(stderr, "Error: Unknown word\n");
             return TOKEN_UNKNOWN;
@@ -50,332 +91,741 @@ Token create_int_token(TokenType type, int value, int line, int column) {
     return token;
 }
 
-Token create_string_token(TokenType type, char* value, int line, int column) {
-    Token token = create_token(type, line, column);
-    token.value.string = strdup(value);
-    return token;
+char* token_text(const char* source, const Token* token) {
+    return strndup(source + token->offset, token->length);
+}
+
+bool token_equals(const char* source, const Token* token, const char* text) {
+    return strncmp(source + token->offset, text, token->length) == 0 && text[token->length] == '\0';
 }
 
-Lexer* init_lexer(const char* source) {
+Lexer* init_lexer(char* source) {
+    return init_lexer_range(source, strlen(source));
+}
+
+Lexer* init_lexer_range(char* source, size_t length) {
     Lexer* lexer = malloc(sizeof(Lexer));
     if (!lexer) return NULL;
 
+    lexer->source = source;
+    lexer->limit = source + length;
+    lexer->kernels = get_scan_kernels();
     lexer->start = source;
     lexer->end = source;
+    lexer->line_start = source;
     lexer->line =  1;
-    lexer->column = 1;
     lexer->tokenIdx = 0;
-    lexer->capacity = 128;
-
-    lexer->tokens = malloc(sizeof(Token) *  lexer->capacity);
-    if (!lexer->tokens) {
-        free(lexer);
-        return NULL;
-    }
+    lexer->capacity = 0;
+    lexer->tokens = NULL;
+    lexer->ring_head = 0;
+    lexer->ring_count = 0;
+    lexer->intern_identifiers = true;
+    lexer->table = NULL;
+    lexer->table_index = 0;
+    lexer->value_index = 0;
+    lexer->replay = NULL;
+    lexer->replay_count = 0;
+    lexer->replay_index = 0;
     return lexer;
 }
 
+void free_lexer(Lexer* lexer) {
+    if (!lexer) return;
+    free(lexer->tokens);
+    free(lexer);
+}
+
+static bool reserve_token(Lexer* lexer) {
+    if (lexer->tokenIdx < lexer->capacity) return true;
+
+    int capacity = lexer->capacity ? lexer->capacity * 2 : 128;
+    Token* tokens = realloc(lexer->tokens, sizeof(Token) * capacity);
+    if (!tokens) return false;
+    lexer->tokens = tokens;
+    lexer->capacity = capacity;
+    return true;
+}
+
 bool add_token(Lexer* lexer, Token token) {
-    if (lexer->tokenIdx >= lexer->capacity) {
-        lexer->capacity *= 2;
-        lexer->tokens = realloc(lexer->tokens, sizeof(Token) * lexer->capacity);
-        if (!lexer->tokens) return false;
-    }
+    if (!reserve_token(lexer)) return false;
 
+    token.offset = lexer->start - lexer->source;
+    token.length = lexer->end - lexer->start;
     lexer->tokens[lexer->tokenIdx++] = token;
     return true;
 }
 
-char advance(Lexer* lexer) {
-    lexer->column++;
-    return *lexer->end++;
-}
+typedef enum {
+    CHAR_OTHER,
+    CHAR_SPACE,
+    CHAR_NEWLINE,
+    CHAR_ALPHA,
+    CHAR_DIGIT,
+    CHAR_UNDERSCORE,
+    CHAR_MINUS,
+    CHAR_OPERATOR,
+    CHAR_MARKER,
+    CHAR_END
+} char_class_t;
+
+typedef enum {
+    SCAN_START,
+    SCAN_IDENTIFIER,
+    SCAN_NUMBER,
+    SCAN_OPERATOR,
+    SCAN_DONE
+} scan_state_t;
+
+static const unsigned char char_class[256] = {
+    ['\0'] = CHAR_END,
+    [' '] = CHAR_SPACE, ['\t'] = CHAR_SPACE, ['\r'] = CHAR_SPACE, ['\v'] = CHAR_SPACE, ['\f'] = CHAR_SPACE,
+    ['\n'] = CHAR_NEWLINE,
+    ['a' ... 'z'] = CHAR_ALPHA,
+    ['A' ... 'Z'] = CHAR_ALPHA,
+    ['0' ... '9'] = CHAR_DIGIT,
+    ['_'] = CHAR_UNDERSCORE,
+    ['-'] = CHAR_MINUS,
+    ['+'] = CHAR_OPERATOR, ['*'] = CHAR_OPERATOR, ['/'] = CHAR_OPERATOR, ['<'] = CHAR_OPERATOR,
+    ['>'] = CHAR_OPERATOR, ['='] = CHAR_OPERATOR, ['!'] = CHAR_OPERATOR,
+    ['('] = CHAR_MARKER, [')'] = CHAR_MARKER, ['['] = CHAR_MARKER, [']'] = CHAR_MARKER,
+    ['{'] = CHAR_MARKER, ['}'] = CHAR_MARKER, [';'] = CHAR_MARKER, [','] = CHAR_MARKER,
+};
+
+typedef struct {
+    TokenType single;
+    TokenType with_equal;   // op followed by '='
+    TokenType doubled;      // op repeated, e.g. "++"
+} OperatorEntry;
+
+static const OperatorEntry operator_table[256] = {
+    ['+'] = {TOKEN_ADD, TOKEN_ADD_AND_ASSIGN, TOKEN_INCREMENT},
+    ['-'] = {TOKEN_SUBTRACT, TOKEN_SUBTRACT_AND_ASSIGN, TOKEN_DECREMENT},
+    ['*'] = {TOKEN_MULTIPLY, TOKEN_MULTIPLY_AND_ASSIGN, TOKEN_UNKNOWN},
+    ['/'] = {TOKEN_DIVIDE, TOKEN_DIVIDE_AND_ASSIGN, TOKEN_UNKNOWN},
+    ['<'] = {TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_UNKNOWN},
+    ['>'] = {TOKEN_GREATER, TOKEN_GREATER_EQUAL, TOKEN_UNKNOWN},
+    ['='] = {TOKEN_ASSIGNMENT, TOKEN_EQUAL, TOKEN_UNKNOWN},
+    ['!'] = {TOKEN_NOT, TOKEN_NOT_EQUAL, TOKEN_UNKNOWN},
+};
+
+static const TokenType marker_table[256] = {
+    ['('] = TOKEN_LEFT_PARENTHESES,
+    [')'] = TOKEN_RIGHT_PARENTHESES,
+    ['['] = TOKEN_LEFT_BRACKET,
+    [']'] = TOKEN_RIGHT_BRACKET,
+    ['{'] = TOKEN_LEFT_BRACE,
+    ['}'] = TOKEN_RIGHT_BRACE,
+    [';'] = TOKEN_SEMICOLON,
+    [','] = TOKEN_COMMA,
+};
+
+// Scans the next token starting at lexer->end into *token. On return
+// lexer->start/end bracket the lexeme. Columns are derived from line_start
+// rather than being counted per character. Nothing at or past lexer->limit is
+// read, so the buffer needs no terminating NUL.
+void scan_token(Lexer* lexer, Token* token) {
+    const unsigned char* p = (const unsigned char*)lexer->end;
+    const unsigned char* start = p;
+    scan_state_t state = SCAN_START;
+    int value = 0;
+    bool is_negative = false;
+
+    const unsigned char* limit = (const unsigned char*)lexer->limit;
+
+    while (state != SCAN_DONE) {
+        unsigned char c = p < limit ? *p : '\0';
+
+        switch (state) {
+            case SCAN_START:
+                start = p;
+                switch (char_class[c]) {
+                    case CHAR_SPACE:
+                    case CHAR_NEWLINE: {
+                        const char* line_start = lexer->line_start;
+                        p = (const unsigned char*)lexer->kernels->skip_whitespace((const char*)p, lexer->limit,
+                            &lexer->line, &line_start);
+                        lexer->line_start = (char*)line_start;
+                        break;
+                    }
+
+                    case CHAR_ALPHA:
+                        p++;
+                        state = SCAN_IDENTIFIER;
+                        break;
+
+                    case CHAR_DIGIT:
+                        state = SCAN_NUMBER;
+                        break;
+
+                    case CHAR_MINUS:
+                        if (p + 1 < limit && char_class[p[1]] == CHAR_DIGIT) {
+                            is_negative = true;
+                            p++;
+                            state = SCAN_NUMBER;
+                        } else {
+                            state = SCAN_OPERATOR;
+                        }
+                        break;
+
+                    case CHAR_OPERATOR:
+                        state = SCAN_OPERATOR;
+                        break;
+
+                    case CHAR_MARKER:
+                        p++;
+                        *token = create_char_token(marker_table[c], c, lexer->line, 0);
+                        state = SCAN_DONE;
+                        break;
+
+                    case CHAR_END:
+                        *token = create_token(TOKEN_EOF, lexer->line, 0);
+                        state = SCAN_DONE;
+                        break;
+
+                    default:
+                        p++;
+                        *token = create_char_token(TOKEN_UNKNOWN, c, lexer->line, 0);
+                        state = SCAN_DONE;
+                        break;
+                }
+                break;
+
+            case SCAN_IDENTIFIER: {
+                p = (const unsigned char*)lexer->kernels->identifier_end((const char*)p, lexer->limit);
+
+                int length = p - start;
+                TokenType type = lookup_keyword((const char*)start, length);
+                *token = create_token(type, lexer->line, 0);
+                if (type == TOKEN_ID && lexer->intern_identifiers) {
+                    token->value.id = intern((const char*)start, length);
+                }
+                state = SCAN_DONE;
+                break;
+            }
+
+            case SCAN_NUMBER: {
+                const unsigned char* digits_end = (const unsigned char*)lexer->kernels->digits_end((const char*)p,
+                    lexer->limit);
+                while (p < digits_end) {
+                    value = value * 10 + (*p++ - '0');
+                }
+
+                *token = create_int_token(TOKEN_INT_LITERAL, is_negative ? -value : value, lexer->line, 0);
+                state = SCAN_DONE;
+                break;
+            }
+
+            case SCAN_OPERATOR: {
+                const OperatorEntry* entry = &operator_table[c];
+                p++;
+                if (p < limit && *p == '=') {
+                    p++;
+                    *token = create_token(entry->with_equal, lexer->line, 0);
+                } else if (p < limit && *p == c && entry->doubled != TOKEN_UNKNOWN) {
+                    p++;
+                    *token = create_token(entry->doubled, lexer->line, 0);
+                } else {
+                    *token = create_char_token(entry->single, c, lexer->line, 0);
+                }
+                state = SCAN_DONE;
+                break;
+            }
 
-char peek(Lexer* lexer) {
-    return *lexer->end;
-} 
+            case SCAN_DONE:
+                break;
+        }
+    }
 
-char peek_next(Lexer* lexer) {
-    if (*(lexer->end) == '\0') return '\0';
-    return *(lexer->end + 1);
+    lexer->start = (char*)start;
+    lexer->end = (char*)p;
+    token->offset = lexer->start - lexer->source;
+    token->length = lexer->end - lexer->start;
+    token->column = lexer->start - lexer->line_start + 1;
 }
 
-bool match(Lexer* lexer, char expected) {
-    if (peek(lexer) != expected) return false;
-    advance(lexer);
-    return true;
+Token* lexical_analysis(char* source) {
+    return lexical_analysis_range(source, strlen(source));
 }
 
-void identifier(Lexer* lexer) {
-    if (isalpha(peek(lexer))) {
-        while (isalnum(peek(lexer)) || peek(lexer) == '_') {
-            advance(lexer);
+Token* lexical_analysis_range(char* source, size_t length) {
+    Lexer* lexer = init_lexer_range(source, length);
+    if (!lexer) return NULL;
+
+    Token* tokens = scan_all_tokens(lexer, NULL);
+    free_lexer(lexer);
+    return tokens;
+}
+
+Token* scan_all_tokens(Lexer* lexer, int* count) {
+    Token* token;
+    do {
+        if (!reserve_token(lexer)) {
+            fprintf(stderr, "Error: Failed to grow token array\n");
+            return NULL;
         }
-    }
+        token = &lexer->tokens[lexer->tokenIdx++];
+        scan_token(lexer, token);
+    } while (token->type != TOKEN_EOF);
 
-    int length = lexer->end - lexer->start;
-    char* text = strndup(lexer->start, length);
+    Token* tokens = lexer->tokens;
+    if (count) *count = lexer->tokenIdx;
+    lexer->tokens = NULL;
+    lexer->tokenIdx = 0;
+    lexer->capacity = 0;
+    return tokens;
+}
 
-    keyword_t keyword_type = get_keyword_type(text);
-    if (keyword_type != KEYWORD_UNKNOWN) {
-        Keyword word = { .type = keyword_type, .name = text};
-        TokenType type = keyword_to_token(&word);
-        add_token(lexer, create_string_token(type, text, lexer->line, lexer->column - length));
-    } else {
-        add_token(lexer, create_string_token(TOKEN_ID, text, lexer->line, lexer->column - length));
+char* apply_source_edit(const char* source, size_t length, const SourceEdit* edit, size_t* new_length) {
+    if (edit->offset < 0 || edit->removed_length < 0 || edit->inserted_length < 0 ||
+        (size_t)edit->offset + edit->removed_length > length) {
+        fprintf(stderr, "Error: Edit is outside the source\n");
+        return NULL;
     }
 
-    free(text);
-}   
+    size_t tail = edit->offset + edit->removed_length;
+    *new_length = length - edit->removed_length + edit->inserted_length;
+    char* edited = malloc(*new_length + 1);
+    if (!edited) return NULL;
 
-void number(Lexer* lexer) {
-    bool isNegative = false;
-    if (*lexer->start == '-') {
-        isNegative = true;
-        advance(lexer);
+    memcpy(edited, source, edit->offset);
+    memcpy(edited + edit->offset, edit->inserted, edit->inserted_length);
+    memcpy(edited + edit->offset + edit->inserted_length, source + tail, length - tail);
+    edited[*new_length] = '\0';
+    return edited;
+}
+
+Token* relex_tokens(Token* tokens, int* token_count, char* source, size_t length, const SourceEdit* edit) {
+    int count = *token_count;
+
+    int edit_end = edit->offset + edit->removed_length;
+    int inserted_end = edit->offset + edit->inserted_length;
+    int delta = edit->inserted_length - edit->removed_length;
+
+    // The scanner reads at most one byte past a lexeme, so a token that ends
+    // before the edit never saw an edited byte and is kept as it is.
+    int kept = 0;
+    int high = count - 1;
+    while (kept < high) {
+        int middle = kept + (high - kept) / 2;
+        if (tokens[middle].offset + tokens[middle].length < edit->offset) {
+            kept = middle + 1;
+        } else {
+            high = middle;
+        }
     }
 
-    while (isdigit(peek(lexer))) {
-        advance(lexer);
+    Lexer* lexer = init_lexer_range(source, length);
+    if (!lexer) return NULL;
+
+    if (kept > 0) {
+        const Token* last = &tokens[kept - 1];
+        lexer->end = source + last->offset + last->length;
+        lexer->line = last->line;
+        lexer->line_start = source + last->offset - (last->column - 1);
     }
 
-    int length = lexer->end - lexer->start;
-    char* num_str = strndup(lexer->start, length);
-    int value = atoi(num_str);
-    if (isNegative) value = -value;
-
-    add_token(lexer, create_int_token(TOKEN_INT_LITERAL, value, lexer->line, lexer->column - length));
-    free(num_str);
-}
-
-void operator(Lexer* lexer) {
-    char c = advance(lexer);
-    TokenType type = TOKEN_UNKNOWN;
-    bool isCompound = false;
-
-    switch (c) {
-        case '+':
-            if (match(lexer, '=')) {
-                type = TOKEN_ADD_AND_ASSIGN;
-                isCompound = true;
-            } else if (match(lexer, '+')) {
-                type = TOKEN_INCREMENT;
-                isCompound = true;
-            } else {
-                type = TOKEN_ADD;
-            }
-            break;
-
-        case '-':
-            if (match(lexer, '=')) {
-                type = TOKEN_SUBTRACT_AND_ASSIGN;
-                isCompound = true;
-            } else if (match(lexer, '-')) {
-                type = TOKEN_DECREMENT;
-                isCompound = true;
-            } else {
-                type = TOKEN_SUBTRACT;
-            }
-            break;
-
-        case '*':
-            if (match(lexer, '=')) {
-                type = TOKEN_MULTIPLY_AND_ASSIGN;
-                isCompound = true;
-            } else {
-                type = TOKEN_MULTIPLY;
-            }
-            break;
-
-        case '/':
-            if (match(lexer, '=')) {
-                type = TOKEN_DIVIDE_AND_ASSIGN;
-                isCompound = true;
-            } else {
-                type = TOKEN_DIVIDE;
-            }
-            break;
-
-        case '<':
-            if (match(lexer, '=')) {
-                type = TOKEN_LESS_EQUAL;
-                isCompound = true;
-            } else {
-                type = TOKEN_LESS;
-            }
-            break;
-
-        case '>':
-            if (match(lexer, '=')) {
-                type = TOKEN_GREATER_EQUAL;
-                isCompound = true;
-            } else {
-                type = TOKEN_GREATER;
-            }
-            break;
-
-        case '=':
-            if (match(lexer, '=')) {
-                type = TOKEN_EQUAL;
-                isCompound = true;
-            } else {
-                type = TOKEN_ASSIGNMENT;
+    // Past the inserted text the new bytes equal the old ones shifted by
+    // delta. A new token that starts where a shifted old token started sees
+    // the same input from there on, so the old stream is reused from `old`.
+    int old = count;
+    int candidate = kept;
+    int line_delta = 0;
+    int column_delta = 0;
+    Token* token;
+    do {
+        if (!reserve_token(lexer)) {
+            fprintf(stderr, "Error: Failed to grow token array\n");
+            free_lexer(lexer);
+            return NULL;
+        }
+        token = &lexer->tokens[lexer->tokenIdx];
+        scan_token(lexer, token);
+
+        if (token->type != TOKEN_EOF && token->offset >= inserted_end) {
+            while (candidate < count - 1 &&
+                (tokens[candidate].offset < edit_end || tokens[candidate].offset + delta < token->offset)) {
+                candidate++;
             }
-            break;
-
-        case '!':
-            if (match(lexer, '=')) {
-                type = TOKEN_NOT_EQUAL;
-                isCompound = true;
-            } else {
-                type = TOKEN_NOT;
+            if (candidate < count - 1 && tokens[candidate].offset + delta == token->offset) {
+                old = candidate;
+                line_delta = token->line - tokens[old].line;
+                column_delta = token->column - tokens[old].column;
+                break;
             }
-            break;
         }
+        lexer->tokenIdx++;
+    } while (token->type != TOKEN_EOF);
+
+    // Splice: kept prefix, re-lexed middle, then the old tail shifted in place.
+    int relexed = lexer->tokenIdx;
+    int tail = count - old;
+    int new_count = kept + relexed + tail;
+    if (new_count > count) {
+        Token* grown = realloc(tokens, sizeof(Token) * new_count);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to grow token array\n");
+            free_lexer(lexer);
+            return NULL;
+        }
+        tokens = grown;
+    }
 
-    if (isCompound) {
-        char op_str[3] = {c, lexer->end[-1], '\0'};
-        add_token(lexer, create_string_token(type, op_str, lexer->line, lexer->column - 2));
-    } else {
-        add_token(lexer, create_char_token(type, c, lexer->line, lexer->column - 1));
+    if (tail > 0) {
+        int sync_line = tokens[old].line;
+        memmove(&tokens[kept + relexed], &tokens[old], sizeof(Token) * tail);
+        for (Token* shifted = &tokens[kept + relexed]; shifted < &tokens[new_count]; shifted++) {
+            if (shifted->line == sync_line) shifted->column += column_delta;
+            shifted->offset += delta;
+            shifted->line += line_delta;
+        }
     }
+    memcpy(&tokens[kept], lexer->tokens, sizeof(Token) * relexed);
+
+    free_lexer(lexer);
+    *token_count = new_count;
+    return tokens;
 }
 
-void marker(Lexer* lexer) {
-    char c = advance(lexer);
-    TokenType type = TOKEN_UNKNOWN;
+static void read_table_token(Lexer* lexer, Token* token);
+static void read_replay_token(Lexer* lexer, Token* token);
+
+// Scanning past the end keeps returning TOKEN_EOF, so the ring can always be filled.
+Token* peek_token(Lexer* lexer, int k) {
+    while (lexer->ring_count <= k) {
+        int slot = (lexer->ring_head + lexer->ring_count) & (TOKEN_LOOKAHEAD - 1);
+        if (lexer->table) {
+            read_table_token(lexer, &lexer->ring[slot]);
+        } else if (lexer->replay) {
+            read_replay_token(lexer, &lexer->ring[slot]);
+        } else {
+            scan_token(lexer, &lexer->ring[slot]);
+        }
+        lexer->ring_count++;
+    }
+    return &lexer->ring[(lexer->ring_head + k) & (TOKEN_LOOKAHEAD - 1)];
+}
+
+Token next_token(Lexer* lexer) {
+    Token token = *peek_token(lexer, 0);
+    lexer->ring_head = (lexer->ring_head + 1) & (TOKEN_LOOKAHEAD - 1);
+    lexer->ring_count--;
+    return token;
+}
 
-    switch (c) {
-        case '(': type = TOKEN_LEFT_PARENTHESES; break;
-        case ')': type = TOKEN_RIGHT_PARENTHESES; break;
-        case '[': type = TOKEN_LEFT_BRACKET; break;
-        case ']': type = TOKEN_RIGHT_BRACKET; break;
-        case '{': type = TOKEN_LEFT_BRACE; break;
-        case '}': type = TOKEN_RIGHT_BRACE; break;
-        case ';': type = TOKEN_SEMICOLON; break;
-        case ',': type = TOKEN_COMMA; break;
+_Static_assert(TOKEN_EOF <= UINT8_MAX, "token kinds must fit in TokenTable.kinds");
+
+static bool append_table_token(TokenTable* table, const Token* token) {
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 1024;
+        uint8_t* kinds = realloc(table->kinds, capacity);
+        if (!kinds) return false;
+        table->kinds = kinds;
+
+        uint32_t* offsets = realloc(table->offsets, sizeof(uint32_t) * capacity);
+        if (!offsets) return false;
+        table->offsets = offsets;
+        table->capacity = capacity;
+    }
+
+    if (token->type == TOKEN_ID || token->type == TOKEN_INT_LITERAL) {
+        if (table->value_count == table->value_capacity) {
+            int capacity = table->value_capacity ? table->value_capacity * 2 : 256;
+            uint32_t* values = realloc(table->values, sizeof(uint32_t) * capacity);
+            if (!values) return false;
+            table->values = values;
+
+            uint32_t* value_tokens = realloc(table->value_tokens, sizeof(uint32_t) * capacity);
+            if (!value_tokens) return false;
+            table->value_tokens = value_tokens;
+            table->value_capacity = capacity;
+        }
+        table->values[table->value_count] = token->value.id;
+        table->value_tokens[table->value_count++] = table->count;
     }
 
-    add_token(lexer, create_char_token(type, c, lexer->line, lexer->column - 1));
+    table->kinds[table->count] = token->type;
+    table->offsets[table->count++] = token->offset;
+    return true;
 }
 
-Token* lexical_analysis(char* source) {
-    Lexer* lexer = init_lexer(source);
-    if (!lexer) return NULL;
+TokenTable* lexical_analysis_compact(char* source, size_t length) {
+    if (length > UINT32_MAX) {
+        fprintf(stderr, "Error: Source is too large for compact token offsets\n");
+        return NULL;
+    }
+
+    TokenTable* table = calloc(1, sizeof(TokenTable));
+    Lexer* lexer = init_lexer_range(source, length);
+    if (!table || !lexer) {
+        free(table);
+        free_lexer(lexer);
+        return NULL;
+    }
+    table->source = source;
+    table->length = length;
+
+    Token token;
+    do {
+        scan_token(lexer, &token);
+        if (!append_table_token(table, &token)) {
+            fprintf(stderr, "Error: Failed to grow token table\n");
+            free_token_table(table);
+            free_lexer(lexer);
+            return NULL;
+        }
+    } while (token.type != TOKEN_EOF);
+
+    free_lexer(lexer);
+    return table;
+}
+
+// Lexemes are re-measured from the source: identifiers and numbers by the
+// scan kernels, operators by whether their kind is the one-character form.
+int token_table_length(const TokenTable* table, int index) {
+    const char* start = table->source + table->offsets[index];
+    const char* limit = table->source + table->length;
+    TokenType kind = table->kinds[index];
+    unsigned char c = *start;
+
+    if (kind == TOKEN_EOF) return 0;
+    if (kind == TOKEN_INT_LITERAL) {
+        const char* digits = c == '-' ? start + 1 : start;
+        return get_scan_kernels()->digits_end(digits, limit) - start;
+    }
+
+    switch (char_class[c]) {
+        case CHAR_ALPHA:
+            return get_scan_kernels()->identifier_end(start, limit) - start;
+        case CHAR_MINUS:
+        case CHAR_OPERATOR:
+            return kind == operator_table[c].single ? 1 : 2;
+        default:
+            return 1;
+    }
+}
+
+// Matches what scan_token() stores: ids and integers from the side table,
+// the character itself for one-byte tokens, zero otherwise.
+static TokenValue table_value(const TokenTable* table, int index, int value_index, int length) {
+    TokenValue value = {0};
+    TokenType kind = table->kinds[index];
+
+    if (kind == TOKEN_ID || kind == TOKEN_INT_LITERAL) {
+        value.id = table->values[value_index];
+    } else if (kind != TOKEN_EOF && length == 1) {
+        value.character = table->source[table->offsets[index]];
+    }
+    return value;
+}
 
-    while (*lexer->end != '\0') {
-        char c = peek(lexer);
+TokenValue token_table_value(const TokenTable* table, int index) {
+    int low = 0;
+    int high = table->value_count - 1;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (table->value_tokens[middle] < (uint32_t)index) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return table_value(table, index, low, token_table_length(table, index));
+}
 
-        if (isspace(c)) {
-            if (c == '\n') {
-                lexer->line++;
-                lexer->column = 1;
+static bool build_line_index(TokenTable* table) {
+    if (table->line_starts) return true;
+
+    int capacity = 1024;
+    int count = 0;
+    uint32_t* starts = malloc(sizeof(uint32_t) * capacity);
+    if (!starts) return false;
+    starts[count++] = 0;
+
+    const char* p = table->source;
+    const char* limit = table->source + table->length;
+    while ((p = memchr(p, '\n', limit - p)) != NULL) {
+        p++;
+        if (count == capacity) {
+            uint32_t* grown = realloc(starts, sizeof(uint32_t) * capacity * 2);
+            if (!grown) {
+                free(starts);
+                return false;
             }
-            advance(lexer);
-            continue;
+            starts = grown;
+            capacity *= 2;
         }
+        starts[count++] = p - table->source;
+    }
 
-        lexer->start = lexer->end;
+    table->line_starts = starts;
+    table->line_count = count;
+    return true;
+}
 
-        if (isalpha(c)) {
-            identifier(lexer);
-        } else if (isdigit(c) || (c == '-' && isdigit(peek_next(lexer)))) {
-            number(lexer);
-        } else if (strchr("+-*/<>=!", c)) {
-            operator(lexer);
-        } else if (strchr(";(){}[],", c)) {
-            marker(lexer);
+bool token_table_position(TokenTable* table, int index, int* line, int* column) {
+    if (!build_line_index(table)) return false;
+
+    uint32_t offset = table->offsets[index];
+    int low = 0;
+    int high = table->line_count - 1;
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (table->line_starts[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle - 1;
         }
     }
 
-    add_token(lexer, create_token(TOKEN_EOF, lexer->line, lexer->column));
-    Token* tokens = lexer->tokens;
-    free(lexer);
-    return tokens;
+    *line = low + 1;
+    *column = offset - table->line_starts[low] + 1;
+    return true;
+}
+
+Token token_table_get(TokenTable* table, int index) {
+    Token token = create_token(table->kinds[index], 0, 0);
+    token.offset = table->offsets[index];
+    token.length = token_table_length(table, index);
+    token.value = token_table_value(table, index);
+    token_table_position(table, index, &token.line, &token.column);
+    return token;
+}
+
+size_t token_table_bytes(const TokenTable* table) {
+    return table->count * (sizeof(uint8_t) + sizeof(uint32_t)) +
+        table->value_count * 2 * sizeof(uint32_t) + table->line_count * sizeof(uint32_t);
+}
+
+void free_token_table(TokenTable* table) {
+    if (!table) return;
+    free(table->kinds);
+    free(table->offsets);
+    free(table->values);
+    free(table->value_tokens);
+    free(table->line_starts);
+    free(table);
+}
+
+Lexer* init_lexer_table(TokenTable* table) {
+    Lexer* lexer = init_lexer_range((char*)table->source, table->length);
+    if (!lexer) return NULL;
+    lexer->table = table;
+    return lexer;
 }
 
-void free_token(Token* token) {
-    if (token->type == TOKEN_ID || token->type == TOKEN_KEYWORD) {
-        free(token->value.string);
+// Sequential replay: the value cursor only moves forward, so no searching is
+// needed. TOKEN_EOF is repeated once the table is exhausted. Line and column
+// stay 0; a diagnostic asks token_table_position() for them.
+static void read_table_token(Lexer* lexer, Token* token) {
+    TokenTable* table = lexer->table;
+    int index = lexer->table_index;
+    if (index < table->count - 1) lexer->table_index++;
+
+    *token = create_token(table->kinds[index], 0, 0);
+    token->offset = table->offsets[index];
+    token->length = token_table_length(table, index);
+    token->value = table_value(table, index, lexer->value_index, token->length);
+    if (token->type == TOKEN_ID || token->type == TOKEN_INT_LITERAL) lexer->value_index++;
+}
+
+Lexer* init_lexer_tokens(char* source, const Token* tokens, int count) {
+    Lexer* lexer = init_lexer_range(source, 0);
+    if (!lexer) return NULL;
+    lexer->replay = tokens;
+    lexer->replay_count = count;
+    return lexer;
+}
+
+static void read_replay_token(Lexer* lexer, Token* token) {
+    if (lexer->replay_index < lexer->replay_count) {
+        *token = lexer->replay[lexer->replay_index++];
+    } else {
+        *token = create_token(TOKEN_EOF, 0, 0);
     }
 }
 
 void free_tokens(Token* tokens) {
-    for (int i = 0; tokens[i].type != TOKEN_EOF; i++) {
-        free_token(&tokens[i]);
-    }
     free(tokens);
 }
 
-void print_tokens(Token* tokens) {
+void print_tokens(const char* source, Token* tokens) {
     for (int i = 0; tokens[i].type != TOKEN_EOF; i++) {
         // printf("Token type: ");
         switch (tokens[i].type) { 
             case TOKEN_ADD_AND_ASSIGN:
-                printf("ADD AND ASSIGN, Value: %s\n", tokens[i].value.string);
+                printf("ADD AND ASSIGN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_SUBTRACT_AND_ASSIGN:
-                printf("SUBTRACT AND ASSSIGN, Value: %s\n", tokens[i].value.string);
+                printf("SUBTRACT AND ASSSIGN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_MULTIPLY_AND_ASSIGN:
-                printf("MULTIPLY AND ASSIGN, Value: %s\n", tokens[i].value.string);
+                printf("MULTIPLY AND ASSIGN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_DIVIDE_AND_ASSIGN:
-                printf("DIVIDE AND ASSIGN, Value: %s\n", tokens[i].value.string);
+                printf("DIVIDE AND ASSIGN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_INCREMENT:
-                printf("INCREMENT, Value: %s\n", tokens[i].value.string);
+                printf("INCREMENT, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_DECREMENT:
-                printf("DECREMENT, Value: %s\n", tokens[i].value.string);
+                printf("DECREMENT, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_EQUAL:
-                printf("EQUAL, Value: %s\n", tokens[i].value.string);
+                printf("EQUAL, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_GREATER_EQUAL:
-                printf("GREATER THAN OR EQUAL, Value: %s\n", tokens[i].value.string);
+                printf("GREATER THAN OR EQUAL, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_LESS_EQUAL:
-                printf("LESS THAN OR EQUAL, Value: %s\n", tokens[i].value.string);
+                printf("LESS THAN OR EQUAL, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_NOT_EQUAL:
-                printf("NOT EQUAL, Value: %s\n", tokens[i].value.string);
+                printf("NOT EQUAL, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break; 
             case TOKEN_IF:
-                printf("IF, Value: %s\n", tokens[i].value.string);
+                printf("IF, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_ELSE:
-                printf("ELSE, Value: %s\n", tokens[i].value.string);
+                printf("ELSE, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_WHILE:
-                printf("WHILE, Value: %s\n", tokens[i].value.string);
+                printf("WHILE, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_FOR:
-                printf("FOR, Value: %s\n", tokens[i].value.string);
+                printf("FOR, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_VOID:
-                printf("VOID, Value: %s\n", tokens[i].value.string);
+                printf("VOID, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_INT:
-                printf("INT, Value: %s\n", tokens[i].value.string);
+                printf("INT, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_BOOLEAN:
-                printf("BOOLEAN, Value: %s\n", tokens[i].value.string);
+                printf("BOOLEAN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_CHAR:
-                printf("CHAR, Value: %s\n", tokens[i].value.string);
+                printf("CHAR, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_INT_LITERAL:
                 printf("INT LITERAL, Value: %d\n", tokens[i].value.integer_value);
                 break;
             case TOKEN_ID:
-                printf("IDENTIFIER, Value: %s\n", tokens[i].value.string);
+                printf("IDENTIFIER, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_KEYWORD:
-                printf("KEYWORD, Value: %s\n", tokens[i].value.string);
+                printf("KEYWORD, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_RETURN:
-                printf("RETURN, Value: %s\n", tokens[i].value.string);
+                printf("RETURN, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
+                break;
+            case TOKEN_STRUCT:
+                printf("STRUCT, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
+                break;
+            case TOKEN_BREAK:
+                printf("BREAK, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
+                break;
+            case TOKEN_CONTINUE:
+                printf("CONTINUE, Value: %.*s\n", tokens[i].length, source + tokens[i].offset);
                 break;
             case TOKEN_UNKNOWN:
                 printf("UNKNOWN\n");
@@ -7,6 +7,7 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include "intern.h"
 
 typedef long long integer_t;
 typedef enum TokenType {
@@ -68,14 +69,18 @@ typedef enum TokenType {
 } TokenType;
 
 typedef union TokenValue{
-    char* string;
     char character;
     int integer_value;
+    uint32_t id;
 } TokenValue;
 
+// offset/length locate the lexeme in the source buffer passed to lexical_analysis(),
+// which must outlive the tokens. Use token_text() to get an owned copy.
 typedef struct Token {
     TokenType type; 
     TokenValue value;
+    int offset;
+    int length;
     int line;
     int column;
 } Token;
@@ -91,6 +96,8 @@ typedef enum {
     KEYWORD_RETURN,
     KEYWORD_VOID,
     KEYWORD_STRUCT,
+    KEYWORD_BREAK,
+    KEYWORD_CONTINUE,
     KEYWORD_UNKNOWN
 } keyword_t;
 
@@ -116,41 +123,149 @@ typedef struct {
     int column;
 } LexerError;
 
+typedef enum {
+    SCAN_KERNEL_SCALAR,
+    SCAN_KERNEL_SSE2,
+    SCAN_KERNEL_AVX2
+} scan_kernel_t;
+
+// Run finders used by the scanner. Each stops at limit and never reads past it.
+typedef struct {
+    const char* (*skip_whitespace)(const char* p, const char* limit, int* newlines, const char** line_start);
+    const char* (*identifier_end)(const char* p, const char* limit);
+    const char* (*digits_end)(const char* p, const char* limit);
+} ScanKernels;
+
+// Compact token storage: a byte of kind and a 32-bit source offset per token.
+// Identifier ids and integer values go to a side table in token order, and
+// lengths, characters and line/column are recovered from the source when
+// asked for. line_starts is only built by the first position query.
+typedef struct {
+    uint8_t* kinds;
+    uint32_t* offsets;
+    int count;
+    int capacity;
+
+    uint32_t* values;
+    uint32_t* value_tokens;     // index of the token owning each value, ascending
+    int value_count;
+    int value_capacity;
+
+    const char* source;
+    size_t length;
+    uint32_t* line_starts;
+    int line_count;
+} TokenTable;
+
+// Tokens the parser may look ahead without consuming; must be a power of two.
+#define TOKEN_LOOKAHEAD 4
+
 typedef struct {
+    char* source;
+    char* limit;
     char* start;
     char* end;
+    char* line_start;
+    const ScanKernels* kernels;
     Token* tokens;
     int tokenIdx;
     int line;
-    int column;
     int capacity;
+    Token ring[TOKEN_LOOKAHEAD];
+    int ring_head;
+    int ring_count;
+    bool intern_identifiers;    // false leaves TOKEN_ID values at INTERN_NONE
+    TokenTable* table;          // when set, tokens are replayed from it instead of scanned
+    int table_index;
+    int value_index;
+    const Token* replay;        // likewise, from an array of replay_count tokens
+    int replay_count;
+    int replay_index;
 } Lexer;
 
-char peek(Lexer* lexer);
-char peek_next(Lexer* lexer);
-char advance(Lexer* lexer);
-void operator(Lexer* lexer);
-void number(Lexer* lexer);
-void identifier(Lexer* lexer);
-void marker(Lexer* lexer);
 bool add_token(Lexer* lexer, Token token);
-bool match(Lexer* lexer, char expected);
+// Scans one token at lexer->end without storing it; lexer->start/end bracket it.
+void scan_token(Lexer* lexer, Token* token);
+
+bool scan_kernel_supported(scan_kernel_t kind);
+bool set_scan_kernel(scan_kernel_t kind);
+scan_kernel_t get_scan_kernel();
+const ScanKernels* get_scan_kernels();
+const char* scan_kernel_name(scan_kernel_t kind);
 
 Token create_token(TokenType type, int line, int column);
 Token create_int_token(TokenType type, int value, int line, int column);
-Token create_string_token(TokenType type, char* value, int line, int column);
 Token create_char_token(TokenType type, char value, int line, int column);
+char* token_text(const char* source, const Token* token);
+bool token_equals(const char* source, const Token* token, const char* text);
 
 Lexer* init_lexer(char* source);
+Lexer* init_lexer_range(char* source, size_t length);
+void free_lexer(Lexer* lexer);
 Token* lexical_analysis(char* source);
+Token* lexical_analysis_range(char* source, size_t length);
+// Scans to TOKEN_EOF and hands the token array (and its length) to the caller.
+Token* scan_all_tokens(Lexer* lexer, int* count);
+
+// Splits source at newlines, lexes the pieces on up to `threads` workers and
+// stitches them back together. The result is identical to
+// lexical_analysis_range(); small inputs and threads <= 1 run serially.
+#define PARALLEL_LEX_MIN_CHUNK 65536
+Token* lexical_analysis_parallel(char* source, size_t length, int threads);
+
+// Preprocesses and lexes in one pass: directives are handled when the scanner
+// reaches them and macros expand straight to tokens, so no preprocessed text
+// is built. Types and values match lexical_analysis() on preprocess() output.
+// Offsets and lines refer to the file each token came from; a token made from
+// a macro use spans that use. Text glued to a use keeps its own span unless
+// it lexes into one token with the expansion, as "-A" does into "-1" when A
+// is 1; that token spans both.
+Token* preprocess_tokens(char* file_path, char* source, size_t length, int* count);
+
+TokenTable* lexical_analysis_compact(char* source, size_t length);
+int token_table_length(const TokenTable* table, int index);
+TokenValue token_table_value(const TokenTable* table, int index);
+bool token_table_position(TokenTable* table, int index, int* line, int* column);
+Token token_table_get(TokenTable* table, int index);
+size_t token_table_bytes(const TokenTable* table);
+void free_token_table(TokenTable* table);
+// Streams a table through the next_token()/peek_token() interface. The
+// tokens carry no line or column; token_table_position() builds the line
+// index the first time a diagnostic needs one.
+Lexer* init_lexer_table(TokenTable* table);
+// Streams tokens[0..count) the same way, then TOKEN_EOF. Their offsets are
+// into source, which lazy function bodies parse from later.
+Lexer* init_lexer_tokens(char* source, const Token* tokens, int count);
+
+// removed_length bytes at offset replaced by inserted_length bytes of inserted.
+typedef struct {
+    int offset;
+    int removed_length;
+    const char* inserted;
+    int inserted_length;
+} SourceEdit;
+
+char* apply_source_edit(const char* source, size_t length, const SourceEdit* edit, size_t* new_length);
+// tokens (*count entries, TOKEN_EOF included) were lexed from the source
+// before the edit; source/length is the buffer after it. Only the tokens the
+// edit can affect are scanned again and the rest are shifted in place. Like
+// realloc(), the array may move: use the returned pointer. *count is updated.
+// On failure NULL is returned and tokens is still valid.
+Token* relex_tokens(Token* tokens, int* count, char* source, size_t length, const SourceEdit* edit);
+
+// Pull interface: tokens are scanned on demand, so no token array is built.
+// peek_token(lexer, 0) is the current token; the pointer stays valid until
+// the next call to next_token(). k must be below TOKEN_LOOKAHEAD.
+Token next_token(Lexer* lexer);
+Token* peek_token(Lexer* lexer, int k);
 
 void print_lexer_error(const LexerError* error);
 
+TokenType lookup_keyword(const char* text, int length);
 keyword_t get_keyword_type(char* str);
 TokenType keyword_to_token(Keyword* word);
 // Token* lexer(char* contents);
-void print_tokens(Token* tokens);
-void free_token(Token* token);
+void print_tokens(const char* source, Token* tokens);
 void free_tokens(Token* tokens);
 
 #endif
\ No newline at end of file
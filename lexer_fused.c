@@ -0,0 +1,292 @@
+#include "lexer.h"
+#include "preprocessor.h"
+
+// The fused pass walks each file once with the lexer's own scanner. The
+// preprocessor only sees directive lines, and a macro use becomes the token
+// its value would have lexed to. The tokens must come out exactly as
+// lexical_analysis() would produce them from preprocess() output.
+//
+// Substituted text can only change how the token just before it lexes:
+// the scanner looks one character past a token and never behind it. So a
+// use with whitespace before it turns into its token directly. A use glued
+// to the previous token, as in "-A" or "3A", is spliced. The substituted
+// text is rebuilt from that token's start up to the next whitespace and
+// lexed on its own. A function-like call is always spliced, from its name
+// to the first whitespace after the call.
+
+static inline bool is_word_start(char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || c == '_';
+}
+
+static inline bool is_run_end(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f' || c == '\n' || c == '\0';
+}
+
+static bool only_blanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p == end;
+}
+
+// Where a stretch of the run's text came from: output[output_start..) is
+// source start..end, copied as it is or, for a macro use, expanded.
+typedef struct {
+    size_t output_start;
+    char* start;
+    char* end;
+    bool expanded;
+} RunPiece;
+
+typedef struct {
+    RunPiece* pieces;
+    int count;
+    int capacity;
+} RunPieces;
+
+// The scan_context of the fused pass; pieces is kept from run to run.
+typedef struct {
+    Lexer* lexer;
+    RunPieces pieces;
+} FusedScan;
+
+static bool add_piece(RunPieces* run, size_t output_start, char* start, char* end, bool expanded) {
+    if (run->count > 0) {
+        RunPiece* last = &run->pieces[run->count - 1];
+        if (!expanded && !last->expanded && last->end == start) {
+            last->end = end;
+            return true;
+        }
+    }
+
+    if (run->count == run->capacity) {
+        int capacity = run->capacity ? run->capacity * 2 : 8;
+        RunPiece* pieces = realloc(run->pieces, sizeof(RunPiece) * capacity);
+        if (!pieces) return false;
+        run->pieces = pieces;
+        run->capacity = capacity;
+    }
+    run->pieces[run->count++] = (RunPiece){ output_start, start, end, expanded };
+    return true;
+}
+
+// The piece holding output byte offset, searching on from *piece.
+static const RunPiece* find_piece(const RunPieces* run, int* piece, size_t offset) {
+    while (*piece + 1 < run->count && run->pieces[*piece + 1].output_start <= offset) (*piece)++;
+    return &run->pieces[*piece];
+}
+
+// Re-lexes the substituted text from the start of the glued previous token
+// (or from word when nothing is glued) to the next whitespace after the last
+// macro use. preprocessor->output serves as the scratch buffer. A token lexed
+// from copied text keeps its own place in the source; one that takes in an
+// expansion spans the macro uses it came from, as in "-A" lexing to "-1".
+static bool splice_run(Preprocessor* preprocessor, Lexer* lexer, RunPieces* pieces, bool glued, char* word,
+        char** run_end) {
+    Token previous = glued ? lexer->tokens[--lexer->tokenIdx] : create_token(TOKEN_UNKNOWN, lexer->line, 0);
+    char* run_start = glued ? lexer->source + previous.offset : word;
+    pieces->count = 0;
+
+    char* limit = lexer->limit;
+    preprocessor->output_length = 0;
+    bool ok = !glued || (append_output(preprocessor, run_start, previous.length) &&
+        add_piece(pieces, 0, run_start, word, false));
+
+    char* p = word;
+    while (ok && p < limit && !is_run_end(*p)) {
+        size_t output_start = preprocessor->output_length;
+        if (!is_word_start(*p)) {
+            ok = append_output(preprocessor, p, 1) && add_piece(pieces, output_start, p, p + 1, false);
+            p++;
+            continue;
+        }
+
+        char* end = (char*)lexer->kernels->identifier_end(p, limit);
+        Macro* macro = find_macro(preprocessor->macros, intern_find(p, end - p));
+        char* use_end = macro ? expand_macro(preprocessor, macro, end) : NULL;
+        if (use_end) {
+            ok = add_piece(pieces, output_start, p, use_end, true);
+        } else {
+            ok = append_output(preprocessor, p, end - p) && add_piece(pieces, output_start, p, end, false);
+            use_end = end;
+        }
+        p = use_end;
+    }
+
+    Lexer* run = ok ? init_lexer_range(preprocessor->output, preprocessor->output_length) : NULL;
+    if (!run) return false;
+
+    // a call may cross lines, so positions are counted forward from run_start
+    char* position = run_start;
+    int line = previous.line;
+    char* line_start = lexer->line_start;
+    int first = 0;
+    int last = 0;
+
+    Token token;
+    for (scan_token(run, &token); ok && token.type != TOKEN_EOF; scan_token(run, &token)) {
+        const RunPiece* from = find_piece(pieces, &first, token.offset);
+        const RunPiece* to = find_piece(pieces, &last, token.offset + token.length - 1);
+        lexer->start = from->expanded ? from->start : from->start + (token.offset - from->output_start);
+        lexer->end = to->expanded ? to->end : to->start + (token.offset + token.length - to->output_start);
+
+        for (; position < lexer->start; position++) {
+            if (*position == '\n') {
+                line++;
+                line_start = position + 1;
+            }
+        }
+        token.line = line;
+        token.column = lexer->start - line_start + 1;
+        ok = add_token(lexer, token);
+    }
+
+    free_lexer(run);
+    *run_end = p;
+    return ok;
+}
+
+// Installed as the preprocessor's scan_source, so included files run through
+// here too. The lexer's cursor is saved on entry and restored on exit because
+// an #include re-enters this function for the included file.
+static bool lex_source(Preprocessor* preprocessor) {
+    FusedScan* scan = preprocessor->scan_context;
+    Lexer* lexer = scan->lexer;
+    Lexer saved = *lexer;
+
+    lexer->source = preprocessor->source;
+    lexer->limit = preprocessor->limit;
+    lexer->start = preprocessor->end;
+    lexer->end = preprocessor->end;
+    lexer->line_start = preprocessor->end;
+    lexer->line = preprocessor->line;
+
+    MacroList* macros = preprocessor->macros;
+    const char* last_end = NULL;
+    bool ok = true;
+
+    while (ok) {
+        const char* line_start = lexer->line_start;
+        lexer->end = (char*)lexer->kernels->skip_whitespace(lexer->end, lexer->limit, &lexer->line, &line_start);
+        lexer->line_start = (char*)line_start;
+        if (lexer->end >= lexer->limit || *lexer->end == '\0') break;
+
+        char* p = lexer->end;
+        if (*p == '#' && only_blanks(lexer->line_start, p)) {
+            preprocessor->end = p;
+            preprocessor->current_pos = p - preprocessor->source;
+            preprocessor->line = lexer->line;
+            preprocessor->column = p - lexer->line_start + 1;
+
+            // an inactive region is skipped inside the directive, lines and all
+            parse_directive(preprocessor);
+            lexer->end = preprocessor->end;
+            lexer->line = preprocessor->line;
+            last_end = NULL;
+            continue;
+        }
+
+        if (is_word_start(*p)) {
+            char* word_end = (char*)lexer->kernels->identifier_end(p, lexer->limit);
+            int length = word_end - p;
+
+            // An ordinary identifier is interned once and that id finds the macro.
+            TokenType type = *p == '_' ? TOKEN_UNKNOWN : lookup_keyword(p, length);
+            uint32_t name_id = type == TOKEN_ID ? intern(p, length) : intern_find(p, length);
+            Macro* macro = find_macro(macros, name_id);
+
+            if (!macro && type == TOKEN_ID) {
+                lexer->start = p;
+                lexer->end = word_end;
+                Token token = create_token(TOKEN_ID, lexer->line, p - lexer->line_start + 1);
+                token.value.id = name_id;
+                ok = add_token(lexer, token);
+                last_end = word_end;
+                continue;
+            }
+
+            // A call's text is lexed as a run; the run may cross lines inside the call.
+            bool glued = last_end == p && lexer->tokenIdx > 0;
+            if (macro && (glued || macro->function_like)) {
+                char* run_end = p;
+                ok = splice_run(preprocessor, lexer, &scan->pieces, glued, p, &run_end);
+                for (char* c = p; c < run_end; c++) {
+                    if (*c == '\n') {
+                        lexer->line++;
+                        lexer->line_start = c + 1;
+                    }
+                }
+                lexer->end = run_end;
+                last_end = run_end;
+                continue;
+            }
+
+            if (macro) {
+                lexer->start = p;
+                lexer->end = word_end;
+                if (macro->has_value) {
+                    ok = add_token(lexer, create_int_token(TOKEN_INT_LITERAL, macro->u.value, lexer->line,
+                        p - lexer->line_start + 1));
+                }
+                last_end = word_end;
+                continue;
+            }
+
+            // not a macro: whatever the lexer makes of the word, with no lookups inside it
+            while (ok && lexer->end < word_end) {
+                Token token;
+                scan_token(lexer, &token);
+                ok = add_token(lexer, token);
+            }
+            last_end = word_end;
+            continue;
+        }
+
+        Token token;
+        scan_token(lexer, &token);
+        ok = add_token(lexer, token);
+        last_end = lexer->end;
+    }
+
+    preprocessor->line = lexer->line;
+    saved.tokens = lexer->tokens;
+    saved.tokenIdx = lexer->tokenIdx;
+    saved.capacity = lexer->capacity;
+    *lexer = saved;
+    return ok;
+}
+
+Token* preprocess_tokens(char* file_path, char* source, size_t length, int* count) {
+    Preprocessor* preprocessor = init_preprocessor(source, length);
+    Lexer* lexer = init_lexer_range(source, length);
+    if (!preprocessor || !preprocessor->macros || !preprocessor->includes || !lexer) {
+        free_preprocessor(preprocessor);
+        free_lexer(lexer);
+        return NULL;
+    }
+
+    FusedScan scan = { .lexer = lexer };
+    preprocessor->file_path = file_path;
+    preprocessor->scan_source = lex_source;
+    preprocessor->scan_context = &scan;
+
+    bool ok = lex_source(preprocessor);
+    end_conditionals(preprocessor);
+    if (ok) {
+        lexer->start = lexer->limit;
+        lexer->end = lexer->limit;
+        ok = add_token(lexer, create_token(TOKEN_EOF, preprocessor->line, 0));
+    }
+
+    Token* tokens = NULL;
+    if (ok) {
+        tokens = lexer->tokens;
+        if (count) *count = lexer->tokenIdx;
+        lexer->tokens = NULL;
+    } else {
+        fprintf(stderr, "Error: Failed to grow token array\n");
+    }
+
+    free(scan.pieces.pieces);
+    free_lexer(lexer);
+    free_preprocessor(preprocessor);
+    return tokens;
+}
@@ -0,0 +1,130 @@
+#include <pthread.h>
+#include "lexer.h"
+
+// Z has no string literals or comments, and no token spans a newline, so
+// the byte after any '\n' is a safe place to start an independent lexer.
+// Each chunk starts at the beginning of a line, which keeps its columns
+// right; only offsets and lines need rebasing when the chunks are joined.
+
+typedef struct {
+    char* start;
+    size_t length;
+    Token* tokens;
+    int count;
+    int newlines;
+    bool stopped;   // hit a NUL before the end of the chunk
+} LexChunk;
+
+static void* lex_chunk(void* arg) {
+    LexChunk* chunk = arg;
+    Lexer* lexer = init_lexer_range(chunk->start, chunk->length);
+    if (!lexer) return NULL;
+
+    // The interner is not thread safe; names are interned in order while
+    // stitching so ids come out exactly as the serial lexer assigns them.
+    lexer->intern_identifiers = false;
+    chunk->tokens = scan_all_tokens(lexer, &chunk->count);
+    chunk->newlines = lexer->line - 1;
+    chunk->stopped = lexer->end < lexer->limit;
+    free_lexer(lexer);
+    return NULL;
+}
+
+static int split_chunks(char* source, size_t length, LexChunk* chunks, int max_chunks) {
+    size_t target = length / max_chunks;
+    char* limit = source + length;
+    char* start = source;
+    int count = 0;
+
+    while (start < limit) {
+        char* end = limit;
+        if (count < max_chunks - 1 && (size_t)(limit - start) > target) {
+            char* newline = memchr(start + target, '\n', limit - (start + target));
+            if (newline) end = newline + 1;
+        }
+
+        chunks[count].start = start;
+        chunks[count].length = end - start;
+        chunks[count].tokens = NULL;
+        count++;
+        start = end;
+    }
+    return count;
+}
+
+static Token* stitch_chunks(char* source, LexChunk* chunks, int count) {
+    size_t total = 1;
+    for (int i = 0; i < count; i++) {
+        if (!chunks[i].tokens) return NULL;
+        total += chunks[i].count - 1;
+        if (chunks[i].stopped) break;
+    }
+
+    Token* tokens = malloc(sizeof(Token) * total);
+    if (!tokens) return NULL;
+
+    size_t next = 0;
+    int line_base = 0;
+    for (int i = 0; i < count; i++) {
+        LexChunk* chunk = &chunks[i];
+        int offset_base = chunk->start - source;
+        bool last = i == count - 1 || chunk->stopped;
+        int keep = last ? chunk->count : chunk->count - 1;
+
+        for (int j = 0; j < keep; j++) {
+            Token token = chunk->tokens[j];
+            token.offset += offset_base;
+            token.line += line_base;
+            if (token.type == TOKEN_ID) {
+                token.value.id = intern(source + token.offset, token.length);
+            }
+            tokens[next++] = token;
+        }
+
+        line_base += chunk->newlines;
+        if (last) break;
+    }
+    return tokens;
+}
+
+Token* lexical_analysis_parallel(char* source, size_t length, int threads) {
+    int max_chunks = threads;
+    if ((size_t)max_chunks > length / PARALLEL_LEX_MIN_CHUNK) max_chunks = length / PARALLEL_LEX_MIN_CHUNK;
+    if (max_chunks <= 1) return lexical_analysis_range(source, length);
+
+    LexChunk* chunks = malloc(sizeof(LexChunk) * max_chunks);
+    pthread_t* workers = malloc(sizeof(pthread_t) * max_chunks);
+    if (!chunks || !workers) {
+        free(chunks);
+        free(workers);
+        return NULL;
+    }
+
+    int count = split_chunks(source, length, chunks, max_chunks);
+
+    // Pick the scan kernels here so the workers only ever read the selection.
+    get_scan_kernels();
+
+    // The calling thread takes the first chunk itself.
+    int started = 1;
+    for (; started < count; started++) {
+        if (pthread_create(&workers[started], NULL, lex_chunk, &chunks[started]) != 0) break;
+    }
+    for (int i = started; i < count; i++) {
+        lex_chunk(&chunks[i]);
+    }
+    lex_chunk(&chunks[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    Token* tokens = stitch_chunks(source, chunks, count);
+    if (!tokens) fprintf(stderr, "Error: Failed to lex source in parallel\n");
+
+    for (int i = 0; i < count; i++) {
+        free_tokens(chunks[i].tokens);
+    }
+    free(chunks);
+    free(workers);
+    return tokens;
+}
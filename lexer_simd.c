@@ -0,0 +1,228 @@
+#include "lexer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+static inline bool is_space_byte(unsigned char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool is_identifier_byte(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || (unsigned char)(c - '0') <= 9 || c == '_';
+}
+
+static inline bool is_digit_byte(unsigned char c) {
+    return (unsigned char)(c - '0') <= 9;
+}
+
+static const char* scalar_skip_whitespace(const char* p, const char* limit, int* newlines, const char** line_start) {
+    while (p < limit && is_space_byte(*p)) {
+        if (*p == '\n') {
+            (*newlines)++;
+            *line_start = p + 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+static const char* scalar_identifier_end(const char* p, const char* limit) {
+    while (p < limit && is_identifier_byte(*p)) p++;
+    return p;
+}
+
+static const char* scalar_digits_end(const char* p, const char* limit) {
+    while (p < limit && is_digit_byte(*p)) p++;
+    return p;
+}
+
+static const ScanKernels scalar_kernels = {
+    .skip_whitespace = scalar_skip_whitespace,
+    .identifier_end = scalar_identifier_end,
+    .digits_end = scalar_digits_end,
+};
+
+#ifdef HAVE_X86_KERNELS
+
+// Each kernel builds a bitmask of the bytes that belong to the run, then the
+// first zero bit marks its end. Fewer than a full vector left falls back to
+// the scalar loop so no load crosses the end of the buffer.
+
+static inline __m128i sse2_in_range(__m128i bytes, char low, char span) {
+    __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(span)), shifted);
+}
+
+static inline unsigned sse2_space_mask(__m128i bytes) {
+    // ' ' plus the range '\t'..'\r' covers every CHAR_SPACE/CHAR_NEWLINE byte
+    __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    __m128i controls = sse2_in_range(bytes, '\t', '\r' - '\t');
+    return _mm_movemask_epi8(_mm_or_si128(space, controls));
+}
+
+static inline unsigned sse2_identifier_mask(__m128i bytes) {
+    __m128i alpha = sse2_in_range(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m128i digit = sse2_in_range(bytes, '0', 9);
+    __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), underscore));
+}
+
+static const char* sse2_skip_whitespace(const char* p, const char* limit, int* newlines, const char** line_start) {
+    while (limit - p >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+        unsigned run = sse2_space_mask(bytes);
+        unsigned breaks = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')));
+
+        int length = run == 0xFFFF ? 16 : __builtin_ctz(~run);
+        breaks &= (1u << length) - 1;
+        if (breaks) {
+            *newlines += __builtin_popcount(breaks);
+            *line_start = p + (31 - __builtin_clz(breaks)) + 1;
+        }
+
+        p += length;
+        if (length < 16) return p;
+    }
+    return scalar_skip_whitespace(p, limit, newlines, line_start);
+}
+
+static const char* sse2_identifier_end(const char* p, const char* limit) {
+    while (limit - p >= 16) {
+        unsigned run = sse2_identifier_mask(_mm_loadu_si128((const __m128i*)p));
+        if (run != 0xFFFF) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    return scalar_identifier_end(p, limit);
+}
+
+static const char* sse2_digits_end(const char* p, const char* limit) {
+    while (limit - p >= 16) {
+        unsigned run = _mm_movemask_epi8(sse2_in_range(_mm_loadu_si128((const __m128i*)p), '0', 9));
+        if (run != 0xFFFF) return p + __builtin_ctz(~run);
+        p += 16;
+    }
+    return scalar_digits_end(p, limit);
+}
+
+static const ScanKernels sse2_kernels = {
+    .skip_whitespace = sse2_skip_whitespace,
+    .identifier_end = sse2_identifier_end,
+    .digits_end = sse2_digits_end,
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i avx2_in_range(__m256i bytes, char low, char span) {
+    __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(span)), shifted);
+}
+
+static AVX2 const char* avx2_skip_whitespace(const char* p, const char* limit, int* newlines, const char** line_start) {
+    while (limit - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+        __m256i space = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+        __m256i controls = avx2_in_range(bytes, '\t', '\r' - '\t');
+        unsigned run = _mm256_movemask_epi8(_mm256_or_si256(space, controls));
+        unsigned breaks = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')));
+
+        int length = run == 0xFFFFFFFFu ? 32 : __builtin_ctz(~run);
+        if (length < 32) breaks &= (1u << length) - 1;
+        if (breaks) {
+            *newlines += __builtin_popcount(breaks);
+            *line_start = p + (31 - __builtin_clz(breaks)) + 1;
+        }
+
+        p += length;
+        if (length < 32) return p;
+    }
+    return sse2_skip_whitespace(p, limit, newlines, line_start);
+}
+
+static AVX2 const char* avx2_identifier_end(const char* p, const char* limit) {
+    while (limit - p >= 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)p);
+        __m256i alpha = avx2_in_range(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+        __m256i digit = avx2_in_range(bytes, '0', 9);
+        __m256i underscore = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+        unsigned run = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), underscore));
+        if (run != 0xFFFFFFFFu) return p + __builtin_ctz(~run);
+        p += 32;
+    }
+    return sse2_identifier_end(p, limit);
+}
+
+static AVX2 const char* avx2_digits_end(const char* p, const char* limit) {
+    while (limit - p >= 32) {
+        unsigned run = _mm256_movemask_epi8(avx2_in_range(_mm256_loadu_si256((const __m256i*)p), '0', 9));
+        if (run != 0xFFFFFFFFu) return p + __builtin_ctz(~run);
+        p += 32;
+    }
+    return sse2_digits_end(p, limit);
+}
+
+static const ScanKernels avx2_kernels = {
+    .skip_whitespace = avx2_skip_whitespace,
+    .identifier_end = avx2_identifier_end,
+    .digits_end = avx2_digits_end,
+};
+
+#endif
+
+static const ScanKernels* active_kernels = NULL;
+static scan_kernel_t active_kind = SCAN_KERNEL_SCALAR;
+
+bool scan_kernel_supported(scan_kernel_t kind) {
+    switch (kind) {
+        case SCAN_KERNEL_SCALAR:
+            return true;
+#ifdef HAVE_X86_KERNELS
+        case SCAN_KERNEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case SCAN_KERNEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+bool set_scan_kernel(scan_kernel_t kind) {
+    if (!scan_kernel_supported(kind)) return false;
+
+    switch (kind) {
+#ifdef HAVE_X86_KERNELS
+        case SCAN_KERNEL_SSE2: active_kernels = &sse2_kernels; break;
+        case SCAN_KERNEL_AVX2: active_kernels = &avx2_kernels; break;
+#endif
+        default: active_kernels = &scalar_kernels; break;
+    }
+    active_kind = kind;
+    return true;
+}
+
+const ScanKernels* get_scan_kernels() {
+    if (!active_kernels) {
+        if (!set_scan_kernel(SCAN_KERNEL_AVX2) && !set_scan_kernel(SCAN_KERNEL_SSE2)) {
+            set_scan_kernel(SCAN_KERNEL_SCALAR);
+        }
+    }
+    return active_kernels;
+}
+
+scan_kernel_t get_scan_kernel() {
+    get_scan_kernels();
+    return active_kind;
+}
+
+const char* scan_kernel_name(scan_kernel_t kind) {
+    switch (kind) {
+        case SCAN_KERNEL_SCALAR: return "scalar";
+        case SCAN_KERNEL_SSE2: return "sse2";
+        case SCAN_KERNEL_AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
@@ -4,43 +4,92 @@
 #include <ctype.h>
 #include <string.h>
 #include "preprocessor.h"
+#include "source.h"
 // #include "lexer.h"
 // #include "ast.h"
 // #include "codegen.h"
 
+// "dir/file.z" with its extension replaced, as in "dir/file.d"
+static char* replace_extension(const char* path, const char* extension) {
+    const char* slash = strrchr(path, '/');
+    const char* dot = strrchr(path, '.');
+    size_t length = dot && (!slash || dot > slash) ? (size_t)(dot - path) : strlen(path);
+
+    char* result = malloc(length + strlen(extension) + 1);
+    if (!result) return NULL;
+    memcpy(result, path, length);
+    strcpy(result + length, extension);
+    return result;
+}
+
+// Usage: main [-I directory]... [-MD] [-MF file] [--cache-dir directory] [--snapshot file]
+//             [--write-snapshot file] file
+// -I adds a directory to search for #include names, after the including
+// file's own directory for "name" and before it for <name>.
+// -MD writes a Make rule for file.o to file.d; -MF names the file instead.
+// --cache-dir reuses the preprocessed output of an earlier run when neither
+// the file nor anything it included has changed.
+// --write-snapshot saves the macros and output of preprocessing file, a
+// prefix header; --snapshot starts from such a snapshot, as if the prefix
+// header were included at the top of file.
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Error: expected two arguments\n");
+    char* file_path = NULL;
+    const char* dependency_path = NULL;
+    const char* snapshot_path = NULL;
+    bool dependencies = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-I", 2) == 0 && (argv[i][2] != '\0' || i + 1 < argc)) {
+            if (!add_include_path(argv[i][2] != '\0' ? argv[i] + 2 : argv[++i])) return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "-MD") == 0) {
+            dependencies = true;
+        } else if (strcmp(argv[i], "-MF") == 0 && i + 1 < argc) {
+            dependencies = true;
+            dependency_path = argv[++i];
+        } else if (strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+            set_output_cache(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            if (!set_macro_snapshot(argv[++i])) return EXIT_FAILURE;
+        } else if (strcmp(argv[i], "--write-snapshot") == 0 && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (!file_path && (argv[i][0] != '-' || argv[i][1] == '\0')) {
+            file_path = argv[i];
+        } else {
+            printf("Error: unexpected argument %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!file_path) {
+        printf("Error: expected a file to compile\n");
         return EXIT_FAILURE;
     }
 
-    char* file_path = argv[1];
-    // char* contents = get_file_contents(file_path);
-    // preprocessor opens up file.
-    char* contents = get_file_contents(file_path);
-<<<<<<< HEAD
-    if (contents != NULL) {
-        printf("Contents of %s\n---\n\"%s\"\n---\n", file_path, contents);
-        Preprocessor* preprocessor = preprocess(contents);
-        if (preprocessor->output) {
+    // Input is mapped and preprocessed in place; "-" reads stdin.
+    SourceFile* source = load_source(file_path);
+    if (source != NULL) {
+        printf("Contents of %s\n---\n\"%.*s\"\n---\n", file_path, (int)source->length, source->data);
+        Preprocessor* preprocessor = preprocess(file_path, source->data, source->length);
+        if (preprocessor && preprocessor->output) {
             printf("Preprocessed output:\n---\n\"%s\"\n---\n", preprocessor->output);
+
+            if (snapshot_path) write_macro_snapshot(preprocessor, snapshot_path);
+
+            if (dependencies) {
+                char* target = replace_extension(file_path, ".o");
+                char* default_path = dependency_path ? NULL : replace_extension(file_path, ".d");
+                if (target && (dependency_path || default_path)) {
+                    write_dependency_file(preprocessor, target, dependency_path ? dependency_path : default_path);
+                }
+                free(target);
+                free(default_path);
+            }
         }
-=======
-    Preprocessor* preprocessor = preprocess(file_path, contents);
-    if (preprocessor->output) {
-        printf("Preprocessed output:\n---\n\"%s\"\n---\n", preprocessor->output);
-    }
-    // if (contents) {
-        // printf("Contents of %s\n---\n\"%s\"\n---\n", file_path, contents);
-        // Preprocessor* preprocessor = preprocess(contents);
-        // if (preprocessor->processed_source) {
-        //     printf("Preprocessed output:\n---\n\"%s\"\n---\n", preprocessor->processed_source);
-        // }
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
         // Token* tokens = lexical_analysis(processed_output);
-        // print_tokens(tokens);
+        // print_tokens(processed_output, tokens);
         
-        // struct program* ast = build_ast(tokens);
+        // Lexer* lexer = init_lexer(processed_output);
+        // struct program* ast = build_ast(lexer);
         // print_ast(ast);
     
         // // Name resolution and type checking
@@ -57,10 +106,15 @@ int main(int argc, char** argv) {
         // free_register_table(sregs);
         // free_stack(stack);
         // free_ast(ast);
+        // free_lexer(lexer);
         // free_tokens(tokens);
-        // free_preprocessor(preprocessor);
-        // free(contents);
-    // }
+        free_preprocessor(preprocessor);
+        free_include_cache();
+        set_output_cache(NULL);
+        set_macro_snapshot(NULL);
+        free_include_resolver();
+        free_source(source);
+    }
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ struct expr* expr_create_integer_literal(int i) {
     node->integer_value = i;
     node->ch_expr = 0;
     node->name = NULL;
+    node->name_id = INTERN_NONE;
     node->string_literal = NULL;
     node->symbol = NULL;
     node->reg = -1;
@@ -30,6 +31,7 @@ struct expr* expr_create_char_literal(char ch) {
     node-> ch_expr = ch;
     node->integer_value = 0;
     node->name = NULL;
+    node->name_id = INTERN_NONE;
     node->string_literal = NULL;
     node->symbol = NULL;
     node->reg = -1;
@@ -46,6 +48,7 @@ struct expr* expr_create_boolean_literal(int b) {
     node->integer_value = b;
     node->ch_expr = 0;
     node->name = NULL;
+    node->name_id = INTERN_NONE;
     node->string_literal = NULL;
     node->symbol = NULL;
     node->reg = -1;
@@ -54,7 +57,7 @@ struct expr* expr_create_boolean_literal(int b) {
 }
 
 struct expr* expr_create_string_literal(char* str) {
-    struct expr* node = (struct expr*)malloc(sizeof(struct expr));
+    struct expr* node = node_alloc(sizeof(struct expr), ARENA_EXPR);
     if (!node) {
         perror("Error allocating space for expression node");
         return NULL;
@@ -64,9 +67,10 @@ struct expr* expr_create_string_literal(char* str) {
     node->left = NULL;
     node->right = NULL;
     node->name = NULL;
+    node->name_id = INTERN_NONE;
     node->integer_value = 0;
     node->ch_expr = 0;
-    node->string_literal = strdup(str);
+    node->string_literal = arena_strdup(get_node_arena(), str);
     node->symbol = NULL;
     node->reg = -1;
 
@@ -74,7 +78,7 @@ struct expr* expr_create_string_literal(char* str) {
 }
 
 struct expr* expr_create(expr_t kind, struct expr* left, struct expr* right) {
-    struct expr* node = malloc(sizeof(struct expr));
+    struct expr* node = node_alloc(sizeof(struct expr), ARENA_EXPR);
     if (!node) {
         fprintf(stderr, "Critical: Memory allocation failed for expression\n");
         exit(EXIT_FAILURE);
@@ -84,6 +88,7 @@ struct expr* expr_create(expr_t kind, struct expr* left, struct expr* right) {
     node->left = left;
     node->right = right;
     node->name = NULL;
+    node->name_id = INTERN_NONE;
     node->integer_value = 0;
     node->ch_expr = 0;
     node->string_literal = NULL;
@@ -93,21 +98,23 @@ struct expr* expr_create(expr_t kind, struct expr* left, struct expr* right) {
     return node;
 }
 
-struct decl* decl_create(char* name, struct type* type, struct expr* value, struct stmt* code, struct decl* next) {
-    struct decl* node = (struct decl*)malloc(sizeof(struct decl));
+struct decl* decl_create(uint32_t name_id, struct type* type, struct expr* value, struct stmt* code, struct decl* next) {
+    struct decl* node = node_alloc(sizeof(struct decl), ARENA_DECL);
     if (!node) {
         perror("Error allocating space for desclaration node");
         return NULL;
     }
 
-    node->name = strdup(name);
+    node->name_id = name_id;
+    node->name = intern_name(name_id);
     if (!node->name) {
-        fprintf(stderr, "Error: Unable to duplicate name");
+        fprintf(stderr, "Error: Unknown identifier id %u\n", name_id);
         return NULL;
     }
     node->type = type;
     node->value = value;
     node->code = code;
+    node->lazy = NULL;
     node->next = next;
     node->symbol = NULL;
     node->reg = -1;
@@ -116,7 +123,7 @@ struct decl* decl_create(char* name, struct type* type, struct expr* value, stru
 }
 
 struct stmt* stmt_create(stmt_t kind, struct decl* decl, struct expr* init_expr, struct expr* expr, struct expr* next_expr, struct stmt* body, struct stmt* else_body, struct stmt* next) {
-    struct stmt* node = (struct stmt*)malloc(sizeof(struct stmt));
+    struct stmt* node = node_alloc(sizeof(struct stmt), ARENA_STMT);
     if (node == NULL) {
         perror("Error allocating space for stmt node");
         return NULL;
@@ -188,61 +195,63 @@ expr_t get_expr_type(Token* token) {
     }
 }
 
-struct expr* parse_factor(Token* tokens, int* tokenIdx) {
+struct expr* parse_factor(Lexer* lexer) {
     struct expr* expr_node = NULL;
+    Token token;
 
-    switch(tokens[*tokenIdx].type) {
+    switch(peek_token(lexer, 0)->type) {
         case TOKEN_INT_LITERAL:
-            (*tokenIdx)++;
-            return expr_create_integer_literal(tokens[*tokenIdx-1].value.integer_value);
+            token = next_token(lexer);
+            return expr_create_integer_literal(token.value.integer_value);
 
         case TOKEN_ID:
-            (*tokenIdx)++;
+            token = next_token(lexer);
             expr_node = expr_create(EXPR_NAME, NULL, NULL);
-            expr_node->name = strdup(tokens[*tokenIdx-1].value.string);
+            expr_node->name_id = token.value.id;
+            expr_node->name = intern_name(expr_node->name_id);
 
-            if (tokens[*tokenIdx].type == TOKEN_INCREMENT ||
-                tokens[*tokenIdx].type == TOKEN_DECREMENT) {
-                expr_t op_kind = get_expr_type(&tokens[*tokenIdx]);
-            (*tokenIdx)++;
+            if (peek_token(lexer, 0)->type == TOKEN_INCREMENT ||
+                peek_token(lexer, 0)->type == TOKEN_DECREMENT) {
+                expr_t op_kind = get_expr_type(peek_token(lexer, 0));
+            next_token(lexer);
             struct expr* postfix_epr = expr_create(op_kind, expr_node, NULL);
             return postfix_epr;
             }
             return expr_node;
 
         case TOKEN_LEFT_PARENTHESES:
-            (*tokenIdx)++;
-            expr_node= parse_expression(tokens, tokenIdx);
-            if (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
+            next_token(lexer);
+            expr_node= parse_expression(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
                 fprintf(stderr, "Error: Mismatched parentheses expected ')'\n");
                 return NULL;
             }
 
-            (*tokenIdx)++;
+            next_token(lexer);
             return expr_node;
 
         case TOKEN_LEFT_BRACKET:
-            (*tokenIdx)++;
-            expr_node = parse_expression(tokens, tokenIdx);
-            if (tokens[*tokenIdx].type != TOKEN_RIGHT_BRACKET) {
+            next_token(lexer);
+            expr_node = parse_expression(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_RIGHT_BRACKET) {
                 fprintf(stderr, "Error: Mismatched brackets, expected ']'\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
             return expr_node;
 
         case TOKEN_ASSIGNMENT:
         case TOKEN_GREATER:
         case TOKEN_LESS:
-            (*tokenIdx)++;
-            printf("CHARACTER Value: %c\n", tokens[*tokenIdx-1].value.character);
-            return expr_create_char_literal(tokens[*tokenIdx-1].value.character);
+            token = next_token(lexer);
+            printf("CHARACTER Value: %c\n", token.value.character);
+            return expr_create_char_literal(token.value.character);
 
         case TOKEN_INCREMENT:
         case TOKEN_DECREMENT:
-            expr_t op_kind = get_expr_type(&tokens[*tokenIdx]);
-            (*tokenIdx)++;
-            struct expr* operand = parse_factor(tokens, tokenIdx);
+            expr_t op_kind = get_expr_type(peek_token(lexer, 0));
+            next_token(lexer);
+            struct expr* operand = parse_factor(lexer);
             return expr_create(op_kind, operand, NULL);
 
         default:
@@ -251,83 +260,72 @@ struct expr* parse_factor(Token* tokens, int* tokenIdx) {
     }
 }
 
-struct expr* parse_term(Token* tokens, int* tokenIdx) {
-    struct expr* expr_left = parse_factor(tokens, tokenIdx);
-
-    while (tokens[*tokenIdx].type == TOKEN_MULTIPLY || tokens[*tokenIdx].type == TOKEN_DIVIDE ||
-        tokens[*tokenIdx].type == TOKEN_MULTIPLY_AND_ASSIGN || tokens[*tokenIdx].type == TOKEN_DIVIDE_AND_ASSIGN) {
-        expr_t op_kind = get_expr_type(&tokens[*tokenIdx]);
-        
-        (*tokenIdx)++;
-
-        struct expr* expr_right = parse_factor(tokens, tokenIdx);
-        expr_left = expr_create(op_kind, expr_left, expr_right);
-    }   
-
-    return expr_left;
-}
-
-struct expr* parse_additive(Token* tokens, int* tokenIdx) {
-    struct expr* expr_left = parse_term(tokens, tokenIdx);
-
-    while ( tokens[*tokenIdx].type == TOKEN_ADD || 
-            tokens[*tokenIdx].type == TOKEN_SUBTRACT ||
-            tokens[*tokenIdx].type == TOKEN_ADD_AND_ASSIGN || 
-            tokens[*tokenIdx].type == TOKEN_SUBTRACT_AND_ASSIGN ) {
-        expr_t op_kind = get_expr_type(&tokens[*tokenIdx]);
-
-        (*tokenIdx)++;
-        struct expr* expr_right = parse_term(tokens, tokenIdx);
-        expr_left = expr_create(op_kind, expr_left, expr_right);
+// Binding power of each binary operator, loosest first. A new level is one
+// more entry here and a row in binary_operators; nothing else changes.
+enum {
+    PRECEDENCE_NONE,
+    PRECEDENCE_ASSIGNMENT,
+    PRECEDENCE_EQUALITY,
+    PRECEDENCE_RELATIONAL,
+    PRECEDENCE_ADDITIVE,
+    PRECEDENCE_MULTIPLICATIVE,
+};
+
+struct binary_operator {
+    uint8_t precedence;      // PRECEDENCE_NONE: not a binary operator
+    bool right_associative;
+    expr_t kind;
+};
+
+static const struct binary_operator binary_operators[TOKEN_EOF + 1] = {
+    [TOKEN_ASSIGNMENT]          = { PRECEDENCE_ASSIGNMENT, true, EXPR_ASSIGNMENT },
+    [TOKEN_ADD_AND_ASSIGN]      = { PRECEDENCE_ASSIGNMENT, true, EXPR_ADD_AND_ASSIGN },
+    [TOKEN_SUBTRACT_AND_ASSIGN] = { PRECEDENCE_ASSIGNMENT, true, EXPR_SUB_AND_ASSIGN },
+    [TOKEN_MULTIPLY_AND_ASSIGN] = { PRECEDENCE_ASSIGNMENT, true, EXPR_MUL_AND_ASSIGN },
+    [TOKEN_DIVIDE_AND_ASSIGN]   = { PRECEDENCE_ASSIGNMENT, true, EXPR_DIV_AND_ASSIGN },
+    [TOKEN_EQUAL]               = { PRECEDENCE_EQUALITY, false, EXPR_EQUAL },
+    [TOKEN_NOT_EQUAL]           = { PRECEDENCE_EQUALITY, false, EXPR_NOT_EQUAL },
+    [TOKEN_LESS]                = { PRECEDENCE_RELATIONAL, false, EXPR_LESS },
+    [TOKEN_GREATER]             = { PRECEDENCE_RELATIONAL, false, EXPR_GREATER },
+    [TOKEN_LESS_EQUAL]          = { PRECEDENCE_RELATIONAL, false, EXPR_LESS_EQUAL },
+    [TOKEN_GREATER_EQUAL]       = { PRECEDENCE_RELATIONAL, false, EXPR_GREATER_EQUAL },
+    [TOKEN_ADD]                 = { PRECEDENCE_ADDITIVE, false, EXPR_ADD },
+    [TOKEN_SUBTRACT]            = { PRECEDENCE_ADDITIVE, false, EXPR_SUB },
+    [TOKEN_MULTIPLY]            = { PRECEDENCE_MULTIPLICATIVE, false, EXPR_MUL },
+    [TOKEN_DIVIDE]              = { PRECEDENCE_MULTIPLICATIVE, false, EXPR_DIV },
+};
+
+// Precedence climbing: one parse_factor per operand, then fold in operators
+// binding at least as tightly as min_precedence. The right operand of a
+// left-associative operator only takes tighter ones, so a - b - c groups
+// to the left while a = b += c groups to the right.
+static struct expr* parse_binary(Lexer* lexer, int min_precedence) {
+    struct expr* expr_left = parse_factor(lexer);
+    if (!expr_left) return NULL;
+
+    for (;;) {
+        const struct binary_operator* op = &binary_operators[peek_token(lexer, 0)->type];
+        if (op->precedence == PRECEDENCE_NONE || op->precedence < min_precedence) break;
+        next_token(lexer);
+
+        struct expr* expr_right = parse_binary(lexer, op->right_associative ? op->precedence : op->precedence + 1);
+        if (!expr_right) return NULL;
+        expr_left = expr_create(op->kind, expr_left, expr_right);
     }
 
     return expr_left;
 }
 
-struct expr* parse_expression(Token* tokens, int* tokenIdx) {
-    struct expr* expr_left = parse_additive(tokens, tokenIdx);
-
-    while (tokens[*tokenIdx].type == TOKEN_LESS || tokens[*tokenIdx].type == TOKEN_GREATER ||
-        tokens[*tokenIdx].type == TOKEN_LESS_EQUAL || tokens[*tokenIdx].type == TOKEN_GREATER_EQUAL
-        || tokens[*tokenIdx].type == TOKEN_NOT_EQUAL || tokens[*tokenIdx].type == TOKEN_EQUAL) {
-        expr_t op_kind;
-
-        switch(tokens[*tokenIdx].type) {
-            case TOKEN_LESS:
-                op_kind = EXPR_LESS;
-                break;
-            case TOKEN_GREATER:
-                op_kind = EXPR_GREATER;
-                break;
-            case TOKEN_GREATER_EQUAL:
-                op_kind = EXPR_GREATER_EQUAL;
-                break;
-            case TOKEN_LESS_EQUAL:
-                op_kind = EXPR_LESS_EQUAL;
-                break;
-            case TOKEN_NOT_EQUAL:
-                op_kind = EXPR_NOT_EQUAL;
-                break;
-            case TOKEN_EQUAL:
-                op_kind = EXPR_EQUAL;
-                break;
-        }
-
-        (*tokenIdx)++;
-        
-        struct expr* expr_right = parse_additive(tokens, tokenIdx);
-        expr_left = expr_create(op_kind, expr_left, expr_right);
-    }
-
-    return expr_left;
+struct expr* parse_expression(Lexer* lexer) {
+    return parse_binary(lexer, PRECEDENCE_ASSIGNMENT);
 }
 
-struct stmt* parse_block(Token* tokens, int* tokenIdx) {
+struct stmt* parse_block(Lexer* lexer) {
     struct stmt* head = NULL;
     struct stmt* current = NULL;
 
-    while (tokens[*tokenIdx].type != TOKEN_RIGHT_BRACE) {
-        struct stmt* new_stmt = parse_statement(tokens, tokenIdx);
+    while (peek_token(lexer, 0)->type != TOKEN_RIGHT_BRACE) {
+        struct stmt* new_stmt = parse_statement(lexer);
         if (!new_stmt) {
             fprintf(stderr, "Error: Unable to parse new statement\n");
             return NULL;
@@ -342,42 +340,42 @@ struct stmt* parse_block(Token* tokens, int* tokenIdx) {
         }
     }
 
-    (*tokenIdx)++;
+    next_token(lexer);
     return head;
 }
 
 
-struct stmt* parse_statement(Token* tokens, int* tokenIdx) {
+struct stmt* parse_statement(Lexer* lexer) {
     struct stmt* stmt = NULL;
 
-    switch (tokens[*tokenIdx].type) {
+    switch (peek_token(lexer, 0)->type) {
         case TOKEN_CHAR:
         case TOKEN_INT: {
-            type_t kind = get_type(&tokens[*tokenIdx]);   
-            (*tokenIdx)++;
+            type_t kind = get_type(peek_token(lexer, 0));   
+            next_token(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_ID) {
+            if (peek_token(lexer, 0)->type != TOKEN_ID) {
                 fprintf(stderr, "Error: Expected identifier after type\n");
                 return NULL;
             }
 
-            char* id = strdup(tokens[*tokenIdx].value.string);
-            (*tokenIdx)++;
+            uint32_t id = peek_token(lexer, 0)->value.id;
+            next_token(lexer);
 
             struct type* var_type = type_create(kind, NULL, NULL);
             if (!var_type) return NULL;
 
             struct decl* decl = NULL;
 
-            if (tokens[*tokenIdx].type == TOKEN_ASSIGNMENT) {
+            if (peek_token(lexer, 0)->type == TOKEN_ASSIGNMENT) {
                 decl = decl_create(id, var_type, NULL, NULL, NULL);
-                (*tokenIdx)++;
-                decl->value = parse_expression(tokens, tokenIdx);
+                next_token(lexer);
+                decl->value = parse_expression(lexer);
                 stmt = stmt_create(STMT_DECL, decl, NULL, NULL, NULL, NULL, NULL, NULL);
-            } else if (tokens[*tokenIdx].type == TOKEN_LEFT_BRACKET) {
-                (*tokenIdx)++;
-                decl = parse_array(tokens, tokenIdx, id, var_type);
-                // printf("Current token type: %d\n", tokens[*tokenIdx].type);
+            } else if (peek_token(lexer, 0)->type == TOKEN_LEFT_BRACKET) {
+                next_token(lexer);
+                decl = parse_array(lexer, id, var_type);
+                // printf("Current token type: %d\n", peek_token(lexer, 0)->type);
                 stmt = stmt_create(STMT_DECL, decl, NULL, NULL, NULL, NULL, NULL, NULL);
             }
 
@@ -385,37 +383,37 @@ struct stmt* parse_statement(Token* tokens, int* tokenIdx) {
         }
 
         case TOKEN_IF: {
-            (*tokenIdx)++;
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_PARENTHESES) {
+            next_token(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_PARENTHESES) {
                 fprintf(stderr, "Error: Expected '(' after 'if' keyword\n");
                 return NULL;
             }
 
-            (*tokenIdx)++;
-            struct expr* condition = parse_expression(tokens, tokenIdx);
-            if (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
+            next_token(lexer);
+            struct expr* condition = parse_expression(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
                 fprintf(stderr, "Error: Mismatched parentheses expected ')'\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_BRACE) {
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_BRACE) {
                 fprintf(stderr, "Error: Expected '{' after if expression\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct stmt* body = parse_block(tokens, tokenIdx);
+            struct stmt* body = parse_block(lexer);
             struct stmt* else_body = NULL;
 
-            if (tokens[*tokenIdx].type == TOKEN_ELSE) {
-                (*tokenIdx)++;
-                if (tokens[*tokenIdx].type != TOKEN_LEFT_BRACE) {
+            if (peek_token(lexer, 0)->type == TOKEN_ELSE) {
+                next_token(lexer);
+                if (peek_token(lexer, 0)->type != TOKEN_LEFT_BRACE) {
                     fprintf(stderr, "Error: Expected '{'  after else keyword\n");
                     return NULL;
                 }
-                (*tokenIdx)++;
-                else_body = parse_block(tokens, tokenIdx);
+                next_token(lexer);
+                else_body = parse_block(lexer);
             }
 
             stmt = stmt_create(STMT_IF, NULL, NULL, condition, NULL, body, else_body, NULL);
@@ -423,105 +421,101 @@ struct stmt* parse_statement(Token* tokens, int* tokenIdx) {
         } 
 
         case TOKEN_FOR: {
-            (*tokenIdx)++;
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_PARENTHESES) {
+            next_token(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_PARENTHESES) {
                 fprintf(stderr, "Expected '(' after 'for' keyword\n");
                 return NULL;
             }
 
-            (*tokenIdx)++;
-            type_t type_kind = get_type(&tokens[*tokenIdx]);   
-            (*tokenIdx)++;
+            next_token(lexer);
+            type_t type_kind = get_type(peek_token(lexer, 0));   
+            next_token(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_ID) {
+            if (peek_token(lexer, 0)->type != TOKEN_ID) {
                 fprintf(stderr, "Error: Expected identifier after type\n");
                 return NULL;
             }
 
-            char* id = strdup(tokens[*tokenIdx].value.string);
-            (*tokenIdx)++;
-
-            struct type* var_type = (struct type*)malloc(sizeof(struct type));
-            var_type->kind = type_kind;
-            var_type->subtype = NULL;
-            var_type->params = NULL;
+            uint32_t id = peek_token(lexer, 0)->value.id;
+            next_token(lexer);
 
+            struct type* var_type = type_create(type_kind, NULL, NULL);
             struct decl* decl = decl_create(id, var_type, NULL, NULL, NULL);
 
-            if (tokens[*tokenIdx].type == TOKEN_ASSIGNMENT) {
-                (*tokenIdx)++;
-                decl->value = parse_expression(tokens, tokenIdx);
+            if (peek_token(lexer, 0)->type == TOKEN_ASSIGNMENT) {
+                next_token(lexer);
+                decl->value = parse_expression(lexer);
             }
 
-            if (tokens[*tokenIdx].type != TOKEN_SEMICOLON) {
+            if (peek_token(lexer, 0)->type != TOKEN_SEMICOLON) {
                 fprintf(stderr, "Error: Expected ';' after for loop initialization\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct expr* condition = parse_expression(tokens, tokenIdx);
-            if (tokens[*tokenIdx].type != TOKEN_SEMICOLON) {
+            struct expr* condition = parse_expression(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_SEMICOLON) {
                 fprintf(stderr, "Error: Expected a 2nd ';' after main expression\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct expr* next_expr = parse_expression(tokens, tokenIdx);
-            if (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
+            struct expr* next_expr = parse_expression(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
                 fprintf(stderr, "Error: Expectec ')' after for loop increment\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_BRACE) {
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_BRACE) {
                 fprintf(stderr, "Error: Expected '{' after for loop header\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct stmt* body = parse_block(tokens, tokenIdx);
+            struct stmt* body = parse_block(lexer);
             stmt = stmt_create(STMT_FOR, decl, NULL, condition, next_expr, body, NULL, NULL);
             break;
         }
 
         case TOKEN_WHILE: {
-            (*tokenIdx)++;
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_PARENTHESES) {
+            next_token(lexer);
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_PARENTHESES) {
                 fprintf(stderr, "Error: Expected '(' after 'while' keyword\n");
                 return NULL;
             } 
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct expr* condition = parse_expression(tokens, tokenIdx);
+            struct expr* condition = parse_expression(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
+            if (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
                 fprintf(stderr, "Error: Mismatched parentheses expected ')'\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            if (tokens[*tokenIdx].type != TOKEN_LEFT_BRACE) {
+            if (peek_token(lexer, 0)->type != TOKEN_LEFT_BRACE) {
                 fprintf(stderr, "Error: Expected '{' after 'while loop' initialization\n");
                 return NULL;
             }
-            (*tokenIdx)++;
+            next_token(lexer);
 
-            struct stmt* body = parse_block(tokens, tokenIdx);
+            struct stmt* body = parse_block(lexer);
             stmt = stmt_create(STMT_WHILE, NULL, NULL, condition, NULL, body, NULL, NULL);
             break;
         }
         case TOKEN_ID: {
-            struct expr* expr = parse_expression(tokens, tokenIdx);
+            struct expr* expr = parse_expression(lexer);
 
             stmt = stmt_create(STMT_EXPR, NULL, NULL, expr, NULL, NULL, NULL, NULL);
             break;
         }
         case TOKEN_RETURN: {
-            (*tokenIdx)++;
+            next_token(lexer);
             struct expr* return_expr = NULL;
 
-            if (tokens[*tokenIdx].type != TOKEN_SEMICOLON) {
-                return_expr = parse_expression(tokens, tokenIdx);
+            if (peek_token(lexer, 0)->type != TOKEN_SEMICOLON) {
+                return_expr = parse_expression(lexer);
             }
             
             stmt = stmt_create(STMT_RETURN, NULL, NULL, return_expr, NULL, NULL, NULL, NULL);
@@ -535,51 +529,52 @@ struct stmt* parse_statement(Token* tokens, int* tokenIdx) {
     }
 
     if (stmt->kind != STMT_IF && stmt->kind !=  STMT_FOR && stmt->kind != STMT_WHILE) {
-        printf("Token type: %d\n", tokens[*tokenIdx].type);
-        if (tokens[*tokenIdx].type != TOKEN_SEMICOLON) {
+        if (peek_token(lexer, 0)->type != TOKEN_SEMICOLON) {
             fprintf(stderr, "Error: Expected semicolon\n");
             return NULL;
         }
-        (*tokenIdx)++;
+        next_token(lexer);
     }
 
     return stmt;
 }
 
-struct param_list* parse_parameters(Token* tokens, int* tokenIdx) {
+struct param_list* parse_parameters(Lexer* lexer) {
     struct param_list* head = NULL;
     struct param_list* current = NULL;
 
-    while (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
-        if (tokens[*tokenIdx].type != TOKEN_INT) {
+    while (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
+        if (peek_token(lexer, 0)->type != TOKEN_INT) {
             fprintf(stderr, "Error: Expected type keyword in parameter.\n");
             return NULL;
         }
 
-        type_t param_list_type = get_type(&tokens[*tokenIdx]);
-        (*tokenIdx)++;
+        type_t param_list_type = get_type(peek_token(lexer, 0));
+        next_token(lexer);
 
-        if (tokens[*tokenIdx].type != TOKEN_ID) {
+        if (peek_token(lexer, 0)->type != TOKEN_ID) {
             fprintf(stderr, "Error: Expected identifier in paramter.\n");
             exit(EXIT_FAILURE);
         } 
 
-        struct param_list* node = (struct param_list*)malloc(sizeof(struct param_list));
-        
-        node->name = strdup(tokens[*tokenIdx].value.string);
-        node->type = (struct type*)malloc(sizeof(struct type));
+        struct param_list* node = node_alloc(sizeof(struct param_list), ARENA_PARAM);
+        if (node == NULL) {
+            perror("Error allocating parameter");
+            return NULL;
+        }
+
+        node->name_id = peek_token(lexer, 0)->value.id;
+        node->name = intern_name(node->name_id);
+        node->type = type_create(param_list_type, NULL, NULL);
         if (node->type == NULL) {
             perror("Error allocating type for parameter");
-            free(node);
             return NULL;
         }
 
-        node->type->kind = param_list_type;
-        node->type->subtype = NULL;
-        node->type->params = NULL;
         node->next = NULL;
+        node->symbol = NULL;
 
-        (*tokenIdx)++;
+        next_token(lexer);
 
         if (head == NULL) {
             head = node;
@@ -589,28 +584,65 @@ struct param_list* parse_parameters(Token* tokens, int* tokenIdx) {
             current = current->next; 
         }
 
-        if (tokens[*tokenIdx].type == TOKEN_COMMA) {
-            (*tokenIdx)++;
-        } else if (tokens[*tokenIdx].type != TOKEN_RIGHT_PARENTHESES) {
+        if (peek_token(lexer, 0)->type == TOKEN_COMMA) {
+            next_token(lexer);
+        } else if (peek_token(lexer, 0)->type != TOKEN_RIGHT_PARENTHESES) {
             fprintf(stderr, "Error: Expected ',' or ')' in parameter list.\n");
             return NULL;
         }
 
     }
 
-    (*tokenIdx)++;
+    next_token(lexer);
 
     return head;
 }
 
-struct decl* parse_function(Token* tokens, int* tokenIdx, char* name, struct type* return_type) {   
+static bool lazy_function_bodies = false;
+
+void set_lazy_function_bodies(bool enabled) {
+    lazy_function_bodies = enabled;
+}
+
+// Consumes tokens up to and including the '}' matching the one just read.
+// Identifiers are not interned here: parsing the body later scans them again.
+static struct lazy_body* skip_function_body(Lexer* lexer) {
+    bool intern_identifiers = lexer->intern_identifiers;
+    lexer->intern_identifiers = false;
+
+    int offset = peek_token(lexer, 0)->offset;
+    int line = peek_token(lexer, 0)->line;
+    int depth = 1;
+    while (depth > 0 && peek_token(lexer, 0)->type != TOKEN_EOF) {
+        Token token = next_token(lexer);
+        if (token.type == TOKEN_LEFT_BRACE) depth++;
+        if (token.type == TOKEN_RIGHT_BRACE && --depth == 0) {
+            lexer->intern_identifiers = intern_identifiers;
+
+            struct lazy_body* lazy = node_alloc(sizeof(struct lazy_body), ARENA_BODY);
+            if (!lazy) return NULL;
+            lazy->source = lexer->source;
+            lazy->offset = offset;
+            lazy->length = token.offset + token.length - offset;
+            lazy->line = line;
+            lazy->arena = get_node_arena();
+            return lazy;
+        }
+    }
+
+    lexer->intern_identifiers = intern_identifiers;
+    return NULL;
+}
+
+struct decl* parse_function(Lexer* lexer, uint32_t name_id, struct type* return_type) {   
+    const char* name = intern_name(name_id);
 
     if (!return_type) {
         fprintf(stderr, "Error: Function '%s' has no return type\n", name);
         return NULL;
     }
 
-    struct param_list* params = parse_parameters(tokens, tokenIdx);
+    struct param_list* params = parse_parameters(lexer);
     struct type* func_type = type_create(TYPE_FUNCTION, return_type, params);
 
     if (!func_type) {
@@ -618,27 +650,70 @@ struct decl* parse_function(Token* tokens, int* tokenIdx, char* name, struct typ
         return NULL;
     }
 
-    if (tokens[*tokenIdx].type != TOKEN_LEFT_BRACE) {
+    if (peek_token(lexer, 0)->type != TOKEN_LEFT_BRACE) {
         fprintf(stderr, "Expected '{' after initializing parameters\n");
         return NULL;
     }
-    (*tokenIdx)++;
+    next_token(lexer);
+
+    if (lazy_function_bodies) {
+        struct lazy_body* lazy = skip_function_body(lexer);
+        if (!lazy) {
+            fprintf(stderr, "Error: Unterminated body for function '%s'\n", name);
+            return NULL;
+        }
+
+        struct decl* d = decl_create(name_id, func_type, NULL, NULL, NULL);
+        if (d) d->lazy = lazy;
+        return d;
+    }
 
-    struct stmt* body = parse_block(tokens, tokenIdx);
+    struct stmt* body = parse_block(lexer);
     if (!body) {
         fprintf(stderr, "Error: Failed to parse function body\n");
         return NULL;
     }
 
-    return decl_create(name, func_type, NULL, body, NULL);
+    return decl_create(name_id, func_type, NULL, body, NULL);
 } 
 
-struct expr* parse_array_init_list(Token* tokens, int* tokenIdx) {
+struct stmt* decl_code(struct decl* d) {
+    if (!d->lazy) return d->code;
+
+    struct lazy_body* lazy = d->lazy;
+    d->lazy = NULL;
+
+    Lexer* lexer = init_lexer_range(lazy->source, lazy->offset + lazy->length);
+    if (!lexer) {
+        fprintf(stderr, "Error: Failed to allocate lexer for function '%s'\n", d->name);
+        return NULL;
+    }
+
+    // Resume in the original buffer so offsets, lines and columns match an
+    // eager parse.
+    char* body = lazy->source + lazy->offset;
+    char* line_start = body;
+    while (line_start > lazy->source && line_start[-1] != '\n') line_start--;
+    lexer->start = body;
+    lexer->end = body;
+    lexer->line = lazy->line;
+    lexer->line_start = line_start;
+
+    Arena* previous = set_node_arena(lazy->arena);
+    d->code = parse_block(lexer);
+    set_node_arena(previous);
+    free_lexer(lexer);
+
+    if (!d->code) fprintf(stderr, "Error: Failed to parse function body\n");
+    return d->code;
+}
+
+struct expr* parse_array_init_list(Lexer* lexer) {
     struct expr* head = NULL;
     struct expr* current = NULL;
 
-    while (tokens[*tokenIdx].type != TOKEN_RIGHT_BRACE) {
-        struct expr* init_expr = parse_expression(tokens, tokenIdx);
+    while (peek_token(lexer, 0)->type != TOKEN_RIGHT_BRACE) {
+        struct expr* init_expr = parse_expression(lexer);
         if (!init_expr) return NULL;
 
         if (!head) {
@@ -649,15 +724,15 @@ struct expr* parse_array_init_list(Token* tokens, int* tokenIdx) {
             current = init_expr;
         }
 
-        if (tokens[*tokenIdx].type == TOKEN_COMMA) (*tokenIdx)++;
+        if (peek_token(lexer, 0)->type == TOKEN_COMMA) next_token(lexer);
     }
 
-    (*tokenIdx)++;
+    next_token(lexer);
 
     return head;
 }
 
-struct decl* parse_array(Token* tokens, int* tokenIdx, char* name, struct type* element_type) {
+struct decl* parse_array(Lexer* lexer, uint32_t name_id, struct type* element_type) {
     if (!element_type) {
         fprintf(stderr, "Error: Element type for array is not known\n");
         return NULL;
@@ -669,10 +744,9 @@ struct decl* parse_array(Token* tokens, int* tokenIdx, char* name, struct type*
         return NULL;
     }
 
-    struct expr* size_expr = parse_expression(tokens, tokenIdx);
+    struct expr* size_expr = parse_expression(lexer);
     if (!size_expr) {
         fprintf(stderr, "Error: Unable to parse expression for array\n");
-        type_delete(array_type);
         return NULL;
     }
     size_expr->kind = EXPR_ARRAY_VAL;
@@ -680,20 +754,20 @@ struct decl* parse_array(Token* tokens, int* tokenIdx, char* name, struct type*
     struct expr* array_expr = expr_create(EXPR_ARRAY, size_expr, NULL);
     if (!array_expr) {
         fprintf(stderr, "Error: Unable to create array expression\n");
-        type_delete(array_type);
         return NULL;
     }
 
-    array_expr->name = strdup(name);
-
-    (*tokenIdx)++;
-    if (tokens[*tokenIdx].type == TOKEN_SEMICOLON) {
-        return decl_create(name, array_type, array_expr, NULL, NULL);
-    } else if (tokens[*tokenIdx].type == TOKEN_ASSIGNMENT) {
-        (*tokenIdx)++;
-        if (tokens[*tokenIdx].type == TOKEN_LEFT_BRACE) {
-            (*tokenIdx)++;
-            array_expr->right = parse_array_init_list(tokens, tokenIdx);
+    array_expr->name_id = name_id;
+    array_expr->name = intern_name(name_id);
+
+    next_token(lexer);
+    if (peek_token(lexer, 0)->type == TOKEN_SEMICOLON) {
+        return decl_create(name_id, array_type, array_expr, NULL, NULL);
+    } else if (peek_token(lexer, 0)->type == TOKEN_ASSIGNMENT) {
+        next_token(lexer);
+        if (peek_token(lexer, 0)->type == TOKEN_LEFT_BRACE) {
+            next_token(lexer);
+            array_expr->right = parse_array_init_list(lexer);
             
             struct expr* current = array_expr->right;
             while (current) {
@@ -703,167 +777,108 @@ struct decl* parse_array(Token* tokens, int* tokenIdx, char* name, struct type*
             }
         }
 
-        struct decl* d = decl_create(name, array_type, array_expr, NULL, NULL);
+        struct decl* d = decl_create(name_id, array_type, array_expr, NULL, NULL);
         printf("Successfully created array decl with type: %d EXPR KIND: %d and EXPR KIND VAL: %d\n " ,d->type->kind, d->value->kind, d->value->right->kind);
 
         return d;
     }
 
-    type_delete(array_type);
-
     return NULL;
 }
 
-struct decl* parse_declaration(Token* tokens, int* tokenIdx) {
-    type_t kind = get_type(&tokens[*tokenIdx]);
+struct decl* parse_declaration(Lexer* lexer) {
+    type_t kind = get_type(peek_token(lexer, 0));
     struct type* type = type_create(kind, NULL, NULL);
     if (!type) {
         perror("Error allocating type in 'parse_declaration()'\n");
         return NULL;
     }
 
-    (*tokenIdx)++;
+    next_token(lexer);
 
-    if (tokens[*tokenIdx].type != TOKEN_ID) {
+    if (peek_token(lexer, 0)->type != TOKEN_ID) {
         fprintf(stderr, "Error: Expected Identifier\n");
-        type_delete(type);
         return NULL;
     }
 
-    char* name = strdup(tokens[*tokenIdx].value.string);
-    (*tokenIdx)++;
+    uint32_t name_id = peek_token(lexer, 0)->value.id;
+    next_token(lexer);
 
     struct expr* value = NULL;
-    if (tokens[*tokenIdx].type == TOKEN_LEFT_PARENTHESES) {
-        (*tokenIdx)++;
-        return parse_function(tokens, tokenIdx, name, type);
-    } else if (tokens[*tokenIdx].type == TOKEN_LEFT_BRACKET) {
-        (*tokenIdx)++;
-        return parse_array(tokens, tokenIdx, name, type);
+    if (peek_token(lexer, 0)->type == TOKEN_LEFT_PARENTHESES) {
+        next_token(lexer);
+        return parse_function(lexer, name_id, type);
+    } else if (peek_token(lexer, 0)->type == TOKEN_LEFT_BRACKET) {
+        next_token(lexer);
+        return parse_array(lexer, name_id, type);
     } else {
-        if (tokens[*tokenIdx].type == TOKEN_ASSIGNMENT) {
-            (*tokenIdx)++;
-            value = parse_expression(tokens, tokenIdx);
+        if (peek_token(lexer, 0)->type == TOKEN_ASSIGNMENT) {
+            next_token(lexer);
+            value = parse_expression(lexer);
         }
 
-        return decl_create(name, type, value, NULL, NULL);
+        return decl_create(name_id, type, value, NULL, NULL);
     }
    
     return NULL;
 }
 
-struct program* build_ast(Token* tokens) {
-    struct program* program = (struct program*)malloc(sizeof(struct program));
-    if (program == NULL) {
-        perror("Error allocating space for program");
-        exit(EXIT_FAILURE);
-    }
-
-    int tokenIdx = 0;
-    struct decl* head = NULL;
+bool parse_declarations(Lexer* lexer, struct decl** head) {
     struct decl* current = NULL;
+    *head = NULL;
 
-    while (tokens[tokenIdx].type != TOKEN_EOF) {
-        if (tokens[tokenIdx].type == TOKEN_SEMICOLON) {
-            tokenIdx++;
+    while (peek_token(lexer, 0)->type != TOKEN_EOF) {
+        if (peek_token(lexer, 0)->type == TOKEN_SEMICOLON) {
+            next_token(lexer);
             continue;
         }
 
-        struct decl* new_decl = parse_declaration(tokens, &tokenIdx);
-        if (!new_decl) {
-            fprintf(stderr, "Fatal: Failed to parse declaration\n");
-            free(program);
-            exit(EXIT_FAILURE);
-        }
+        struct decl* new_decl = parse_declaration(lexer);
+        if (!new_decl) return false;
 
-        if (!head) {
-            head = new_decl;
-            current = new_decl;
+        if (!*head) {
+            *head = new_decl;
         } else {
             current->next = new_decl;
-            current = new_decl;
         }
+        current = new_decl;
     }
 
-    program->declaration = head;
-    printf("Program built successfully\n");
-
-    return program;
+    return true;
 }
 
-void free_node(struct decl* declaration) {
-    if (!declaration) return;
-
-    free(declaration->name);
-
-    if (declaration->type) {
-        free(declaration->type->subtype);
-
-        while (declaration->type->params) {
-            struct param_list* param_next = declaration->type->params->next;
-            free(declaration->type->params->name);
-            free(declaration->type->params->type);
-            free(declaration->type->params);
-            declaration->type->params = param_next;
-        }
-
-        free(declaration->type);   
-    }   
-
-    if (declaration->value) {
-        while (declaration->value->left) {
-            struct expr* expr_next = declaration->value->left->left;
+// Every node of the tree, and every symbol and type the later phases hang
+// off it, comes from the program's arena; free_ast() releases them at once.
+struct program* build_ast(Lexer* lexer) {
+    Arena* arena = arena_create("ast");
+    if (arena == NULL) exit(EXIT_FAILURE);
+    Arena* previous = set_node_arena(arena);
 
-            free(declaration->value->left->name);
-            free(declaration->value->left->string_literal);
-            
-            free(declaration->value->left);
-
-            declaration->value->left = expr_next;
-        }
-
-        while (declaration->value->right) {
-            struct expr* expr_next = declaration->value->right->right;
-            
-            free(declaration->value->right->name);
-            free(declaration->value->right->string_literal);
-
-            free(declaration->value->right);
-
-            declaration->value->right = expr_next;
-        }
-
-        free(declaration->value->name);
-        free(declaration->value->string_literal);
-        free(declaration->value);
+    struct program* program = node_alloc(sizeof(struct program), ARENA_PROGRAM);
+    if (program == NULL) {
+        perror("Error allocating space for program");
+        exit(EXIT_FAILURE);
     }
+    program->arena = arena;
 
-    while (declaration->code) {
-        struct stmt* stmt_next = declaration->code->next;
-
-        free(declaration->code->decl);
-        free(declaration->code->init_expr);
-        free(declaration->code->expr);
-        free(declaration->code->next_expr);
-        free(declaration->code->body);
-        free(declaration->code->else_body);
-        free(declaration->code);
-        declaration->code = stmt_next;
+    struct decl* head = NULL;
+    if (!parse_declarations(lexer, &head)) {
+        fprintf(stderr, "Fatal: Failed to parse declaration\n");
+        arena_free(arena);
+        exit(EXIT_FAILURE);
     }
 
-    free(declaration);
+    set_node_arena(previous);
+    program->declaration = head;
+    printf("Program built successfully\n");
+
+    return program;
 }
 
 void free_ast(struct program* root) {
     if (!root) return;
 
-    while (root->declaration) {
-        struct decl* next = root->declaration->next;
-        free_node(root->declaration);
-        root->declaration = next;
-    }
-
-    free(root);
+    arena_free(root->arena);
 }
 
 void print_type(struct type* type, int indent) {
@@ -1121,7 +1136,7 @@ void print_decl(struct decl* decl, int indent) {
         print_expr(decl->value, indent + 1);
     }
     
-    if (decl->code) {
+    if (decl_code(decl)) {
         for (int i = 0; i < indent; i++) printf("  ");
         printf("CODE:\n");
         print_stmt(decl->code, indent + 1);
@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include "ast.h"
+
+// A top-level declaration ends at a ';' or at a '}' that brings the brace
+// depth back to zero, so one pass over the token kinds finds places where
+// the parse can be cut. Each run of whole declarations is then parsed on its
+// own from the shared token array, and the runs' lists are joined in order.
+// The parser only reads the interner, which lexing has already filled.
+
+typedef struct {
+    char* source;
+    const Token* tokens;
+    int count;
+    Arena* arena;
+    struct decl* head;
+    bool parsed;
+} ParseRun;
+
+static void* parse_run(void* arg) {
+    ParseRun* run = arg;
+    Lexer* lexer = init_lexer_tokens(run->source, run->tokens, run->count);
+    if (!lexer) return NULL;
+
+    Arena* previous = set_node_arena(run->arena);
+    run->parsed = parse_declarations(lexer, &run->head);
+    set_node_arena(previous);
+    free_lexer(lexer);
+    return NULL;
+}
+
+// tokens[count] is the TOKEN_EOF. A '}' followed by ';' (an array
+// initializer) ends its declaration at the ';'.
+static int split_runs(char* source, const Token* tokens, int count, ParseRun* runs, int max_runs) {
+    int target = count / max_runs;
+    int start = 0;
+    int depth = 0;
+    int made = 0;
+
+    for (int i = 0; i < count && made < max_runs - 1; i++) {
+        TokenType type = tokens[i].type;
+        if (type == TOKEN_LEFT_BRACE) depth++;
+        if (type == TOKEN_RIGHT_BRACE) depth--;
+
+        bool boundary = depth == 0 && (type == TOKEN_SEMICOLON ||
+            (type == TOKEN_RIGHT_BRACE && tokens[i + 1].type != TOKEN_SEMICOLON));
+        if (boundary && i + 1 - start >= target) {
+            runs[made++] = (ParseRun){ .source = source, .tokens = tokens + start, .count = i + 1 - start };
+            start = i + 1;
+        }
+    }
+
+    runs[made++] = (ParseRun){ .source = source, .tokens = tokens + start, .count = count - start };
+    return made;
+}
+
+struct program* build_ast_parallel(char* source, size_t length, int threads) {
+    // Parsing straight off the scanner saves building the token array.
+    if (threads <= 1) {
+        Lexer* lexer = init_lexer_range(source, length);
+        if (!lexer) return NULL;
+        struct program* program = build_ast(lexer);
+        free_lexer(lexer);
+        return program;
+    }
+
+    Token* tokens = lexical_analysis_parallel(source, length, threads);
+    if (!tokens) return NULL;
+
+    int count = 0;
+    while (tokens[count].type != TOKEN_EOF) count++;
+
+    int max_runs = threads;
+    if (max_runs > count / PARALLEL_PARSE_MIN_TOKENS) max_runs = count / PARALLEL_PARSE_MIN_TOKENS;
+    if (max_runs < 1) max_runs = 1;
+
+    Arena* arena = arena_create("ast");
+    ParseRun* runs = malloc(sizeof(ParseRun) * max_runs);
+    pthread_t* workers = malloc(sizeof(pthread_t) * max_runs);
+    struct program* program = arena ? arena_alloc(arena, sizeof(struct program), ARENA_PROGRAM) : NULL;
+    if (!program || !runs || !workers) {
+        perror("Error allocating space for program");
+        exit(EXIT_FAILURE);
+    }
+    program->arena = arena;
+
+    int run_count = split_runs(source, tokens, count, runs, max_runs);
+    for (int i = 0; i < run_count; i++) {
+        runs[i].arena = arena_create_child(arena, "ast run");
+        if (!runs[i].arena) exit(EXIT_FAILURE);
+    }
+
+    // The calling thread takes the first run itself.
+    int started = 1;
+    for (; started < run_count; started++) {
+        if (pthread_create(&workers[started], NULL, parse_run, &runs[started]) != 0) break;
+    }
+    for (int i = started; i < run_count; i++) {
+        parse_run(&runs[i]);
+    }
+    parse_run(&runs[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    struct decl** link = &program->declaration;
+    *link = NULL;
+    for (int i = 0; i < run_count; i++) {
+        if (!runs[i].parsed) {
+            fprintf(stderr, "Fatal: Failed to parse declaration\n");
+            arena_free(arena);
+            exit(EXIT_FAILURE);
+        }
+
+        *link = runs[i].head;
+        while (*link) link = &(*link)->next;
+    }
+
+    free(runs);
+    free(workers);
+    free_tokens(tokens);
+    printf("Program built successfully\n");
+
+    return program;
+}
@@ -1,17 +1,30 @@
+#include <sys/stat.h>
 #include "preprocessor.h"
 
+static IncludeCacheEntry* include_cache[INCLUDE_CACHE_SIZE];
+static IncludeCacheStats include_cache_stats = {0};
+static unsigned translation_unit_count = 0;
+
+static bool preprocess_source(Preprocessor* preprocessor);
+
 void init_macrolist(Preprocessor* preprocessor) {
-	preprocessor->macros = malloc(sizeof(Macro) * MACRO_COUNT);
+	preprocessor->macros = malloc(sizeof(MacroList));
 	if (!preprocessor->macros) return;
 
 	preprocessor->macros->macro = malloc(sizeof(Macro) * MACRO_COUNT);
-	if (!preprocessor->macros->macro) {
+	preprocessor->macros->slots = calloc(MACRO_TABLE_SIZE, sizeof(uint32_t));
+	if (!preprocessor->macros->macro || !preprocessor->macros->slots) {
+		free(preprocessor->macros->macro);
+		free(preprocessor->macros->slots);
 		free(preprocessor->macros);
+		preprocessor->macros = NULL;
 		return;
 	}
 
 	preprocessor->macros->macro_count = 0;
 	preprocessor->macros->macro_capacity = MACRO_COUNT;
+	preprocessor->macros->slot_capacity = MACRO_TABLE_SIZE;
+	preprocessor->macros->generation = 0;
 }
 
 void init_includelist(Preprocessor* preprocessor) {
@@ -23,22 +36,43 @@ void init_includelist(Preprocessor* preprocessor) {
 	preprocessor->includes->tail = NULL;
 }
 
-Preprocessor* init_preprocessor(char* source) {
+Preprocessor* init_preprocessor(char* source, size_t length) {
 	Preprocessor* preprocessor = malloc(sizeof(Preprocessor));
 	if (!preprocessor) {
 		fprintf(stderr, "Error: Failed to allocate space for preprocessor\n");
 		return NULL;
 	}
-	
+
+	preprocessor->file_path = NULL;
+	preprocessor->include_depth = 0;
+	preprocessor->translation_unit = ++translation_unit_count;
+	preprocessor->current_include = NULL;
+	preprocessor->recording = NULL;
+	preprocessor->error_count = 0;
+	preprocessor->touched = NULL;
+	preprocessor->touched_capacity = 0;
+	preprocessor->touch_stamp = 0;
 	preprocessor->line = 1;
 	preprocessor->column = 1;
 	preprocessor->output = NULL;
+	preprocessor->output_length = 0;
+	preprocessor->output_capacity = 0;
+	preprocessor->segments = NULL;
+	preprocessor->segment_count = 0;
+	preprocessor->segment_capacity = 0;
+	preprocessor->current_pos = 0;
+	preprocessor->conditionals = NULL;
+	preprocessor->conditional_count = 0;
+	preprocessor->conditional_capacity = 0;
+	preprocessor->conditional_base = 0;
+	preprocessor->source = source;
+	preprocessor->limit = source + length;
 	preprocessor->start = source;
 	preprocessor->end = source;
-<<<<<<< HEAD
-	preprocessor->output = strdup(source);
-=======
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
+
+	preprocessor->scan_source = preprocess_source;
+	preprocessor->scan_context = NULL;
+	memset(&preprocessor->expander, 0, sizeof(MacroExpander));
 
 	init_macrolist(preprocessor);
 	init_includelist(preprocessor);
@@ -47,45 +81,38 @@ Preprocessor* init_preprocessor(char* source) {
 }
 
 bool is_at_end(Preprocessor* preprocessor) {
-    return *preprocessor->end == '\0';
+    return preprocessor->end >= preprocessor->limit || *preprocessor->end == '\0';
 }
 
-char advance(Preprocessor* preprocessor) {
+static char advance(Preprocessor* preprocessor) {
     if (is_at_end(preprocessor)) return '\0';
 	preprocessor->column++;
     preprocessor->current_pos++;
 	return *preprocessor->end++;
 }
 
-char peek(Preprocessor* preprocessor) {
+static char peek(Preprocessor* preprocessor) {
     if (is_at_end(preprocessor)) return '\0';
 	return *preprocessor->end;
 }
 
-char peek_next(Preprocessor* preprocessor) {
-	if (is_at_end(preprocessor) || *(preprocessor->end + 1) == '\0') return '\0';
-	return *(preprocessor->end + 1);
-}
-
-<<<<<<< HEAD
-bool match(Preprocessor* preprocessor, char expected) {
-	if (peek(preprocessor) != expected) return false;
-	advance(preprocessor);
-	return true;
+// Directives end at the newline, so only blanks are skipped inside them.
+static void skip_blanks(Preprocessor* preprocessor) {
+	while (peek(preprocessor) == ' ' || peek(preprocessor) == '\t') {
+		advance(preprocessor);
+	}
 }
 
-void add_include(IncludeList* list, char* file_path, int start_pos) {
-=======
 void add_include_node(IncludeList* list, char* file_path, size_t start_pos, size_t end_pos) {
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
 	struct IncludeNode* node = malloc(sizeof(struct IncludeNode));
 	if (!node) return;
 
 	node->start_pos = start_pos;
-<<<<<<< HEAD
-=======
 	node->end_pos = end_pos;
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
+	node->content_length = 0;
+	node->name = NULL;
+	node->angled = false;
+	node->including_path = NULL;
 	node->next = NULL;
 	node->file_path = strdup(file_path);
 	if (!node->file_path) {
@@ -107,77 +134,259 @@ void add_include_node(IncludeList* list, char* file_path, size_t start_pos, size
 
 }
 
+bool set_include_lookup(struct IncludeNode* node, const char* name, size_t length, bool angled, const char* including_path) {
+	char* name_copy = strndup(name, length);
+	char* including_copy = strdup(including_path ? including_path : "");
+	if (!name_copy || !including_copy) {
+		free(name_copy);
+		free(including_copy);
+		return false;
+	}
+
+	free(node->name);
+	free(node->including_path);
+	node->name = name_copy;
+	node->angled = angled;
+	node->including_path = including_copy;
+	return true;
+}
+
+bool include_lookup_unchanged(const char* name, bool angled, const char* including_path, const char* path) {
+	char* found = resolve_include_path(including_path, name, strlen(name), angled);
+	bool unchanged = found && strcmp(found, path) == 0;
+	free(found);
+	return unchanged;
+}
+
+void free_include_node(struct IncludeNode* node) {
+	free(node->file_path);
+	free(node->name);
+	free(node->including_path);
+	free(node);
+}
+
 bool is_at_character(Preprocessor* preprocessor, char c) {
-    return *preprocessor->end == c;
+    return !is_at_end(preprocessor) && *preprocessor->end == c;
 }
 
+static void expand_include(Preprocessor* preprocessor, struct IncludeNode* node);
+
 void parse_include(Preprocessor* preprocessor, int start_pos) {
-	while (*preprocessor->end != '\n') {
-		char c = peek(preprocessor);
+	skip_blanks(preprocessor);
 
-		skip_whitespace(preprocessor);
+	char close;
+	switch (peek(preprocessor)) {
+		case '<':
+			close = '>';
+			break;
 
-		preprocessor->start = preprocessor->end;
+		case '"':
+			close = '"';
+			break;
 
-		switch (c) {
-			case '<':
-				while (!is_at_character(preprocessor, '<')) {
-					advance(preprocessor);
-				}
-				break;
+		default:
+			return;
+	}
+	advance(preprocessor);
 
-			case '"':
-				while (!is_at_character(preprocessor, '"')) {
-					advance(preprocessor);
-				}
-				break;
+	preprocessor->start = preprocessor->end;
+	while (!is_at_end(preprocessor) && !is_at_character(preprocessor, close) && !is_at_character(preprocessor, '\n')) {
+		advance(preprocessor);
+	}
 
-			default:
-				return;
-		}
+	if (!is_at_character(preprocessor, close)) {
+		fprintf(stderr, "Error: Unterminated file name in #include on line %d\n", preprocessor->line);
+		preprocessor->error_count++;
+		return;
+	}
 
+	const char* name = preprocessor->start;
+	int length = preprocessor->end - preprocessor->start;
+	char* file_path = resolve_include_path(preprocessor->file_path, name, length, close == '>');
+	advance(preprocessor);
+	if (!file_path) return;
+
+	// the lookup goes with the include so a cached result can repeat it
+	IncludeList* list = preprocessor->includes;
+	size_t include_count = list->include_count;
+	add_include_node(list, file_path, start_pos, preprocessor->current_pos);
+	free(file_path);
+	if (list->include_count == include_count) return;
+
+	struct IncludeNode* node = list->tail;
+	if (!set_include_lookup(node, name, length, close == '>', preprocessor->file_path)) {
+		fprintf(stderr, "Error: Failed to record #include on line %d\n", preprocessor->line);
+		preprocessor->error_count++;
+		list->tail = node->prev;
+		if (node->prev) node->prev->next = NULL;
+		else list->head = NULL;
+		list->include_count--;
+		free_include_node(node);
+		return;
 	}
-<<<<<<< HEAD
-	
-	int length = preprocessor->end - preprocessor->start - 1;
-	char* file_path = strndup(preprocessor->start + 1, length);
-	add_include(preprocessor->includes, file_path, start_pos);
-=======
+	expand_include(preprocessor, node);
+}
 
-	size_t end_pos = preprocessor->end - 1;
-	int length = preprocessor->end - preprocessor->start - 2;
-	char* file_path = strndup(preprocessor->start + 1, length);
+void include_file(Preprocessor* preprocessor, char* file_path, size_t start_pos, size_t end_pos) {
+	size_t include_count = preprocessor->includes->include_count;
 	add_include_node(preprocessor->includes, file_path, start_pos, end_pos);
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
-	free((void*)file_path);
 
+	if (preprocessor->includes->include_count > include_count) {
+		expand_include(preprocessor, preprocessor->includes->tail);
+	}
+}
+
+// Interned ids are dense, so a multiplicative hash spreads them well.
+static size_t macro_slot(MacroList* macros, uint32_t name_id) {
+	return (name_id * 2654435761u) & (macros->slot_capacity - 1);
+}
+
+Macro* find_macro(MacroList* macros, uint32_t name_id) {
+	if (name_id == INTERN_NONE) return NULL;
+
+	size_t mask = macros->slot_capacity - 1;
+	for (size_t idx = macro_slot(macros, name_id); macros->slots[idx]; idx = (idx + 1) & mask) {
+		Macro* macro = &macros->macro[macros->slots[idx] - 1];
+		if (macro->name_id == name_id) return macro;
+	}
+	return NULL;
 }
 
 bool macro_exists(MacroList* macros, char* name) {
+	return find_macro(macros, intern_find(name, strlen(name))) != NULL;
+}
+
+static bool grow_macro_slots(MacroList* macros) {
+	size_t new_capacity = macros->slot_capacity * 2;
+	uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+	if (!slots) return false;
+
+	free(macros->slots);
+	macros->slots = slots;
+	macros->slot_capacity = new_capacity;
+
+	size_t mask = new_capacity - 1;
 	for (size_t i = 0; i < macros->macro_count; i++) {
-		if (strcmp(macros->macro[i].name, name) == 0) {
-			return true;
-		}
+		size_t idx = macro_slot(macros, macros->macro[i].name_id);
+		while (slots[idx]) idx = (idx + 1) & mask;
+		slots[idx] = i + 1;
 	}
-	return false;
+	return true;
 }
 
-void add_macro(MacroList* macros, char* name, int value) {
-	Macro macro_node = {
-		.name = strdup(name),
-		.u.value = value,
-	};
+// Returns false when the macro was not added, e.g. because the name is taken.
+bool insert_macro(MacroList* macros, Macro macro_node) {
+	if (macro_node.name_id == INTERN_NONE || find_macro(macros, macro_node.name_id)) return false;
 
 	if (macros->macro_count >= macros->macro_capacity) {
 		size_t new_capacity = macros->macro_capacity * 2;
 		Macro* new_macros = realloc(macros->macro, new_capacity * sizeof(Macro));
-		if (!macros) return;
+		if (!new_macros) return false;
 
 		macros->macro = new_macros;
 		macros->macro_capacity = new_capacity;
 	}
 
-	macros->macro[macros->macro_count++] = macro_node;
+	// keep the table at most half full
+	if ((macros->macro_count + 1) * 2 > macros->slot_capacity && !grow_macro_slots(macros)) return false;
+
+	macro_node.name = intern_name(macro_node.name_id);
+	macros->macro[macros->macro_count] = macro_node;
+	macros->generation++;
+
+	size_t mask = macros->slot_capacity - 1;
+	size_t idx = macro_slot(macros, macro_node.name_id);
+	while (macros->slots[idx]) idx = (idx + 1) & mask;
+	macros->slots[idx] = ++macros->macro_count;
+	return true;
+}
+
+static void define_macro(MacroList* macros, uint32_t name_id, bool has_value, int value) {
+	Macro macro_node = {
+		.name_id = name_id,
+		.has_value = has_value,
+		.u.value = value,
+	};
+	insert_macro(macros, macro_node);
+}
+
+void add_macro(MacroList* macros, char* name, int value) {
+	define_macro(macros, intern_cstr(name), true, value);
+}
+
+// Records the state of a macro the first time the file being recorded
+// looks at it or defines it.
+static void note_macro(Preprocessor* preprocessor, uint32_t name_id, Macro* macro) {
+	// function-like expansions are not recorded, so the file is rescanned every time
+	if (macro && macro->function_like) {
+		preprocessor->recording->replayable = false;
+		preprocessor->recording = NULL;
+		return;
+	}
+
+	if (name_id >= preprocessor->touched_capacity) {
+		size_t new_capacity = preprocessor->touched_capacity ? preprocessor->touched_capacity : 1024;
+		while (new_capacity <= name_id) new_capacity *= 2;
+
+		uint32_t* touched = realloc(preprocessor->touched, new_capacity * sizeof(uint32_t));
+		if (!touched) {
+			preprocessor->recording->replayable = false;
+			preprocessor->recording = NULL;
+			return;
+		}
+		memset(touched + preprocessor->touched_capacity, 0, (new_capacity - preprocessor->touched_capacity) * sizeof(uint32_t));
+		preprocessor->touched = touched;
+		preprocessor->touched_capacity = new_capacity;
+	}
+	if (preprocessor->touched[name_id] == preprocessor->touch_stamp) return;
+	preprocessor->touched[name_id] = preprocessor->touch_stamp;
+
+	IncludeCacheEntry* entry = preprocessor->recording;
+	if (entry->assumption_count == entry->assumption_capacity) {
+		size_t new_capacity = entry->assumption_capacity ? entry->assumption_capacity * 2 : 16;
+		MacroAssumption* assumptions = realloc(entry->assumptions, new_capacity * sizeof(MacroAssumption));
+		if (!assumptions) {
+			entry->replayable = false;
+			preprocessor->recording = NULL;
+			return;
+		}
+		entry->assumptions = assumptions;
+		entry->assumption_capacity = new_capacity;
+	}
+
+	entry->assumptions[entry->assumption_count++] = (MacroAssumption){
+		.name_id = name_id,
+		.defined = macro != NULL,
+		.has_value = macro && macro->has_value,
+		.value = macro ? macro->u.value : 0,
+	};
+}
+
+static void note_definition(Preprocessor* preprocessor, uint32_t name_id, bool has_value, int value) {
+	IncludeCacheEntry* entry = preprocessor->recording;
+	if (entry->definition_count == entry->definition_capacity) {
+		size_t new_capacity = entry->definition_capacity ? entry->definition_capacity * 2 : 16;
+		MacroDefinition* definitions = realloc(entry->definitions, new_capacity * sizeof(MacroDefinition));
+		if (!definitions) {
+			entry->replayable = false;
+			preprocessor->recording = NULL;
+			return;
+		}
+		entry->definitions = definitions;
+		entry->definition_capacity = new_capacity;
+	}
+
+	entry->definitions[entry->definition_count++] = (MacroDefinition){
+		.name_id = name_id,
+		.has_value = has_value,
+		.value = value,
+	};
+}
+
+Macro* use_macro(Preprocessor* preprocessor, uint32_t name_id) {
+	Macro* macro = find_macro(preprocessor->macros, name_id);
+	if (preprocessor->recording) note_macro(preprocessor, name_id, macro);
+	return macro;
 }
 
 char* get_identifier(Preprocessor* preprocessor) {
@@ -191,23 +400,75 @@ char* get_identifier(Preprocessor* preprocessor) {
     return strndup(preprocessor->start, length);
 }
 
+static void parse_function_define(Preprocessor* preprocessor, char* name) {
+	advance(preprocessor);
+	char* params = preprocessor->end;
+	while (!is_at_end(preprocessor) && peek(preprocessor) != ')' && peek(preprocessor) != '\n') {
+		advance(preprocessor);
+	}
+	if (!is_at_character(preprocessor, ')')) {
+		fprintf(stderr, "Error: Unterminated parameter list for macro %s on line %d\n", name, preprocessor->line);
+		preprocessor->error_count++;
+		return;
+	}
+	char* params_end = preprocessor->end;
+	advance(preprocessor);
+	skip_blanks(preprocessor);
+
+	char* body = preprocessor->end;
+	while (!is_at_end(preprocessor) && peek(preprocessor) != '\n') {
+		advance(preprocessor);
+	}
+
+	Macro macro_node = { .name_id = intern_cstr(name) };
+	if (!parse_macro_body(&macro_node, params, params_end, body, preprocessor->end)) {
+		fprintf(stderr, "Error: Invalid parameter list for macro %s on line %d\n", name, preprocessor->line);
+		preprocessor->error_count++;
+		return;
+	}
+
+	// the definition is not recorded, so the file is rescanned every time
+	if (preprocessor->recording) {
+		preprocessor->recording->replayable = false;
+		preprocessor->recording = NULL;
+	}
+
+	if (!insert_macro(preprocessor->macros, macro_node)) {
+		free(macro_node.body);
+		free(macro_node.body_text);
+	}
+}
+
 void parse_define(Preprocessor* preprocessor) {
-    skip_whitespace(preprocessor);
+    skip_blanks(preprocessor);
 
 	char* name = get_identifier(preprocessor);
 	if (!name) return;
-    
-    skip_whitespace(preprocessor);
+
+	// a '(' right after the name starts a parameter list
+	if (name[0] != '\0' && is_at_character(preprocessor, '(')) {
+		parse_function_define(preprocessor, name);
+		free(name);
+		return;
+	}
+
+    skip_blanks(preprocessor);
 
 	preprocessor->start = preprocessor->end;
     char c = peek(preprocessor);
-    if (c != '-' || !isdigit(peek(preprocessor))) return;
-    
-    int value = get_number(preprocessor);
-    if (!macro_exists(preprocessor->macros, name)) {
-        add_macro(preprocessor->macros, name, value);
+    bool has_value = c == '-' || isdigit(c);
+    if (name[0] == '\0' || (!has_value && c != '\n' && c != '\0')) {
+        free(name);
+        return;
     }
-		 
+
+    int value = has_value ? get_number(preprocessor) : 0;
+    uint32_t name_id = intern_cstr(name);
+    // note_macro() can give up on the recording, so check again before the definition
+    if (preprocessor->recording) note_macro(preprocessor, name_id, find_macro(preprocessor->macros, name_id));
+    if (preprocessor->recording) note_definition(preprocessor, name_id, has_value, value);
+    define_macro(preprocessor->macros, name_id, has_value, value);
+
 	free(name);
 }
 
@@ -223,260 +484,646 @@ int get_number(Preprocessor* preprocessor) {
 	}
 
     // not consuming '-' as we have bool flag
-	int length = preprocessor->end - preprocessor->start + 1;
-	char* num_str = strndup(preprocessor->start, length);
+	int length = preprocessor->end - preprocessor->start - isNegative;
+	char* num_str = strndup(preprocessor->start + isNegative, length);
 	int value = atoi(num_str);
 	if (isNegative) value = -value;
 
 	free(num_str);
 
-<<<<<<< HEAD
     return value;
-=======
-	int length = preprocessor->end - preprocessor->start;
-	char* text = strndup(preprocessor->start, length);
-	
-	if (strcmp(text, "#define") == 0) {
-		parse_define_directive(preprocessor);
-	} else if (strcmp(text, "#include") == 0) {
-		parse_include_directive(preprocessor, start_pos);
-	}
+}
 
-	free(text);
-	
+void skip_whitespace(Preprocessor* preprocessor) {
+    while (!is_at_end(preprocessor) && isspace(peek(preprocessor))) {
+        if (peek(preprocessor) == '\n') {
+            preprocessor->line++;
+            preprocessor->column = 1;
+        }
+        advance(preprocessor);
+    }
 }
 
-void marker(Preprocessor* preprocessor) {
-	size_t start_pos = preprocessor->end;
-	char c = advance(preprocessor);
+Preprocessor* preprocess(char* original_file_path, char* source, size_t length)  {
+	Preprocessor* preprocessor = init_preprocessor(source, length);
+	if (!preprocessor) return NULL;
+
+	preprocessor->file_path = original_file_path;
+
+	apply_macro_snapshot(preprocessor);
+
+	uint64_t cache_key = 0;
+	if (load_cached_output(preprocessor, &cache_key)) return preprocessor;
+
+	replace_macros(preprocessor);
+	store_cached_output(preprocessor, cache_key);
+
+	return preprocessor;
 
-	switch (c) {
-		case '#':
-		case '<': 
-		case '"':
-			identifier(preprocessor, start_pos);
-			break; 
-	}
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
 }
 
-long get_file_size(FILE* file) {
-    fpos_t posIndicator;
-    if (fgetpos(file, &posIndicator) != 0) {
-        fprintf(stderr, "fgetpos() failed\n");
-        exit(EXIT_FAILURE);
+void free_preprocessor(Preprocessor* preprocessor) {
+	if (!preprocessor) return;
+
+    if (preprocessor->macros) {
+        for (size_t i = 0; i < preprocessor->macros->macro_count; i++) {
+            free(preprocessor->macros->macro[i].body);
+            free(preprocessor->macros->macro[i].body_text);
+        }
+        free(preprocessor->macros->macro);
+        free(preprocessor->macros->slots);
+        free(preprocessor->macros);
     }
 
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    
-    if (fsetpos(file, &posIndicator) != 0) {
-        fprintf(stderr, "fsetpos() failed\n");
-        exit(EXIT_FAILURE);
+	if (preprocessor->includes) {
+        struct IncludeNode* current = preprocessor->includes->head;
+    	while (current) {
+    		struct IncludeNode* next = current->next;
+    		free_include_node(current);
+    		current = next;
+    	}
+        free(preprocessor->includes);
     }
 
-    return file_size;
+	free_macro_expander(&preprocessor->expander);
+	free(preprocessor->touched);
+	free(preprocessor->conditionals);
+	free(preprocessor->segments);
+	free(preprocessor->output);
+	free(preprocessor);
 }
 
-char* get_file_contents(char* file_path) {
-    FILE* file = fopen(file_path, "rb");
-    if (!file) {
-    	fprintf(stderr, "Error: Failed to open file\n");
-        exit(EXIT_FAILURE);
-    }
+int find_macro_replacement(MacroList* macros, const char* name) {
+    Macro* macro = find_macro(macros, intern_find(name, strlen(name)));
+    return macro ? macro->u.value : -1;
+}
 
-    long file_size = get_file_size(file);
-    char* contents = malloc(file_size + 1);
-    char* writeIt = contents;
+static bool reserve_output(Preprocessor* preprocessor, size_t needed);
 
-    size_t bytes_read = 0;
-    while (bytes_read < file_size) {
-        size_t curr_bytes_read = fread(writeIt, 1, file_size - bytes_read, file);
-        bytes_read += curr_bytes_read;
-        writeIt += curr_bytes_read;
+bool append_output(Preprocessor* preprocessor, const char* text, size_t length) {
+	if (!reserve_output(preprocessor, preprocessor->output_length + length + 1)) return false;
+	memcpy(preprocessor->output + preprocessor->output_length, text, length);
+	preprocessor->output_length += length;
+	return true;
+}
 
-        if (feof(file)) { break; }
-    }
+static bool reserve_output(Preprocessor* preprocessor, size_t needed) {
+	if (needed <= preprocessor->output_capacity) return true;
 
-    if (bytes_read < file_size) {
-        printf("Bytes read: %zu\nFile size: %li\n", bytes_read, file_size);
-        free(contents);
-        exit(EXIT_FAILURE);
-    }
-    contents[bytes_read] ='\0';
-    fclose(file);
+	size_t new_size = preprocessor->output_capacity ? preprocessor->output_capacity * 2 : INITIAL_BUFFER_SIZE;
+	while (new_size < needed) new_size *= 2;
+
+	char* new_output = realloc(preprocessor->output, new_size);
+	if (!new_output) return false;
+	preprocessor->output = new_output;
+	preprocessor->output_capacity = new_size;
+	return true;
+}
 
-    return contents;
+// Starts a run of output that comes from the current file at the current line.
+static void begin_segment(Preprocessor* preprocessor) {
+	if (preprocessor->segment_count > 0 &&
+		preprocessor->segments[preprocessor->segment_count - 1].output_start == preprocessor->output_length) {
+		preprocessor->segment_count--;
+	}
+
+	if (preprocessor->segment_count == preprocessor->segment_capacity) {
+		size_t new_capacity = preprocessor->segment_capacity ? preprocessor->segment_capacity * 2 : 16;
+		SourceSegment* segments = realloc(preprocessor->segments, new_capacity * sizeof(SourceSegment));
+		if (!segments) return;
+		preprocessor->segments = segments;
+		preprocessor->segment_capacity = new_capacity;
+	}
 
+	preprocessor->segments[preprocessor->segment_count++] = (SourceSegment){
+		.file_path = preprocessor->file_path,
+		.output_start = preprocessor->output_length,
+		.line = preprocessor->line,
+	};
 }
 
-<<<<<<< HEAD
-void skip_whitespace(Preprocessor* preprocessor) {
-    while (!is_at_end(preprocessor) && isspace(peek(preprocessor))) {
-        if (peek(preprocessor) == '\n') {
-            preprocessor->line++;
-            preprocessor->column = 1;
-        }
-        advance(preprocessor);
-    }
-=======
-void update_subsequent_positions(struct IncludeNode* node, char* curr_file_path) {
-	size_t include_length = strlen(curr_file_path);
-	node->start_pos += include_length;
-	node->end_pos += include_length;
+bool source_location(Preprocessor* preprocessor, size_t output_offset, const char** file_path, int* line) {
+	if (preprocessor->segment_count == 0 || output_offset > preprocessor->output_length) return false;
+
+	size_t low = 0;
+	size_t high = preprocessor->segment_count - 1;
+	while (low < high) {
+		size_t middle = low + (high - low + 1) / 2;
+		if (preprocessor->segments[middle].output_start <= output_offset) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
+
+	const SourceSegment* segment = &preprocessor->segments[low];
+	*file_path = segment->file_path;
+	*line = segment->line;
+	for (size_t i = segment->output_start; i < output_offset; i++) {
+		if (preprocessor->output[i] == '\n') (*line)++;
+	}
+	return true;
 }
 
-void write_to_source(Preprocessor* preprocessor, char* original_file_path, char* source, char* includes_file_path, size_t start_pos, size_t end_pos) {
-	char* include_contents = get_file_contents(includes_file_path);
-	size_t include_length = strlen(include_contents);
+// Splits a directive line into its name and the first word after it.
+bool directive_words(const char* line, const char* end, const char** name, size_t* name_length,
+		const char** word, size_t* word_length) {
+	while (line < end && (*line == ' ' || *line == '\t')) line++;
+	if (line == end || *line != '#') return false;
+	line++;
+
+	const char* words[2];
+	size_t lengths[2];
+	for (int i = 0; i < 2; i++) {
+		while (line < end && (*line == ' ' || *line == '\t')) line++;
+		words[i] = line;
+		while (line < end && (isalnum((unsigned char)*line) || *line == '_')) line++;
+		lengths[i] = line - words[i];
+	}
 
-	size_t source_length = strlen(source);
-	size_t new_size = include_length + source_length;
-	char* new_content = malloc(new_size + 1);
+	*name = words[0];
+	*name_length = lengths[0];
+	*word = words[1];
+	*word_length = lengths[1];
+	return true;
+}
 
-	memcpy(new_content, include_contents, include_length);
+static bool is_word(const char* word, size_t length, const char* expected) {
+	return length == strlen(expected) && memcmp(word, expected, length) == 0;
+}
 
-	memmove(
-		new_content + include_length,
-		source,
-		source_length
-	);
+static void skip_inactive(Preprocessor* preprocessor);
 
-	new_content[new_size] = '\0';		
+void parse_directive(Preprocessor* preprocessor) {
+	int include_pos = preprocessor->current_pos;
+	advance(preprocessor);
+
+	bool inactive = false;
+	char* directive = get_identifier(preprocessor);
+	if (directive && (strcmp(directive, "if") == 0 || strcmp(directive, "ifdef") == 0 ||
+		strcmp(directive, "ifndef") == 0 || strcmp(directive, "elif") == 0 ||
+		strcmp(directive, "else") == 0 || strcmp(directive, "endif") == 0)) {
+		inactive = parse_conditional(preprocessor, directive);
+	} else if (directive && strcmp(directive, "define") == 0) {
+		parse_define(preprocessor);
+	} else if (directive && strcmp(directive, "include") == 0) {
+		parse_include(preprocessor, include_pos);
+	} else if (directive && strcmp(directive, "pragma") == 0) {
+		skip_blanks(preprocessor);
+		char* pragma = get_identifier(preprocessor);
+		if (pragma && strcmp(pragma, "once") == 0 && preprocessor->current_include) {
+			preprocessor->current_include->once = true;
+		}
+		free(pragma);
+	}
+	free(directive);
 
-	preprocessor->file = fopen(original_file_path, "w+");
-	if (!preprocessor->file) return;
+	// the rest of the directive line is dropped; its newline is kept
+	while (!is_at_end(preprocessor) && peek(preprocessor) != '\n') {
+		advance(preprocessor);
+	}
+	if (inactive) skip_inactive(preprocessor);
+}
 
-	fseek(preprocessor->file, start_pos, SEEK_SET);
-	fwrite(new_content, 1, new_size, preprocessor->file);
+static inline bool is_identifier_char(char c) {
+	return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || (unsigned char)(c - '0') <= 9 || c == '_';
+}
 
-	free(include_contents);
-	free(new_content);
+// Moves past a macro call whose expansion is already in the output. A call
+// spread over several lines starts a new segment so later output still maps
+// to the right line.
+static void skip_call(Preprocessor* preprocessor, char* call_end) {
+	int newlines = 0;
+	for (char* p = preprocessor->end; p < call_end; p++) {
+		if (*p == '\n') {
+			newlines++;
+			preprocessor->column = call_end - p;
+		}
+	}
+	if (!newlines) preprocessor->column += call_end - preprocessor->end;
 
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
+	preprocessor->current_pos += call_end - preprocessor->end;
+	preprocessor->end = call_end;
+	if (newlines) {
+		preprocessor->line += newlines;
+		begin_segment(preprocessor);
+	}
 }
 
-void generator(Preprocessor* preprocessor, char* original_file_path, char* source) {
-	struct IncludeNode* current = preprocessor->includes->head;
-	while (current) {
-		write_to_source(preprocessor, original_file_path, source, current->file_path,
-			current->start_pos, current->end_pos);
+// Jumps over an inactive region with memchr, one line at a time, looking only
+// for a '#' that starts a line. Nested conditionals are counted, and the scan
+// stops on the newline before the #elif, #else or #endif that ends the
+// region, so that directive is handled next. The skipped lines are written as
+// empty lines when the output is text, which keeps line numbers in step.
+static void skip_inactive(Preprocessor* preprocessor) {
+	const char* limit = preprocessor->limit;
+	const char* newline = preprocessor->end;
+	int depth = 0;
+	int lines = 0;
+
+	while (newline < limit && *newline == '\n') {
+		const char* line = newline + 1;
+		const char* next = memchr(line, '\n', limit - line);
+		if (!next) next = limit;
+
+		const char* text = line;
+		while (text < next && (*text == ' ' || *text == '\t')) text++;
+		if (text < next && *text == '#') {
+			const char* name;
+			const char* word;
+			size_t name_length, word_length;
+			directive_words(text, next, &name, &name_length, &word, &word_length);
+
+			if (is_word(name, name_length, "if") || is_word(name, name_length, "ifdef") ||
+				is_word(name, name_length, "ifndef")) {
+				depth++;
+			} else if (is_word(name, name_length, "endif")) {
+				if (depth == 0) break;
+				depth--;
+			} else if (depth == 0 && (is_word(name, name_length, "elif") || is_word(name, name_length, "else"))) {
+				break;
+			}
+		}
+
+		lines++;
+		newline = next;
+	}
 
-		update_subsequent_positions(current->next, current->file_path);
-		current = current->next;
+	if (preprocessor->scan_source == preprocess_source && reserve_output(preprocessor, preprocessor->output_length + lines + 1)) {
+		memset(preprocessor->output + preprocessor->output_length, '\n', lines);
+		preprocessor->output_length += lines;
 	}
+
+	preprocessor->current_pos += newline - preprocessor->end;
+	preprocessor->end = (char*)newline;
+	preprocessor->line += lines;
+	preprocessor->column = 1;
 }
 
-Preprocessor* preprocess(char* original_file_path, char* source)  {
-	Preprocessor* preprocessor = init_preprocessor(source);
-<<<<<<< HEAD
+// Streams source..limit of the current file into the output: directives are
+// handled as their lines are reached, so a macro only applies after its
+// #define, and identifiers are looked up by interned id. Directive lines keep
+// their newline so line numbers within a file still match the input.
+static bool preprocess_source(Preprocessor* preprocessor) {
+	begin_segment(preprocessor);
 
+	bool at_line_start = true;
 	while (!is_at_end(preprocessor)) {
-		skip_whitespace(preprocessor);
-
-		if (is_at_end(preprocessor)) break;
-
-        if (peek(preprocessor) == '#') {
-            int include_pos = preprocessor->current_pos;
-            advance(preprocessor); 
-            
-            char* directive = get_identifier(preprocessor);
-            if (directive && strcmp(directive, "define") == 0) {
-                parse_define(preprocessor);
-            } else if (directive && strcmp(directive, "include") == 0) {
-                parse_include(preprocessor, include_pos);
-            }
-            free(directive);
-        } else {
-            advance(preprocessor);
-        }
-	}
-	replace_macros(preprocessor);
+		const char* input = preprocessor->end;
+		char c = *input;
+
+		if (at_line_start && c == '#') {
+			parse_directive(preprocessor);
+			continue;
+		}
 
-=======
-	
-	while (*preprocessor->end != '\0') {
-		char c = peek(preprocessor);
+		if (is_identifier_char(c) && (unsigned char)(c - '0') > 9) {
+			const char* limit = preprocessor->limit;
+			while (input < limit && is_identifier_char(*input)) input++;
+
+			size_t word_length = input - preprocessor->end;
+			if (!reserve_output(preprocessor, preprocessor->output_length + word_length + 16)) return false;
+
+			char* output = preprocessor->output + preprocessor->output_length;
+			Macro* macro;
+			if (preprocessor->recording) {
+				uint32_t name_id = intern(preprocessor->end, word_length);
+				macro = find_macro(preprocessor->macros, name_id);
+				note_macro(preprocessor, name_id, macro);
+			} else {
+				macro = find_macro(preprocessor->macros, intern_find(preprocessor->end, word_length));
+			}
 
-		if (isspace(c)) {
-			if (c == '\n') {
-				preprocessor->line++;
-				preprocessor->column = 1;
+			if (macro && macro->function_like) {
+				char* call_end = expand_macro(preprocessor, macro, (char*)input);
+				if (call_end) {
+					skip_call(preprocessor, call_end);
+					at_line_start = false;
+					continue;
+				}
+
+				// a name with no call after it stays as it is
+				macro = NULL;
+				if (!reserve_output(preprocessor, preprocessor->output_length + word_length + 16)) return false;
+				output = preprocessor->output + preprocessor->output_length;
 			}
-			advance(preprocessor);
 
+			if (macro) {
+				if (macro->has_value) preprocessor->output_length += sprintf(output, "%d", macro->u.value);
+			} else {
+				memcpy(output, preprocessor->end, word_length);
+				preprocessor->output_length += word_length;
+			}
+
+			preprocessor->end += word_length;
+			preprocessor->current_pos += word_length;
+			preprocessor->column += word_length;
+			at_line_start = false;
+			continue;
 		}
 
-		if (isdigit(c) || (c == '-' && isdigit(peek_next(preprocessor)))) {
-			number(preprocessor);
-		} else if (strchr("#<>\"",c)) {
-			marker(preprocessor);
+		if (!reserve_output(preprocessor, preprocessor->output_length + 2)) return false;
+		if (c == '\n') {
+			at_line_start = true;
+			preprocessor->line++;
+			preprocessor->column = 0;
+		} else if (c != ' ' && c != '\t') {
+			at_line_start = false;
 		}
+		preprocessor->output[preprocessor->output_length++] = advance(preprocessor);
+	}
+	return true;
+}
 
+static size_t include_cache_bucket(const char* path) {
+	uint32_t hash = 2166136261u;
+	for (; *path; path++) {
+		hash = (hash ^ (unsigned char)*path) * 16777619u;
 	}
+	return hash & (INCLUDE_CACHE_SIZE - 1);
+}
 
-	generator(preprocessor, original_file_path, source);
-	fclose(preprocessor->file);
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
-	return preprocessor;
+static bool is_blank_line(const char* line, const char* end) {
+	while (line < end && (*line == ' ' || *line == '\t' || *line == '\r')) line++;
+	return line == end;
+}
+
+// Returns NAME's id when everything in the file sits between
+// #ifndef NAME / #define NAME and a final matching #endif.
+static uint32_t detect_include_guard(const char* data, size_t length) {
+	const char* limit = data + length;
+	const char* guard = NULL;
+	size_t guard_length = 0;
+	int depth = 0;
+	int significant = 0;
+	bool closed = false;
+
+	for (const char* line = data; line < limit; ) {
+		const char* end = memchr(line, '\n', limit - line);
+		if (!end) end = limit;
+
+		if (!is_blank_line(line, end)) {
+			if (closed) return INTERN_NONE;
+
+			const char* name;
+			const char* word;
+			size_t name_length, word_length;
+			bool directive = directive_words(line, end, &name, &name_length, &word, &word_length);
+			significant++;
+
+			if (significant == 1) {
+				if (!directive || !is_word(name, name_length, "ifndef") || word_length == 0) return INTERN_NONE;
+				guard = word;
+				guard_length = word_length;
+				depth = 1;
+			} else if (significant == 2) {
+				if (!directive || !is_word(name, name_length, "define") ||
+					word_length != guard_length || memcmp(word, guard, guard_length) != 0) {
+					return INTERN_NONE;
+				}
+			} else if (directive && (is_word(name, name_length, "if") || is_word(name, name_length, "ifdef") ||
+					is_word(name, name_length, "ifndef"))) {
+				depth++;
+			} else if (directive && depth == 1 && (is_word(name, name_length, "else") ||
+					is_word(name, name_length, "elif"))) {
+				// the other branch is live once the guard is defined
+				return INTERN_NONE;
+			} else if (directive && is_word(name, name_length, "endif")) {
+				closed = --depth == 0;
+			}
+		}
+		line = end + 1;
+	}
+
+	return closed ? intern(guard, guard_length) : INTERN_NONE;
+}
 
+static void clear_include_entry(IncludeCacheEntry* entry) {
+	free_source(entry->source);
+	free(entry->output);
+	free(entry->assumptions);
+	free(entry->definitions);
+
+	entry->source = NULL;
+	entry->guard_id = INTERN_NONE;
+	entry->once = false;
+	entry->translation_unit = 0;
+	entry->replayable = true;
+	entry->recorded = false;
+	entry->output = NULL;
+	entry->output_length = 0;
+	entry->assumptions = NULL;
+	entry->assumption_count = 0;
+	entry->assumption_capacity = 0;
+	entry->definitions = NULL;
+	entry->definition_count = 0;
+	entry->definition_capacity = 0;
 }
 
-<<<<<<< HEAD
-=======
+static IncludeCacheEntry* lookup_include(const char* path) {
+	struct stat info;
+	char* canonical = canonical_include_path(path);
+	if (!canonical || stat(canonical, &info) != 0) {
+		fprintf(stderr, "Error: Failed to open file %s\n", path);
+		free(canonical);
+		return NULL;
+	}
+
+	size_t bucket = include_cache_bucket(canonical);
+	IncludeCacheEntry* entry = include_cache[bucket];
+	while (entry && strcmp(entry->path, canonical) != 0) entry = entry->next;
+
+	if (entry && entry->source && entry->size == info.st_size &&
+		entry->mtime.tv_sec == info.st_mtim.tv_sec && entry->mtime.tv_nsec == info.st_mtim.tv_nsec) {
+		include_cache_stats.hits++;
+		free(canonical);
+		return entry;
+	}
+
+	if (entry) {
+		clear_include_entry(entry);
+		free(canonical);
+	} else {
+		entry = calloc(1, sizeof(IncludeCacheEntry));
+		if (!entry) {
+			free(canonical);
+			return NULL;
+		}
+		entry->path = canonical;
+		clear_include_entry(entry);
+		entry->next = include_cache[bucket];
+		include_cache[bucket] = entry;
+	}
+
+	include_cache_stats.misses++;
+	entry->source = load_source(entry->path);
+	if (!entry->source) return NULL;
 
-void free_macro(Macro macro) {
-	free(macro.name);
-	free(macro.u.replacement);
+	entry->mtime = info.st_mtim;
+	entry->size = info.st_size;
+	entry->guard_id = detect_include_guard(entry->source->data, entry->source->length);
+	return entry;
 }
 
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
-void free_preprocessor(Preprocessor* preprocessor) {
-	if (!preprocessor) return;
+const IncludeCacheStats* get_include_cache_stats() {
+	return &include_cache_stats;
+}
 
-    if (preprocessor->macros) {
-    	for (size_t i = 0; i < preprocessor->macros->macro_count; i++) {
-    		free(preprocessor->macros->macro[i].name);
-            free(preprocessor->macros->macro[i].u.replacement);
-    	} 
-        free(preprocessor->macros->macro);
-        free(preprocessor->macros);
-    }
-	
-	if (preprocessor->includes) {
-        struct IncludeNode* current = preprocessor->includes->head;
-    	while (current) {
-    		struct IncludeNode* next = current->next;
-    		free(current->file_path);
-    		free(current);
-    		current = next;
-    	}
-        free(preprocessor->includes);
-    }
-	free(preprocessor);
+void free_include_cache() {
+	for (size_t i = 0; i < INCLUDE_CACHE_SIZE; i++) {
+		IncludeCacheEntry* entry = include_cache[i];
+		while (entry) {
+			IncludeCacheEntry* next = entry->next;
+			clear_include_entry(entry);
+			free(entry->path);
+			free(entry);
+			entry = next;
+		}
+		include_cache[i] = NULL;
+	}
 }
 
-int find_macro_replacement(MacroList* macros, const char* name) {
-    for (size_t i = 0; i < macros->macro_count; i++) {
-        if (strcmp(macros->macro[i].name, name) == 0) {
-            return macros->macro[i].u.value;
-        }
-    }
-    return -1;
+static IncludeCacheEntry* find_include(const char* path) {
+	char* canonical = canonical_include_path(path);
+	if (!canonical) return NULL;
+
+	IncludeCacheEntry* entry = include_cache[include_cache_bucket(canonical)];
+	while (entry && strcmp(entry->path, canonical) != 0) entry = entry->next;
+	free(canonical);
+	return entry;
 }
 
-void replace_macros(Preprocessor* preprocessor) {
-    char* input = strdup(preprocessor->output);
-    if (!input) return;
+bool is_included_once(const char* path) {
+	IncludeCacheEntry* entry = find_include(path);
+	return entry && entry->once;
+}
 
-    size_t output_size = strlen(input) * 2;
-    char* output = malloc(output_size);
-    if (!output) {
-        free(input);
-        return;
-    }
+void assume_included(Preprocessor* preprocessor, const char* path, bool once) {
+	IncludeCacheEntry* entry = lookup_include(path);
+	if (!entry) return;
+
+	entry->once |= once;
+	entry->translation_unit = preprocessor->translation_unit;
+}
+
+// Emits the recorded result if every macro the file depended on is in the
+// same state now; the file's own definitions are then applied in order.
+static bool replay_include(Preprocessor* preprocessor, IncludeCacheEntry* entry) {
+	for (size_t i = 0; i < entry->assumption_count; i++) {
+		const MacroAssumption* assumption = &entry->assumptions[i];
+		Macro* macro = find_macro(preprocessor->macros, assumption->name_id);
+		if ((macro != NULL) != assumption->defined) return false;
+		if (macro && (macro->has_value != assumption->has_value || macro->u.value != assumption->value)) return false;
+	}
+
+	if (!reserve_output(preprocessor, preprocessor->output_length + entry->output_length + 1)) return false;
+
+	begin_segment(preprocessor);
+	memcpy(preprocessor->output + preprocessor->output_length, entry->output, entry->output_length);
+	preprocessor->output_length += entry->output_length;
+
+	for (size_t i = 0; i < entry->definition_count; i++) {
+		const MacroDefinition* definition = &entry->definitions[i];
+		define_macro(preprocessor->macros, definition->name_id, definition->has_value, definition->value);
+	}
+	return true;
+}
+
+// Included files come from the include cache and are streamed into the
+// output in place of the directive; the including file's cursor is restored
+// afterwards. Nothing is written back to disk.
+static void expand_include(Preprocessor* preprocessor, struct IncludeNode* node) {
+	// what the including file produces now depends on another file
+	if (preprocessor->recording) {
+		preprocessor->recording->replayable = false;
+		preprocessor->recording = NULL;
+	}
+
+	if (preprocessor->include_depth >= MAX_INCLUDE_DEPTH) {
+		fprintf(stderr, "Error: #include nested too deeply at %s\n", node->file_path);
+		preprocessor->error_count++;
+		return;
+	}
+
+	IncludeCacheEntry* entry = lookup_include(node->file_path);
+	if (!entry) {
+		preprocessor->error_count++;
+		return;
+	}
+
+	if ((entry->once && entry->translation_unit == preprocessor->translation_unit) ||
+		(entry->guard_id != INTERN_NONE && find_macro(preprocessor->macros, entry->guard_id))) {
+		include_cache_stats.skipped++;
+		return;
+	}
+	entry->translation_unit = preprocessor->translation_unit;
+
+	Preprocessor saved = *preprocessor;
+	size_t output_start = preprocessor->output_length;
+
+	preprocessor->file_path = node->file_path;
+	preprocessor->line = 1;
+	preprocessor->column = 1;
+
+	// results are recorded and replayed as text, so only when text is the output
+	bool writes_text = preprocessor->scan_source == preprocess_source;
+	if (writes_text && entry->recorded && replay_include(preprocessor, entry)) {
+		include_cache_stats.replayed++;
+	} else {
+		preprocessor->source = entry->source->data;
+		preprocessor->limit = entry->source->data + entry->source->length;
+		preprocessor->start = preprocessor->source;
+		preprocessor->end = preprocessor->source;
+		preprocessor->current_pos = 0;
+		preprocessor->include_depth++;
+		preprocessor->current_include = entry;
+		preprocessor->conditional_base = preprocessor->conditional_count;
+
+		if (writes_text && !entry->recorded && entry->replayable) {
+			entry->assumption_count = 0;
+			entry->definition_count = 0;
+			preprocessor->recording = entry;
+			preprocessor->touch_stamp++;
+		}
 
-    char* current = ouptut;
-    char* input_ptr = input;
+		int error_count = preprocessor->error_count;
+		preprocessor->scan_source(preprocessor);
+		end_conditionals(preprocessor);
+
+		// a replay would leave out the diagnostics
+		if (preprocessor->recording == entry && preprocessor->error_count == error_count) {
+			size_t length = preprocessor->output_length - output_start;
+			entry->output = malloc(length + 1);
+			if (entry->output) {
+				memcpy(entry->output, preprocessor->output + output_start, length);
+				entry->output_length = length;
+				entry->recorded = true;
+			}
+		}
+	}
+	node->content_length = preprocessor->output_length - output_start;
+
+	preprocessor->source = saved.source;
+	preprocessor->limit = saved.limit;
+	preprocessor->start = saved.start;
+	preprocessor->end = saved.end;
+	preprocessor->line = saved.line;
+	preprocessor->column = saved.column;
+	preprocessor->current_pos = saved.current_pos;
+	preprocessor->file_path = saved.file_path;
+	preprocessor->include_depth = saved.include_depth;
+	preprocessor->current_include = saved.current_include;
+	preprocessor->recording = saved.recording;
+	preprocessor->conditional_base = saved.conditional_base;
+	begin_segment(preprocessor);
+}
+
+// Appends to the output, after anything a snapshot put there.
+void replace_macros(Preprocessor* preprocessor) {
+	size_t needed = preprocessor->output_length + (preprocessor->limit - preprocessor->source) + INITIAL_BUFFER_SIZE;
+	if (!reserve_output(preprocessor, needed)) return;
 
-}
\ No newline at end of file
+	preprocess_source(preprocessor);
+	end_conditionals(preprocessor);
+	preprocessor->output[preprocessor->output_length] = '\0';
+}
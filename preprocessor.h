@@ -5,23 +5,33 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+#include "intern.h"
+#include "source.h"
 
 #define MACRO_COUNT 100
+#define MACRO_TABLE_SIZE 256
 #define INCLUDE_PATHS 100
 #define INITIAL_BUFFER_SIZE 4096
+#define MAX_INCLUDE_DEPTH 64
+#define INCLUDE_CACHE_SIZE 256
+#define MACRO_MEMO_SIZE 1024
+#define RESOLVER_CACHE_SIZE 1024
 
 struct IncludeNode {
 	char* file_path;
-<<<<<<< HEAD
-	size_t placeholder_id;
-	int start_pos;
-	int end_pos;
-=======
 	size_t start_pos;
 	size_t end_pos;
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
 	size_t content_length;
 
+	// The #include that found file_path, so the lookup can be made again:
+	// the name as written, <> or "", and the including file. name is NULL
+	// for a file included by path.
+	char* name;
+	bool angled;
+	char* including_path;
+
 	struct IncludeNode* prev;
 	struct IncludeNode* next;
 };
@@ -32,44 +42,229 @@ typedef struct {
 	size_t include_count;
 } IncludeList;
 
+typedef enum {
+	PP_WORD,
+	PP_NUMBER,
+	PP_TEXT,
+	PP_PARAM
+} pp_token_kind_t;
+
+// A token of a function-like macro body, argument or expansion. Words are
+// anything that could name a macro; everything else between blanks is text,
+// with '(', ')' and ',' always on their own. hide is the token's hide-set:
+// the macros that must not expand it again.
 typedef struct {
-	char* name;
+	uint8_t kind;
+	bool space_before;
+	int length;                 // PP_TEXT
+	uint32_t hide;
+	union {
+		uint32_t id;            // PP_WORD name, PP_PARAM index
+		int value;              // PP_NUMBER
+		const char* text;       // PP_TEXT
+	} u;
+} PPToken;
+
+typedef struct {
+	const char* name;
+	uint32_t name_id;
+	bool has_value; // false for `#define NAME`, which expands to nothing
 	union {
 		char* replacement;
 		int value;
 	} u;
 
+	// `#define NAME(a, b) body`; body tokens point into body_text
+	bool function_like;
+	int param_count;
+	PPToken* body;
+	int body_length;
+	char* body_text;
 } Macro;
 
+// macro[] holds definitions in order; slots is an open-addressing index
+// over it keyed on the interned name (index + 1, 0 marks an empty slot).
 typedef struct {
 	Macro* macro;
 	size_t macro_count;
 	size_t macro_capacity;
+	uint32_t* slots;
+	size_t slot_capacity;
+	unsigned generation; // bumped by every definition
 } MacroList;
 
+// Hide-sets are chains of (macro, parent) nodes, hash-consed so that the
+// same chain always has the same index; 0 is the empty set.
+typedef struct {
+	uint32_t macro_id;
+	uint32_t parent;
+} HideSetNode;
+
+// One function-like call from the source and what it expanded to. The key
+// holds the macro and the argument tokens, so equal calls share it.
+typedef struct {
+	uint64_t hash;
+	unsigned char* key;
+	size_t key_length;
+	PPToken* tokens;
+	size_t token_count;
+} MacroMemo;
+
+typedef struct {
+	HideSetNode* nodes;
+	size_t node_count;
+	size_t node_capacity;
+	uint32_t* node_slots;
+	size_t node_slot_capacity;
+
+	MacroMemo* memo;
+	size_t memo_count;
+	size_t memo_capacity;
+	unsigned memo_generation;
+	unsigned char* key;
+	size_t key_capacity;
+
+	size_t calls;       // function-like calls expanded, memoized or not
+	size_t memo_hits;
+} MacroExpander;
+
+// The state of one macro as an included file first saw it.
+typedef struct {
+	uint32_t name_id;
+	bool defined;
+	bool has_value;
+	int value;
+} MacroAssumption;
+
+typedef struct {
+	uint32_t name_id;
+	bool has_value;
+	int value;
+} MacroDefinition;
+
+// An included file, kept for the rest of the process and keyed on its
+// canonical path; a changed mtime or size reloads it.
+//
+// guard_id is NAME when the whole file is wrapped in #ifndef NAME /
+// #define NAME ... #endif, and `once` is set by #pragma once; either lets a
+// repeat include be skipped without touching the file.
+//
+// The preprocessed result of the first expansion is kept as well. It only
+// depends on the macros the file looked at or defined, so it is replayed
+// while every assumption still holds. Files that include others are never
+// replayed.
+typedef struct IncludeCacheEntry {
+	char* path;
+	struct timespec mtime;
+	off_t size;
+	SourceFile* source;
+
+	uint32_t guard_id;
+	bool once;
+	unsigned translation_unit;
+
+	bool replayable;
+	bool recorded;
+	char* output;
+	size_t output_length;
+	MacroAssumption* assumptions;
+	size_t assumption_count;
+	size_t assumption_capacity;
+	MacroDefinition* definitions;
+	size_t definition_count;
+	size_t definition_capacity;
+
+	struct IncludeCacheEntry* next;
+} IncludeCacheEntry;
+
+typedef struct {
+	size_t hits;     // found in the cache with the same mtime and size
+	size_t misses;   // read from disk
+	size_t skipped;  // dropped by an include guard or #pragma once
+	size_t replayed; // emitted from the cached result without rescanning
+} IncludeCacheStats;
+
+// An open #if/#ifdef/#ifndef. taken is set once one of its branches has been
+// active, so every later #elif and #else is skipped.
 typedef struct {
-<<<<<<< HEAD
-=======
-	FILE* file; // going to reopn initial file to writer included content back 
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
+	int line;
+	bool taken;
+	bool seen_else;
+} ConditionalFrame;
+
+typedef struct {
+	size_t lookups;         // #include names resolved
+	size_t probes;          // candidate paths checked; each is a stat() without the cache
+	size_t stat_calls;
+	size_t directory_reads; // directories listed with readdir()
+	size_t realpath_calls;
+	size_t realpath_hits;
+} IncludeResolverStats;
+
+typedef struct {
+	size_t hits;   // output taken from the cache
+	size_t misses; // no entry, or one of its files changed
+	size_t stores;
+} OutputCacheStats;
+
+// A run of the output that came from one file, starting at `line` there.
+// Together the segments map any output offset back to its file and line.
+typedef struct {
+	const char* file_path;
+	size_t output_start;
+	int line;
+} SourceSegment;
+
+typedef struct Preprocessor {
+	const char* file_path;
+	int include_depth;
+	unsigned translation_unit;
+	IncludeCacheEntry* current_include;
+
+	// the include whose result is being recorded, and the ids it has seen
+	IncludeCacheEntry* recording;
+	uint32_t* touched;
+	size_t touched_capacity;
+	uint32_t touch_stamp;
+
 	int line;
 	int column;
 
+	// source..limit is the input; it may be a read-only mapping with no
+	// trailing NUL, so scanning stops at limit.
+	char* source;
+	char* limit;
 	char* start;
 	char* end;
 	char* output;
+	size_t output_length;
+	size_t output_capacity;
+
+	SourceSegment* segments;
+	size_t segment_count;
+	size_t segment_capacity;
 
 	int current_pos;
 
+	// open conditionals; those from conditional_base up belong to the current file
+	ConditionalFrame* conditionals;
+	size_t conditional_count;
+	size_t conditional_capacity;
+	size_t conditional_base;
+
 	IncludeList* includes;
 	MacroList* macros;
-} Preprocessor;
+	MacroExpander expander;
 
-<<<<<<< HEAD
+	// diagnostics printed so far; output that had any is never cached
+	int error_count;
+
+	// Runs the current file from end to limit. The default writes text to
+	// output; the fused lexer installs one that emits tokens to scan_context.
+	bool (*scan_source)(struct Preprocessor* preprocessor);
+	void* scan_context;
+} Preprocessor;
 
-<<<<<<< HEAD
-=======
->>>>>>> echo
 // macro functionality
 bool is_at_end(Preprocessor* preprocessor);
 bool is_at_character(Preprocessor* preprocessor, char c);
@@ -78,51 +273,100 @@ char* get_identifier(Preprocessor* preprocessor);
 int get_number(Preprocessor* preprocessor);
 void parse_define(Preprocessor* preprocessor);
 void parse_include(Preprocessor* preprocessor, int start_pos);
-<<<<<<< HEAD
-void add_include(MacroList* list, char* name, int value);
-=======
+// handles the directive line starting at the '#' under end; stops before its newline
+void parse_directive(Preprocessor* preprocessor);
 void add_include_node(IncludeList* list, char* file_path, size_t start_pos, size_t end_pos);
-void add_int_macro_node(MacroList* list, char* name, int value);
-void add_string_macro_node(MacroList* list, char* name, char* replacement);
-
-// macro functionality
-bool macro_exists(MacroList* macros, char* name);
+// copies the lookup that found node's file into it; including_path may be NULL
+bool set_include_lookup(struct IncludeNode* node, const char* name, size_t length, bool angled, const char* including_path);
+// whether the lookup recorded for an include still finds path
+bool include_lookup_unchanged(const char* name, bool angled, const char* including_path, const char* path);
+void free_include_node(struct IncludeNode* node);
+// records file_path in the include list and expands it at the current position
+void include_file(Preprocessor* preprocessor, char* file_path, size_t start_pos, size_t end_pos);
 
-void parse_define_directive(Preprocessor* preprocessor);
-void parse_include_directive(Preprocessor* preprocessor, size_t start_pos);
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
-=======
-void add_include(IncludeList* list, char* file_path, int start_pos);
->>>>>>> echo
-
-char advance(Preprocessor* preprocessor);
-char peek(Preprocessor* preprocessor);
-char peek_next(Preprocessor* preprocessor);
 void skip_whitespace(Preprocessor* preprocessor);
 
-
+Macro* find_macro(MacroList* macros, uint32_t name_id);
 bool macro_exists(MacroList* macros, char* name);
-void add_macro(IncludeList* list, char* file_path, int start_pos);
 int find_macro_replacement(MacroList* macros, const char* name);
 void add_macro(MacroList* list, char* name, int value);
+bool insert_macro(MacroList* macros, Macro macro_node);
 void replace_macros(Preprocessor* preprocessor);
-void add_macro(MacroList* macros, const char* name, const char* value);
-
-// writer code from #include directive to file
-long get_file_size(FILE* file);
-char* get_file_contents(char* source);
-<<<<<<< HEAD
-=======
-void update_subsequent_positions(struct IncludeNode* node, char* file_path);
-void write_to_source(Preprocessor* preprocessor, char* original_file_path, char* source, char* includes_file_path, size_t start_pos, size_t end_pos);
-void grab_include_contents(Preprocessor* preprocessor, char* source);
-void generator(Preprocessor* preprocessor, char* original_file_path, char* source);
->>>>>>> 8e0126cb350316c8a6962c814ab27d1140b47e05
+bool append_output(Preprocessor* preprocessor, const char* text, size_t length);
+// find_macro() that also records the lookup when an include is being recorded
+Macro* use_macro(Preprocessor* preprocessor, uint32_t name_id);
+bool directive_words(const char* line, const char* end, const char** name, size_t* name_length,
+	const char** word, size_t* word_length);
+
+// conditional compilation (preprocessor_conditional.c)
+// Handles #if, #ifdef, #ifndef, #elif, #else or #endif with end just past the
+// directive name; returns true when the lines after it are inactive.
+bool parse_conditional(Preprocessor* preprocessor, const char* directive);
+// reports the conditionals the current file left open and drops them
+void end_conditionals(Preprocessor* preprocessor);
+
+// function-like macros (preprocessor_macro.c)
+bool parse_macro_body(Macro* macro, const char* params, const char* params_end, const char* body, const char* body_end);
+// Appends the expansion of the use of macro whose name ends at word_end to
+// the output and returns where the use ends (past the ')' of a call), or NULL
+// when a function-like name is not followed by '('.
+char* expand_macro(Preprocessor* preprocessor, Macro* macro, char* word_end);
+void free_macro_expander(MacroExpander* expander);
+// Memoization is on by default; turning it off is for measurement.
+void set_macro_memoization(bool enabled);
+
+// include search paths (preprocessor_include.c)
+bool add_include_path(const char* directory);
+size_t get_include_path_count();
+const char* get_include_path(size_t index);
+char* resolve_include_path(const char* including_path, const char* name, int length, bool angled);
+// realpath(), remembered per path
+char* canonical_include_path(const char* path);
+// Caching is on by default; turning it off is for measurement.
+void set_include_resolver_caching(bool enabled);
+const IncludeResolverStats* get_include_resolver_stats();
+void free_include_resolver();
+
+// per-process cache of included files
+const IncludeCacheStats* get_include_cache_stats();
+void free_include_cache();
+// whether path has been seen to use #pragma once
+bool is_included_once(const char* path);
+// treats path as already included in this translation unit
+void assume_included(Preprocessor* preprocessor, const char* path, bool once);
+
+// preprocessed-output cache (preprocessor_cache.c); off until a directory is set
+void set_output_cache(const char* directory);
+const OutputCacheStats* get_output_cache_stats();
+// Before preprocessing: sets *key and, when the cached entry for it is still
+// valid, fills in the output, segments and includes and returns true.
+bool load_cached_output(Preprocessor* preprocessor, uint64_t* key);
+void store_cached_output(Preprocessor* preprocessor, uint64_t key);
+// Writes a Make rule "target: file includes..." to path.
+bool write_dependency_file(Preprocessor* preprocessor, const char* target, const char* path);
+// FNV-1a of the file's contents; 0 when it cannot be read
+uint64_t hash_file(const char* path);
+
+// macro snapshots (preprocessor_snapshot.c)
+// Saves the state left by preprocessing a prefix header: macros, output,
+// includes with the lookups that found them, the -I directories and the
+// mtime, size and hash of every file read.
+bool write_macro_snapshot(Preprocessor* preprocessor, const char* path);
+// Maps the snapshot preprocess() starts from; NULL unmaps it.
+bool set_macro_snapshot(const char* path);
+// Starts preprocessor from the snapshot as if its prefix header had been
+// included first. A snapshot whose headers changed, whose -I directories
+// differ or whose #include would now find another file includes the prefix
+// header instead; returns false when there is no snapshot to apply.
+bool apply_macro_snapshot(Preprocessor* preprocessor);
+
+// maps an offset in preprocessor->output back to the file and line it came from
+bool source_location(Preprocessor* preprocessor, size_t output_offset, const char** file_path, int* line);
 
 void init_macrolist(Preprocessor* preprocessor);
 void init_includelist(Preprocessor* preprocessor);
-Preprocessor* init_preprocessor();
-Preprocessor* preprocess(char* original_file_path, char* source);
+Preprocessor* init_preprocessor(char* source, size_t length);
+Preprocessor* preprocess(char* original_file_path, char* source, size_t length);
 
 void free_preprocessor(Preprocessor* preprocessor);
-#endif
\ No newline at end of file
+#endif
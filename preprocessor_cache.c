@@ -0,0 +1,394 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include "preprocessor.h"
+
+// A cache entry is named after a hash of the main file's path and contents
+// and of the state preprocessing started from: the -I directories, the
+// macros already defined and any output a snapshot put first. It lists every
+// #include the run made, with a hash of what the file held then and the
+// lookup that found it, followed by the segments and the output. A later run
+// with the same key repeats each lookup and rehashes each file, and uses the
+// output as it is when every lookup finds the same file and none of them
+// changed; otherwise it preprocesses and replaces the entry. Repeating the
+// lookup is what notices a header added earlier on the search path.
+
+#define OUTPUT_CACHE_MAGIC "ZPPC\0\0\0\2"
+#define NO_LOOKUP UINT32_MAX
+
+static char* output_cache_directory = NULL;
+static OutputCacheStats output_cache_stats = {0};
+
+// Followed by the path, then the #include name and the including file's path
+// unless name_length is NO_LOOKUP; each string ends in a NUL.
+typedef struct {
+	uint32_t path_length;
+	uint32_t name_length;
+	uint32_t including_length;
+	uint32_t angled;
+	uint64_t hash;
+	uint64_t start_pos;
+	uint64_t end_pos;
+	uint64_t content_length;
+} CachedInclude;
+
+typedef struct {
+	uint32_t file; // 0 is the main file, i + 1 the i-th include
+	int32_t line;
+	uint64_t output_start;
+} CachedSegment;
+
+typedef struct {
+	char magic[8];
+	uint64_t key;
+	uint32_t include_count;
+	uint32_t segment_count;
+	uint64_t output_length;
+} CacheHeader;
+
+void set_output_cache(const char* directory) {
+	free(output_cache_directory);
+	output_cache_directory = directory ? strdup(directory) : NULL;
+}
+
+const OutputCacheStats* get_output_cache_stats() {
+	return &output_cache_stats;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t length) {
+	const unsigned char* bytes = data;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// 0 stands for a file that could not be read, so a file appearing later
+// invalidates the entry too.
+uint64_t hash_file(const char* path) {
+	struct stat info;
+	if (stat(path, &info) != 0) return 0;
+
+	SourceFile* source = load_source(path);
+	if (!source) return 0;
+	uint64_t hash = hash_bytes(14695981039346656037ull, source->data, source->length);
+	free_source(source);
+	return hash;
+}
+
+static uint64_t output_cache_key(Preprocessor* preprocessor) {
+	uint64_t hash = 14695981039346656037ull;
+	const char* path = preprocessor->file_path ? preprocessor->file_path : "";
+	hash = hash_bytes(hash, path, strlen(path) + 1);
+	hash = hash_bytes(hash, preprocessor->source, preprocessor->limit - preprocessor->source);
+	hash = hash_bytes(hash, preprocessor->output, preprocessor->output_length);
+	for (size_t i = 0; i < get_include_path_count(); i++) {
+		hash = hash_bytes(hash, get_include_path(i), strlen(get_include_path(i)) + 1);
+	}
+
+	MacroList* macros = preprocessor->macros;
+	for (size_t i = 0; i < macros->macro_count; i++) {
+		const Macro* macro = &macros->macro[i];
+		hash = hash_bytes(hash, intern_name(macro->name_id), intern_length(macro->name_id) + 1);
+		hash = hash_bytes(hash, &macro->has_value, sizeof(macro->has_value));
+		hash = hash_bytes(hash, &macro->u.value, sizeof(macro->u.value));
+		if (macro->function_like) {
+			hash = hash_bytes(hash, &macro->param_count, sizeof(macro->param_count));
+			hash = hash_bytes(hash, macro->body_text, strlen(macro->body_text) + 1);
+		}
+	}
+	return hash;
+}
+
+static char* cache_entry_path(uint64_t key) {
+	size_t length = strlen(output_cache_directory) + 32;
+	char* path = malloc(length);
+	if (path) snprintf(path, length, "%s/%016llx.zpp", output_cache_directory, (unsigned long long)key);
+	return path;
+}
+
+// Hashes each distinct path once; a header included twice shares the hash.
+static uint64_t path_hash(const char** paths, const uint64_t* hashes, size_t index) {
+	for (size_t i = 0; i < index; i++) {
+		if (strcmp(paths[i], paths[index]) == 0) return hashes[i];
+	}
+	return hash_file(paths[index]);
+}
+
+static const void* take(const char** cursor, const char* end, size_t size) {
+	if ((size_t)(end - *cursor) < size) return NULL;
+	const void* data = *cursor;
+	*cursor += size;
+	return data;
+}
+
+static const char* take_string(const char** cursor, const char* end, uint32_t length) {
+	const char* text = take(cursor, end, (size_t)length + 1);
+	return text && text[length] == '\0' ? text : NULL;
+}
+
+// Drops the output, segments and includes the run has so far.
+static void clear_output(Preprocessor* preprocessor) {
+	struct IncludeNode* current = preprocessor->includes->head;
+	while (current) {
+		struct IncludeNode* next = current->next;
+		free_include_node(current);
+		current = next;
+	}
+	preprocessor->includes->head = NULL;
+	preprocessor->includes->tail = NULL;
+	preprocessor->includes->include_count = 0;
+	preprocessor->segment_count = 0;
+	preprocessor->output_length = 0;
+}
+
+// The entry is checked in full first; the preprocessor is only replaced by
+// it once every file it names still hashes the same.
+static bool restore_output(Preprocessor* preprocessor, const SourceFile* entry, uint64_t key) {
+	const char* cursor = entry->data;
+	const char* end = entry->data + entry->length;
+
+	const CacheHeader* header = take(&cursor, end, sizeof(CacheHeader));
+	if (!header || memcmp(header->magic, OUTPUT_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->key != key) {
+		return false;
+	}
+
+	uint32_t include_count = header->include_count;
+	CachedInclude* includes = malloc((include_count + 1) * sizeof(CachedInclude));
+	const char** paths = malloc((include_count + 1) * sizeof(char*));
+	const char** names = malloc((include_count + 1) * sizeof(char*));
+	const char** including = malloc((include_count + 1) * sizeof(char*));
+	uint64_t* hashes = malloc((include_count + 1) * sizeof(uint64_t));
+	struct IncludeNode** nodes = malloc((include_count + 1) * sizeof(struct IncludeNode*));
+	bool valid = includes && paths && names && including && hashes && nodes;
+
+	for (uint32_t i = 0; valid && i < include_count; i++) {
+		const void* fields = take(&cursor, end, sizeof(CachedInclude));
+		if (!fields) {
+			valid = false;
+			break;
+		}
+		memcpy(&includes[i], fields, sizeof(CachedInclude));
+
+		paths[i] = take_string(&cursor, end, includes[i].path_length);
+		names[i] = NULL;
+		including[i] = NULL;
+		if (paths[i] && includes[i].name_length != NO_LOOKUP) {
+			names[i] = take_string(&cursor, end, includes[i].name_length);
+			including[i] = names[i] ? take_string(&cursor, end, includes[i].including_length) : NULL;
+			valid = including[i] != NULL;
+		} else {
+			valid = paths[i] != NULL;
+		}
+	}
+
+	const CachedSegment* segments = valid ? take(&cursor, end, header->segment_count * sizeof(CachedSegment)) : NULL;
+	const char* output = segments ? take(&cursor, end, header->output_length) : NULL;
+	valid = output && cursor == end;
+
+	for (uint32_t i = 0; valid && i < include_count; i++) {
+		valid = !names[i] || include_lookup_unchanged(names[i], includes[i].angled, including[i], paths[i]);
+	}
+	for (uint32_t i = 0; valid && i < include_count; i++) {
+		hashes[i] = path_hash(paths, hashes, i);
+		valid = hashes[i] == includes[i].hash;
+	}
+
+	if (valid) {
+		clear_output(preprocessor);
+		for (uint32_t i = 0; valid && i < include_count; i++) {
+			add_include_node(preprocessor->includes, (char*)paths[i], includes[i].start_pos, includes[i].end_pos);
+			nodes[i] = preprocessor->includes->tail;
+			valid = preprocessor->includes->include_count == i + 1 &&
+				(!names[i] || set_include_lookup(nodes[i], names[i], includes[i].name_length, includes[i].angled, including[i]));
+			if (valid) nodes[i]->content_length = includes[i].content_length;
+		}
+	}
+
+	if (valid && header->segment_count > preprocessor->segment_capacity) {
+		SourceSegment* grown = realloc(preprocessor->segments, header->segment_count * sizeof(SourceSegment));
+		valid = grown != NULL;
+		if (grown) {
+			preprocessor->segments = grown;
+			preprocessor->segment_capacity = header->segment_count;
+		}
+	}
+	for (uint32_t i = 0; valid && i < header->segment_count; i++) {
+		CachedSegment segment;
+		memcpy(&segment, &segments[i], sizeof(CachedSegment));
+		if (segment.file > include_count || segment.output_start > header->output_length) {
+			valid = false;
+			break;
+		}
+
+		preprocessor->segments[i] = (SourceSegment){
+			.file_path = segment.file ? nodes[segment.file - 1]->file_path : preprocessor->file_path,
+			.output_start = segment.output_start,
+			.line = segment.line,
+		};
+		preprocessor->segment_count = i + 1;
+	}
+
+	valid = valid && append_output(preprocessor, output, header->output_length);
+
+	free(includes);
+	free(paths);
+	free(names);
+	free(including);
+	free(hashes);
+	free(nodes);
+	if (!valid) return false;
+
+	preprocessor->output[preprocessor->output_length] = '\0';
+	return true;
+}
+
+bool load_cached_output(Preprocessor* preprocessor, uint64_t* key) {
+	if (!output_cache_directory || !preprocessor->macros || !preprocessor->includes) return false;
+
+	*key = output_cache_key(preprocessor);
+	char* path = cache_entry_path(*key);
+	struct stat info;
+	if (!path || stat(path, &info) != 0) {
+		output_cache_stats.misses++;
+		free(path);
+		return false;
+	}
+
+	SourceFile* entry = load_source(path);
+	free(path);
+	bool restored = entry && restore_output(preprocessor, entry, *key);
+	free_source(entry);
+
+	if (!restored) {
+		output_cache_stats.misses++;
+		return false;
+	}
+	output_cache_stats.hits++;
+	return true;
+}
+
+static uint32_t segment_file(Preprocessor* preprocessor, const char* file_path) {
+	uint32_t index = 1;
+	for (struct IncludeNode* node = preprocessor->includes->head; node; node = node->next, index++) {
+		if (node->file_path == file_path) return index;
+	}
+	return 0;
+}
+
+// Written to a temporary name and renamed, so a reader never sees half an entry.
+// A run that reported errors is not stored, since a hit would not repeat them.
+void store_cached_output(Preprocessor* preprocessor, uint64_t key) {
+	if (!output_cache_directory || !preprocessor->output || !preprocessor->includes) return;
+	if (preprocessor->error_count) return;
+
+	char* path = cache_entry_path(key);
+	size_t temporary_length = path ? strlen(path) + 32 : 0;
+	char* temporary = path ? malloc(temporary_length) : NULL;
+	if (!temporary) {
+		free(path);
+		return;
+	}
+	snprintf(temporary, temporary_length, "%s.%ld.tmp", path, (long)getpid());
+
+	FILE* file = fopen(temporary, "wb");
+	const char** paths = malloc((preprocessor->includes->include_count + 1) * sizeof(char*));
+	uint64_t* hashes = malloc((preprocessor->includes->include_count + 1) * sizeof(uint64_t));
+	bool ok = file && paths && hashes;
+
+	CacheHeader header = {
+		.key = key,
+		.include_count = preprocessor->includes->include_count,
+		.segment_count = preprocessor->segment_count,
+		.output_length = preprocessor->output_length,
+	};
+	memcpy(header.magic, OUTPUT_CACHE_MAGIC, sizeof(header.magic));
+	ok = ok && fwrite(&header, sizeof(header), 1, file) == 1;
+
+	size_t index = 0;
+	for (struct IncludeNode* node = preprocessor->includes->head; ok && node; node = node->next, index++) {
+		paths[index] = node->file_path;
+		hashes[index] = path_hash(paths, hashes, index);
+		CachedInclude include = {
+			.path_length = strlen(node->file_path),
+			.name_length = node->name ? strlen(node->name) : NO_LOOKUP,
+			.including_length = node->name ? strlen(node->including_path) : 0,
+			.angled = node->angled,
+			.hash = hashes[index],
+			.start_pos = node->start_pos,
+			.end_pos = node->end_pos,
+			.content_length = node->content_length,
+		};
+		ok = fwrite(&include, sizeof(include), 1, file) == 1 &&
+			fwrite(node->file_path, include.path_length + 1, 1, file) == 1;
+		if (ok && node->name) {
+			ok = fwrite(node->name, include.name_length + 1, 1, file) == 1 &&
+				fwrite(node->including_path, include.including_length + 1, 1, file) == 1;
+		}
+	}
+
+	for (size_t i = 0; ok && i < preprocessor->segment_count; i++) {
+		const SourceSegment* segment = &preprocessor->segments[i];
+		CachedSegment cached = {
+			.file = segment->file_path == preprocessor->file_path ? 0 : segment_file(preprocessor, segment->file_path),
+			.line = segment->line,
+			.output_start = segment->output_start,
+		};
+		ok = fwrite(&cached, sizeof(cached), 1, file) == 1;
+	}
+	ok = ok && fwrite(preprocessor->output, 1, preprocessor->output_length, file) == preprocessor->output_length;
+
+	if (file && fclose(file) != 0) ok = false;
+	if (ok && rename(temporary, path) == 0) {
+		output_cache_stats.stores++;
+	} else {
+		if (file) fprintf(stderr, "Error: Failed to write preprocessor cache entry %s\n", path);
+		unlink(temporary);
+	}
+
+	free(paths);
+	free(hashes);
+	free(temporary);
+	free(path);
+}
+
+// Make escapes spaces with a backslash and '$' by doubling it.
+static void write_dependency_path(FILE* file, const char* path) {
+	for (; *path; path++) {
+		if (*path == ' ' || *path == '#') fputc('\\', file);
+		if (*path == '$') fputc('$', file);
+		fputc(*path, file);
+	}
+}
+
+bool write_dependency_file(Preprocessor* preprocessor, const char* target, const char* path) {
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Error: Failed to open dependency file %s\n", path);
+		return false;
+	}
+
+	write_dependency_path(file, target);
+	fputs(":", file);
+	if (preprocessor->file_path) {
+		fputc(' ', file);
+		write_dependency_path(file, preprocessor->file_path);
+	}
+
+	for (struct IncludeNode* node = preprocessor->includes->head; node; node = node->next) {
+		bool repeated = preprocessor->file_path && strcmp(node->file_path, preprocessor->file_path) == 0;
+		for (struct IncludeNode* earlier = node->prev; earlier && !repeated; earlier = earlier->prev) {
+			repeated = strcmp(earlier->file_path, node->file_path) == 0;
+		}
+		if (repeated) continue;
+
+		fputs(" \\\n  ", file);
+		write_dependency_path(file, node->file_path);
+	}
+	fputc('\n', file);
+
+	if (fclose(file) != 0) {
+		fprintf(stderr, "Error: Failed to write dependency file %s\n", path);
+		return false;
+	}
+	return true;
+}
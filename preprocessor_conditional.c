@@ -0,0 +1,356 @@
+#include "preprocessor.h"
+
+// #if and #elif take an integer constant expression with the usual C
+// operators. An identifier evaluates to the value of its integer macro and to
+// 0 otherwise, and `defined NAME` or `defined(NAME)` to whether it is defined.
+// Function-like macros are not expanded here. Every macro looked at goes
+// through use_macro(), so a recorded include is replayed only while those
+// macros keep their state.
+
+typedef struct {
+	Preprocessor* preprocessor;
+	const char* p;
+	const char* end;
+	int unevaluated; // > 0 on the side of &&, || or ?: that is not taken
+	bool error;
+} Expression;
+
+typedef struct {
+	const char* text;
+	int precedence;
+} BinaryOperator;
+
+// two-character operators come first so the longest match wins
+static const BinaryOperator binary_operators[] = {
+	{"||", 1}, {"&&", 2}, {"==", 6}, {"!=", 6}, {"<=", 7}, {">=", 7}, {"<<", 8}, {">>", 8},
+	{"|", 3}, {"^", 4}, {"&", 5}, {"<", 7}, {">", 7}, {"+", 9}, {"-", 9}, {"*", 10}, {"/", 10}, {"%", 10},
+};
+
+static long long parse_ternary(Expression* expression);
+
+static inline bool is_word_start(char c) {
+	return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || c == '_';
+}
+
+static inline bool is_word_char(char c) {
+	return is_word_start(c) || (unsigned char)(c - '0') <= 9;
+}
+
+static void skip_expression_blanks(Expression* expression) {
+	while (expression->p < expression->end &&
+		(*expression->p == ' ' || *expression->p == '\t' || *expression->p == '\r')) {
+		expression->p++;
+	}
+}
+
+static bool accept(Expression* expression, char c) {
+	skip_expression_blanks(expression);
+	if (expression->p == expression->end || *expression->p != c) return false;
+	expression->p++;
+	return true;
+}
+
+static uint32_t parse_name(Expression* expression) {
+	skip_expression_blanks(expression);
+	const char* name = expression->p;
+	while (expression->p < expression->end && is_word_char(*expression->p)) expression->p++;
+	if (expression->p == name || !is_word_start(*name)) {
+		expression->error = true;
+		return INTERN_NONE;
+	}
+	return intern(name, expression->p - name);
+}
+
+// decimal, 0x hex or 0 octal, with any u/l suffix ignored
+static long long parse_number(Expression* expression) {
+	const char* p = expression->p;
+	const char* end = expression->end;
+	unsigned long long value = 0;
+	unsigned base = 10;
+
+	if (p + 1 < end && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		base = 16;
+		p += 2;
+	} else if (*p == '0') {
+		base = 8;
+	}
+
+	for (; p < end; p++) {
+		unsigned digit;
+		if ((unsigned char)(*p - '0') <= 9) {
+			digit = *p - '0';
+		} else if ((unsigned char)((*p | 0x20) - 'a') < 6) {
+			digit = (*p | 0x20) - 'a' + 10;
+		} else {
+			break;
+		}
+		if (digit >= base) break;
+		value = value * base + digit;
+	}
+	while (p < end && ((*p | 0x20) == 'u' || (*p | 0x20) == 'l')) p++;
+
+	if (p < end && is_word_char(*p)) expression->error = true;
+	expression->p = p;
+	return (long long)value;
+}
+
+static long long parse_character(Expression* expression) {
+	const char* p = expression->p + 1;
+	const char* end = expression->end;
+	long long value = 0;
+
+	if (p < end && *p == '\\' && p + 1 < end) {
+		switch (p[1]) {
+			case 'n': value = '\n'; break;
+			case 't': value = '\t'; break;
+			case 'r': value = '\r'; break;
+			case '0': value = '\0'; break;
+			default: value = (unsigned char)p[1]; break;
+		}
+		p += 2;
+	} else if (p < end) {
+		value = (unsigned char)*p++;
+	}
+
+	if (p >= end || *p != '\'') {
+		expression->error = true;
+		return 0;
+	}
+	expression->p = p + 1;
+	return value;
+}
+
+static long long parse_unary(Expression* expression) {
+	skip_expression_blanks(expression);
+	if (expression->p == expression->end) {
+		expression->error = true;
+		return 0;
+	}
+
+	char c = *expression->p;
+	if (c == '(') {
+		expression->p++;
+		long long value = parse_ternary(expression);
+		if (!accept(expression, ')')) expression->error = true;
+		return value;
+	}
+	if (c == '!' || c == '-' || c == '+' || c == '~') {
+		expression->p++;
+		long long operand = parse_unary(expression);
+		if (c == '!') return !operand;
+		if (c == '-') return (long long)(0ULL - (unsigned long long)operand);
+		if (c == '~') return ~operand;
+		return operand;
+	}
+	if ((unsigned char)(c - '0') <= 9) return parse_number(expression);
+	if (c == '\'') return parse_character(expression);
+
+	if (is_word_start(c)) {
+		const char* word = expression->p;
+		while (expression->p < expression->end && is_word_char(*expression->p)) expression->p++;
+
+		if (expression->p - word == 7 && memcmp(word, "defined", 7) == 0) {
+			bool parenthesized = accept(expression, '(');
+			uint32_t name_id = parse_name(expression);
+			if (parenthesized && !accept(expression, ')')) expression->error = true;
+			return name_id != INTERN_NONE && use_macro(expression->preprocessor, name_id) != NULL;
+		}
+
+		Macro* macro = use_macro(expression->preprocessor, intern(word, expression->p - word));
+		return macro && macro->has_value && !macro->function_like ? macro->u.value : 0;
+	}
+
+	expression->error = true;
+	return 0;
+}
+
+static const BinaryOperator* find_operator(Expression* expression) {
+	skip_expression_blanks(expression);
+	size_t available = expression->end - expression->p;
+	for (size_t i = 0; i < sizeof(binary_operators) / sizeof(binary_operators[0]); i++) {
+		size_t length = strlen(binary_operators[i].text);
+		if (length <= available && memcmp(expression->p, binary_operators[i].text, length) == 0) {
+			return &binary_operators[i];
+		}
+	}
+	return NULL;
+}
+
+static long long apply_operator(Expression* expression, const char* op, long long left, long long right) {
+	unsigned long long a = left;
+	unsigned long long b = right;
+
+	switch (op[0]) {
+		case '|': return op[1] ? left || right : left | right;
+		case '&': return op[1] ? left && right : left & right;
+		case '^': return left ^ right;
+		case '=': return left == right;
+		case '!': return left != right;
+		case '<':
+			if (op[1] == '<') return (long long)(a << (b & 63));
+			return op[1] ? left <= right : left < right;
+		case '>':
+			if (op[1] == '>') return left >> (b & 63);
+			return op[1] ? left >= right : left > right;
+		case '+': return (long long)(a + b);
+		case '-': return (long long)(a - b);
+		case '*': return (long long)(a * b);
+		default:
+			if (right == 0) {
+				if (!expression->unevaluated) {
+					fprintf(stderr, "Error: Division by zero in #if on line %d\n", expression->preprocessor->line);
+					expression->preprocessor->error_count++;
+				}
+				return 0;
+			}
+			if (right == -1) return op[0] == '/' ? (long long)(0ULL - a) : 0;
+			return op[0] == '/' ? left / right : left % right;
+	}
+}
+
+static long long parse_binary(Expression* expression, int min_precedence) {
+	long long left = parse_unary(expression);
+
+	for (;;) {
+		const BinaryOperator* op = find_operator(expression);
+		if (!op || op->precedence < min_precedence) return left;
+		expression->p += strlen(op->text);
+
+		bool short_circuit = (op->precedence == 2 && !left) || (op->precedence == 1 && left);
+		if (short_circuit) expression->unevaluated++;
+		long long right = parse_binary(expression, op->precedence + 1);
+		if (short_circuit) expression->unevaluated--;
+
+		left = apply_operator(expression, op->text, left, right);
+	}
+}
+
+static long long parse_ternary(Expression* expression) {
+	long long condition = parse_binary(expression, 1);
+	if (!accept(expression, '?')) return condition;
+
+	if (!condition) expression->unevaluated++;
+	long long if_true = parse_ternary(expression);
+	if (!condition) expression->unevaluated--;
+
+	if (!accept(expression, ':')) {
+		expression->error = true;
+		return 0;
+	}
+
+	if (condition) expression->unevaluated++;
+	long long if_false = parse_ternary(expression);
+	if (condition) expression->unevaluated--;
+
+	return condition ? if_true : if_false;
+}
+
+// Evaluates the rest of the directive line; a malformed expression is false.
+static bool evaluate_condition(Preprocessor* preprocessor) {
+	const char* end = memchr(preprocessor->end, '\n', preprocessor->limit - preprocessor->end);
+	Expression expression = {
+		.preprocessor = preprocessor,
+		.p = preprocessor->end,
+		.end = end ? end : preprocessor->limit,
+	};
+
+	long long value = parse_ternary(&expression);
+	skip_expression_blanks(&expression);
+	if (expression.error || expression.p != expression.end) {
+		fprintf(stderr, "Error: Invalid #if expression on line %d\n", preprocessor->line);
+		preprocessor->error_count++;
+		return false;
+	}
+	return value != 0;
+}
+
+static bool is_defined(Preprocessor* preprocessor) {
+	const char* end = memchr(preprocessor->end, '\n', preprocessor->limit - preprocessor->end);
+	Expression expression = {
+		.preprocessor = preprocessor,
+		.p = preprocessor->end,
+		.end = end ? end : preprocessor->limit,
+	};
+
+	uint32_t name_id = parse_name(&expression);
+	if (name_id == INTERN_NONE) {
+		fprintf(stderr, "Error: Missing macro name on line %d\n", preprocessor->line);
+		preprocessor->error_count++;
+		return false;
+	}
+	return use_macro(preprocessor, name_id) != NULL;
+}
+
+static bool push_conditional(Preprocessor* preprocessor, bool taken) {
+	if (preprocessor->conditional_count == preprocessor->conditional_capacity) {
+		size_t new_capacity = preprocessor->conditional_capacity ? preprocessor->conditional_capacity * 2 : 16;
+		ConditionalFrame* conditionals = realloc(preprocessor->conditionals, new_capacity * sizeof(ConditionalFrame));
+		if (!conditionals) return false;
+		preprocessor->conditionals = conditionals;
+		preprocessor->conditional_capacity = new_capacity;
+	}
+
+	preprocessor->conditionals[preprocessor->conditional_count++] = (ConditionalFrame){
+		.line = preprocessor->line,
+		.taken = taken,
+		.seen_else = false,
+	};
+	return true;
+}
+
+bool parse_conditional(Preprocessor* preprocessor, const char* directive) {
+	if (strcmp(directive, "if") == 0 || strcmp(directive, "ifdef") == 0 || strcmp(directive, "ifndef") == 0) {
+		bool active;
+		if (directive[2] == '\0') {
+			active = evaluate_condition(preprocessor);
+		} else {
+			active = is_defined(preprocessor) == (directive[2] == 'd');
+		}
+
+		if (!push_conditional(preprocessor, active)) {
+			fprintf(stderr, "Error: Failed to allocate space for #%s on line %d\n", directive, preprocessor->line);
+			preprocessor->error_count++;
+			return false;
+		}
+		return !active;
+	}
+
+	if (preprocessor->conditional_count == preprocessor->conditional_base) {
+		fprintf(stderr, "Error: #%s without #if on line %d\n", directive, preprocessor->line);
+		preprocessor->error_count++;
+		return false;
+	}
+	ConditionalFrame* frame = &preprocessor->conditionals[preprocessor->conditional_count - 1];
+
+	if (strcmp(directive, "endif") == 0) {
+		preprocessor->conditional_count--;
+		return false;
+	}
+
+	if (frame->seen_else) {
+		fprintf(stderr, "Error: #%s after #else on line %d\n", directive, preprocessor->line);
+		preprocessor->error_count++;
+		return true;
+	}
+
+	if (strcmp(directive, "else") == 0) {
+		frame->seen_else = true;
+		bool inactive = frame->taken;
+		frame->taken = true;
+		return inactive;
+	}
+
+	// #elif: once a branch has been taken the condition is not even looked at
+	if (frame->taken) return true;
+	frame->taken = evaluate_condition(preprocessor);
+	return !frame->taken;
+}
+
+void end_conditionals(Preprocessor* preprocessor) {
+	while (preprocessor->conditional_count > preprocessor->conditional_base) {
+		const ConditionalFrame* frame = &preprocessor->conditionals[--preprocessor->conditional_count];
+		fprintf(stderr, "Error: Unterminated #if from line %d in %s\n", frame->line,
+			preprocessor->file_path ? preprocessor->file_path : "<input>");
+		preprocessor->error_count++;
+	}
+}
@@ -0,0 +1,284 @@
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "preprocessor.h"
+
+// Include names are resolved against the including file's directory and
+// the -I directories. Every probe is answered from a per-process cache:
+//
+// - A plain name is looked up in a listing of its directory, read with
+//   readdir() the first time the directory is probed. Misses, which are
+//   most probes when there are many -I directories, cost no syscall at all.
+// - A name with a '/' in it is stat()ed once per candidate path and the
+//   answer, found or not, is kept.
+// - realpath(), which the include cache keys on, is kept per path as well.
+//
+// Files and directories are assumed not to change while the process runs.
+
+static char* include_paths[INCLUDE_PATHS];
+static size_t include_path_count = 0;
+static bool resolver_caching = true;
+static IncludeResolverStats resolver_stats = {0};
+
+typedef struct DirectoryListing {
+	char* directory;       // as it prefixes a candidate, "" or ending in '/'
+	bool readable;
+	char** names;
+	size_t name_count;
+	uint32_t* slots;       // open addressing over names, index + 1
+	size_t slot_capacity;
+	struct DirectoryListing* next;
+} DirectoryListing;
+
+// One candidate path: whether it exists and, once asked, its realpath().
+typedef struct PathEntry {
+	char* path;
+	int exists;            // -1 not probed yet, else 0 or 1
+	bool canonical_known;
+	char* canonical;       // NULL when realpath() failed
+	struct PathEntry* next;
+} PathEntry;
+
+static DirectoryListing* listings[RESOLVER_CACHE_SIZE];
+static PathEntry* paths[RESOLVER_CACHE_SIZE];
+
+static uint32_t hash_text(const char* text, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+	}
+	return hash;
+}
+
+bool add_include_path(const char* directory) {
+	if (include_path_count == INCLUDE_PATHS) {
+		fprintf(stderr, "Error: More than %d include directories\n", INCLUDE_PATHS);
+		return false;
+	}
+
+	// stored with a trailing '/' so a candidate is the directory followed by the name
+	size_t length = strlen(directory);
+	bool slash = length > 0 && directory[length - 1] == '/';
+	char* path = malloc(length + 2);
+	if (!path) return false;
+	memcpy(path, directory, length);
+	strcpy(path + length, slash ? "" : "/");
+
+	include_paths[include_path_count++] = path;
+	return true;
+}
+
+size_t get_include_path_count() {
+	return include_path_count;
+}
+
+const char* get_include_path(size_t index) {
+	return index < include_path_count ? include_paths[index] : NULL;
+}
+
+void set_include_resolver_caching(bool enabled) {
+	resolver_caching = enabled;
+}
+
+const IncludeResolverStats* get_include_resolver_stats() {
+	return &resolver_stats;
+}
+
+static bool add_listing_name(DirectoryListing* listing, const char* name) {
+	if ((listing->name_count + 1) * 2 > listing->slot_capacity) {
+		size_t new_capacity = listing->slot_capacity ? listing->slot_capacity * 2 : 64;
+		uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+		char** names = realloc(listing->names, (new_capacity / 2) * sizeof(char*));
+		if (!slots || !names) {
+			free(slots);
+			if (names) listing->names = names;
+			return false;
+		}
+
+		for (size_t i = 0; i < listing->name_count; i++) {
+			size_t idx = hash_text(names[i], strlen(names[i])) & (new_capacity - 1);
+			while (slots[idx]) idx = (idx + 1) & (new_capacity - 1);
+			slots[idx] = i + 1;
+		}
+		free(listing->slots);
+		listing->slots = slots;
+		listing->names = names;
+		listing->slot_capacity = new_capacity;
+	}
+
+	char* copy = strdup(name);
+	if (!copy) return false;
+
+	size_t idx = hash_text(name, strlen(name)) & (listing->slot_capacity - 1);
+	while (listing->slots[idx]) idx = (idx + 1) & (listing->slot_capacity - 1);
+	listing->names[listing->name_count++] = copy;
+	listing->slots[idx] = listing->name_count;
+	return true;
+}
+
+static bool listing_contains(const DirectoryListing* listing, const char* name, size_t length) {
+	if (!listing->slot_capacity) return false;
+
+	size_t mask = listing->slot_capacity - 1;
+	for (size_t idx = hash_text(name, length) & mask; listing->slots[idx]; idx = (idx + 1) & mask) {
+		const char* candidate = listing->names[listing->slots[idx] - 1];
+		if (strncmp(candidate, name, length) == 0 && candidate[length] == '\0') return true;
+	}
+	return false;
+}
+
+static DirectoryListing* find_listing(const char* directory, size_t length) {
+	size_t bucket = hash_text(directory, length) & (RESOLVER_CACHE_SIZE - 1);
+	for (DirectoryListing* listing = listings[bucket]; listing; listing = listing->next) {
+		if (strncmp(listing->directory, directory, length) == 0 && listing->directory[length] == '\0') return listing;
+	}
+
+	DirectoryListing* listing = calloc(1, sizeof(DirectoryListing));
+	if (!listing) return NULL;
+	listing->directory = strndup(directory, length);
+	if (!listing->directory) {
+		free(listing);
+		return NULL;
+	}
+
+	// a listing that cannot be read in full falls back to stat() per probe
+	resolver_stats.directory_reads++;
+	DIR* handle = opendir(length ? listing->directory : ".");
+	if (handle) {
+		listing->readable = true;
+		for (struct dirent* entry = readdir(handle); entry; entry = readdir(handle)) {
+			if (!add_listing_name(listing, entry->d_name)) {
+				listing->readable = false;
+				break;
+			}
+		}
+		closedir(handle);
+	}
+
+	listing->next = listings[bucket];
+	listings[bucket] = listing;
+	return listing;
+}
+
+static PathEntry* find_path(const char* path) {
+	size_t length = strlen(path);
+	size_t bucket = hash_text(path, length) & (RESOLVER_CACHE_SIZE - 1);
+	for (PathEntry* entry = paths[bucket]; entry; entry = entry->next) {
+		if (strcmp(entry->path, path) == 0) return entry;
+	}
+
+	PathEntry* entry = calloc(1, sizeof(PathEntry));
+	if (!entry) return NULL;
+	entry->path = strdup(path);
+	if (!entry->path) {
+		free(entry);
+		return NULL;
+	}
+	entry->exists = -1;
+	entry->next = paths[bucket];
+	paths[bucket] = entry;
+	return entry;
+}
+
+static bool stat_exists(const char* path) {
+	struct stat info;
+	resolver_stats.stat_calls++;
+	return stat(path, &info) == 0;
+}
+
+// Does directory + name exist? candidate holds that path.
+static bool probe(const char* directory, size_t directory_length, const char* name, size_t length, const char* candidate) {
+	resolver_stats.probes++;
+	if (!resolver_caching) return stat_exists(candidate);
+
+	if (!memchr(name, '/', length)) {
+		DirectoryListing* listing = find_listing(directory, directory_length);
+		if (listing && listing->readable) return listing_contains(listing, name, length);
+	}
+
+	PathEntry* entry = find_path(candidate);
+	if (!entry) return stat_exists(candidate);
+	if (entry->exists < 0) entry->exists = stat_exists(candidate);
+	return entry->exists;
+}
+
+static char* join_path(const char* directory, size_t directory_length, const char* name, size_t length) {
+	char* path = malloc(directory_length + length + 1);
+	if (!path) return NULL;
+	memcpy(path, directory, directory_length);
+	memcpy(path + directory_length, name, length);
+	path[directory_length + length] = '\0';
+	return path;
+}
+
+// Quoted names are searched for next to the including file and then in the
+// -I directories; angled names the other way round. An absolute name, or one
+// found nowhere, comes back as it would be next to the including file, so
+// the error names that path.
+char* resolve_include_path(const char* including_path, const char* name, int length, bool angled) {
+	resolver_stats.lookups++;
+	const char* slash = including_path ? strrchr(including_path, '/') : NULL;
+	size_t local_length = slash ? (size_t)(slash - including_path + 1) : 0;
+	if (name[0] == '/') return strndup(name, length);
+
+	char* local = join_path(including_path, local_length, name, length);
+	if (!local) return NULL;
+	if (!angled && probe(including_path, local_length, name, length, local)) return local;
+
+	for (size_t i = 0; i < include_path_count; i++) {
+		size_t directory_length = strlen(include_paths[i]);
+		char* candidate = join_path(include_paths[i], directory_length, name, length);
+		if (!candidate) break;
+		if (probe(include_paths[i], directory_length, name, length, candidate)) {
+			free(local);
+			return candidate;
+		}
+		free(candidate);
+	}
+
+	if (angled) probe(including_path, local_length, name, length, local);
+	return local;
+}
+
+char* canonical_include_path(const char* path) {
+	PathEntry* entry = resolver_caching ? find_path(path) : NULL;
+	if (entry && entry->canonical_known) {
+		resolver_stats.realpath_hits++;
+		return entry->canonical ? strdup(entry->canonical) : NULL;
+	}
+
+	resolver_stats.realpath_calls++;
+	char* canonical = realpath(path, NULL);
+	if (entry) {
+		entry->canonical_known = true;
+		entry->canonical = canonical ? strdup(canonical) : NULL;
+	}
+	return canonical;
+}
+
+void free_include_resolver() {
+	for (size_t i = 0; i < RESOLVER_CACHE_SIZE; i++) {
+		for (DirectoryListing* listing = listings[i]; listing; ) {
+			DirectoryListing* next = listing->next;
+			for (size_t k = 0; k < listing->name_count; k++) free(listing->names[k]);
+			free(listing->names);
+			free(listing->slots);
+			free(listing->directory);
+			free(listing);
+			listing = next;
+		}
+		listings[i] = NULL;
+
+		for (PathEntry* entry = paths[i]; entry; ) {
+			PathEntry* next = entry->next;
+			free(entry->path);
+			free(entry->canonical);
+			free(entry);
+			entry = next;
+		}
+		paths[i] = NULL;
+	}
+
+	for (size_t i = 0; i < include_path_count; i++) free(include_paths[i]);
+	include_path_count = 0;
+}
@@ -0,0 +1,566 @@
+#include "preprocessor.h"
+
+// Function-like macros are expanded on tokens rather than text. A call
+// pre-expands its arguments, substitutes them into the body and rescans
+// the result. Every token carries a hide-set, and a name is never expanded
+// by a macro already in its hide-set, which is what stops recursion. The
+// rescan covers the substituted body only: a result that ends in a macro
+// name does not pick up a '(' that follows the call in the source.
+//
+// Calls written in the source, including calls nested in their arguments,
+// are memoized on the macro and the exact argument tokens. The memo is
+// dropped whenever a macro is defined. Calls made while a body is rescanned
+// are not memoized. They carry hide-sets, so they seldom repeat exactly, and
+// their results can be as large as the whole expansion.
+
+static bool memoize_expansions = true;
+
+void set_macro_memoization(bool enabled) {
+	memoize_expansions = enabled;
+}
+
+typedef struct {
+	PPToken* tokens;
+	size_t count;
+	size_t capacity;
+} PPTokenList;
+
+typedef struct {
+	size_t start;
+	size_t end;
+} ArgumentRange;
+
+static bool push_token(PPTokenList* list, PPToken token) {
+	if (list->count == list->capacity) {
+		size_t new_capacity = list->capacity ? list->capacity * 2 : 16;
+		PPToken* tokens = realloc(list->tokens, new_capacity * sizeof(PPToken));
+		if (!tokens) return false;
+		list->tokens = tokens;
+		list->capacity = new_capacity;
+	}
+	list->tokens[list->count++] = token;
+	return true;
+}
+
+static inline bool is_word_start(char c) {
+	return (unsigned char)((c | 0x20) - 'a') <= 'z' - 'a' || c == '_';
+}
+
+static inline bool is_word_char(char c) {
+	return is_word_start(c) || (unsigned char)(c - '0') <= 9;
+}
+
+static inline bool is_blank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool is_text(const PPToken* token, char c) {
+	return token->kind == PP_TEXT && token->length == 1 && token->u.text[0] == c;
+}
+
+// Splits p..end into tokens. With `call` set, p is at '(' and the scan stops
+// after the matching ')', treating newlines as blanks; NULL means the call
+// was never closed. Otherwise the scan stops at the end of the line.
+static const char* tokenize(const char* p, const char* end, PPTokenList* list, bool call) {
+	int depth = 0;
+	bool space = false;
+
+	while (p < end && *p != '\0') {
+		char c = *p;
+		if (is_blank(c) || (call && c == '\n')) {
+			space = true;
+			p++;
+			continue;
+		}
+		if (c == '\n') break;
+
+		PPToken token = { .space_before = space, .hide = 0 };
+		const char* start = p;
+		space = false;
+
+		if (is_word_start(c)) {
+			while (p < end && is_word_char(*p)) p++;
+			token.kind = PP_WORD;
+			token.u.id = intern(start, p - start);
+		} else {
+			if (c == '(' || c == ')' || c == ',') {
+				p++;
+			} else {
+				while (p < end && *p != '\0' && *p != '\n' && !is_blank(*p) && !is_word_start(*p) &&
+					*p != '(' && *p != ')' && *p != ',') {
+					p++;
+				}
+			}
+			token.kind = PP_TEXT;
+			token.u.text = start;
+			token.length = p - start;
+		}
+		if (!push_token(list, token)) return NULL;
+
+		if (call && c == '(') {
+			depth++;
+		} else if (call && c == ')' && --depth == 0) {
+			return p;
+		}
+	}
+	return call ? NULL : p;
+}
+
+bool parse_macro_body(Macro* macro, const char* params, const char* params_end, const char* body, const char* body_end) {
+	uint32_t* param_ids = NULL;
+	int param_count = 0;
+
+	const char* p = params;
+	while (p < params_end) {
+		while (p < params_end && is_blank(*p)) p++;
+		if (p == params_end && param_count == 0) break;
+
+		const char* name = p;
+		while (p < params_end && is_word_char(*p)) p++;
+		if (p == name || !is_word_start(*name)) {
+			free(param_ids);
+			return false;
+		}
+
+		uint32_t* grown = realloc(param_ids, (param_count + 1) * sizeof(uint32_t));
+		if (!grown) {
+			free(param_ids);
+			return false;
+		}
+		param_ids = grown;
+		param_ids[param_count++] = intern(name, p - name);
+
+		while (p < params_end && is_blank(*p)) p++;
+		if (p < params_end && *p != ',') {
+			free(param_ids);
+			return false;
+		}
+		if (p < params_end) p++;
+	}
+
+	macro->body_text = strndup(body, body_end - body);
+	PPTokenList list = {0};
+	if (!macro->body_text || !tokenize(macro->body_text, macro->body_text + (body_end - body), &list, false)) {
+		free(macro->body_text);
+		free(list.tokens);
+		free(param_ids);
+		return false;
+	}
+
+	for (size_t i = 0; i < list.count; i++) {
+		if (list.tokens[i].kind != PP_WORD) continue;
+		for (int k = 0; k < param_count; k++) {
+			if (list.tokens[i].u.id == param_ids[k]) {
+				list.tokens[i].kind = PP_PARAM;
+				list.tokens[i].u.id = k;
+				break;
+			}
+		}
+	}
+	free(param_ids);
+
+	macro->function_like = true;
+	macro->param_count = param_count;
+	macro->body = list.tokens;
+	macro->body_length = list.count;
+	return true;
+}
+
+static bool hide_set_contains(const MacroExpander* expander, uint32_t set, uint32_t macro_id) {
+	while (set) {
+		const HideSetNode* node = &expander->nodes[set - 1];
+		if (node->macro_id == macro_id) return true;
+		set = node->parent;
+	}
+	return false;
+}
+
+static size_t hide_set_slot(uint32_t parent, uint32_t macro_id, size_t capacity) {
+	return ((parent * 2654435761u) ^ (macro_id * 40503u)) & (capacity - 1);
+}
+
+static bool grow_hide_set_slots(MacroExpander* expander) {
+	size_t new_capacity = expander->node_slot_capacity ? expander->node_slot_capacity * 2 : 256;
+	uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+	if (!slots) return false;
+
+	for (size_t i = 0; i < expander->node_count; i++) {
+		const HideSetNode* node = &expander->nodes[i];
+		size_t idx = hide_set_slot(node->parent, node->macro_id, new_capacity);
+		while (slots[idx]) idx = (idx + 1) & (new_capacity - 1);
+		slots[idx] = i + 1;
+	}
+
+	free(expander->node_slots);
+	expander->node_slots = slots;
+	expander->node_slot_capacity = new_capacity;
+	return true;
+}
+
+// set ∪ {macro_id}, as the index of the one node chain that spells it
+static bool hide_set_add(MacroExpander* expander, uint32_t set, uint32_t macro_id, uint32_t* result) {
+	if (hide_set_contains(expander, set, macro_id)) {
+		*result = set;
+		return true;
+	}
+
+	if ((expander->node_count + 1) * 2 > expander->node_slot_capacity && !grow_hide_set_slots(expander)) return false;
+
+	size_t mask = expander->node_slot_capacity - 1;
+	size_t idx = hide_set_slot(set, macro_id, expander->node_slot_capacity);
+	for (; expander->node_slots[idx]; idx = (idx + 1) & mask) {
+		const HideSetNode* node = &expander->nodes[expander->node_slots[idx] - 1];
+		if (node->parent == set && node->macro_id == macro_id) {
+			*result = expander->node_slots[idx];
+			return true;
+		}
+	}
+
+	if (expander->node_count == expander->node_capacity) {
+		size_t new_capacity = expander->node_capacity ? expander->node_capacity * 2 : 64;
+		HideSetNode* nodes = realloc(expander->nodes, new_capacity * sizeof(HideSetNode));
+		if (!nodes) return false;
+		expander->nodes = nodes;
+		expander->node_capacity = new_capacity;
+	}
+
+	expander->nodes[expander->node_count++] = (HideSetNode){ .macro_id = macro_id, .parent = set };
+	expander->node_slots[idx] = expander->node_count;
+	*result = expander->node_count;
+	return true;
+}
+
+static bool append_key(MacroExpander* expander, size_t* length, const void* data, size_t size) {
+	if (*length + size > expander->key_capacity) {
+		size_t new_capacity = expander->key_capacity ? expander->key_capacity * 2 : 256;
+		while (new_capacity < *length + size) new_capacity *= 2;
+
+		unsigned char* key = realloc(expander->key, new_capacity);
+		if (!key) return false;
+		expander->key = key;
+		expander->key_capacity = new_capacity;
+	}
+	memcpy(expander->key + *length, data, size);
+	*length += size;
+	return true;
+}
+
+static bool append_key_token(MacroExpander* expander, size_t* length, const PPToken* token) {
+	unsigned char header[2] = { token->kind, token->space_before };
+	if (!append_key(expander, length, header, sizeof(header))) return false;
+	if (!append_key(expander, length, &token->hide, sizeof(token->hide))) return false;
+
+	switch (token->kind) {
+		case PP_TEXT:
+			return append_key(expander, length, &token->length, sizeof(token->length)) &&
+				append_key(expander, length, token->u.text, token->length);
+		case PP_NUMBER:
+			return append_key(expander, length, &token->u.value, sizeof(token->u.value));
+		default:
+			return append_key(expander, length, &token->u.id, sizeof(token->u.id));
+	}
+}
+
+// Builds the memo key for a call in expander->key and returns its length, 0 on failure.
+static size_t build_memo_key(MacroExpander* expander, const Macro* macro, const PPToken* name, const PPToken* input,
+		const ArgumentRange* arguments, int argument_count) {
+	size_t length = 0;
+	bool ok = append_key(expander, &length, &macro->name_id, sizeof(macro->name_id)) &&
+		append_key(expander, &length, &name->hide, sizeof(name->hide)) &&
+		append_key(expander, &length, &argument_count, sizeof(argument_count));
+
+	for (int i = 0; ok && i < argument_count; i++) {
+		uint32_t count = arguments[i].end - arguments[i].start;
+		ok = append_key(expander, &length, &count, sizeof(count));
+		for (size_t t = arguments[i].start; ok && t < arguments[i].end; t++) {
+			ok = append_key_token(expander, &length, &input[t]);
+		}
+	}
+	return ok ? length : 0;
+}
+
+static uint64_t hash_key(const unsigned char* key, size_t length) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ key[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static MacroMemo* find_memo(MacroExpander* expander, const unsigned char* key, size_t length, uint64_t hash) {
+	if (!expander->memo) return NULL;
+
+	size_t mask = expander->memo_capacity - 1;
+	for (size_t idx = hash & mask; ; idx = (idx + 1) & mask) {
+		MacroMemo* memo = &expander->memo[idx];
+		if (!memo->key) return memo;
+		if (memo->hash == hash && memo->key_length == length && memcmp(memo->key, key, length) == 0) return memo;
+	}
+}
+
+// Empties the table but keeps it, since a file that defines macros between
+// calls would otherwise reallocate it after every #define.
+static void clear_memo(MacroExpander* expander) {
+	if (!expander->memo_count) return;
+
+	for (size_t i = 0; i < expander->memo_capacity; i++) {
+		free(expander->memo[i].key);
+		free(expander->memo[i].tokens);
+	}
+	memset(expander->memo, 0, expander->memo_capacity * sizeof(MacroMemo));
+	expander->memo_count = 0;
+}
+
+static bool grow_memo(MacroExpander* expander) {
+	size_t new_capacity = expander->memo_capacity ? expander->memo_capacity * 2 : MACRO_MEMO_SIZE;
+	MacroMemo* memo = calloc(new_capacity, sizeof(MacroMemo));
+	if (!memo) return false;
+
+	for (size_t i = 0; i < expander->memo_capacity; i++) {
+		MacroMemo* entry = &expander->memo[i];
+		if (!entry->key) continue;
+
+		size_t idx = entry->hash & (new_capacity - 1);
+		while (memo[idx].key) idx = (idx + 1) & (new_capacity - 1);
+		memo[idx] = *entry;
+	}
+
+	free(expander->memo);
+	expander->memo = memo;
+	expander->memo_capacity = new_capacity;
+	return true;
+}
+
+// Takes ownership of key; the tokens are copied.
+static void store_memo(MacroExpander* expander, unsigned char* key, size_t length, uint64_t hash,
+		const PPTokenList* result) {
+	PPToken* tokens = malloc((result->count ? result->count : 1) * sizeof(PPToken));
+	if (!tokens || ((expander->memo_count + 1) * 2 > expander->memo_capacity && !grow_memo(expander))) {
+		free(tokens);
+		free(key);
+		return;
+	}
+	memcpy(tokens, result->tokens, result->count * sizeof(PPToken));
+
+	MacroMemo* memo = find_memo(expander, key, length, hash);
+	memo->hash = hash;
+	memo->key = key;
+	memo->key_length = length;
+	memo->tokens = tokens;
+	memo->token_count = result->count;
+	expander->memo_count++;
+}
+
+static bool append_tokens(PPTokenList* out, const PPToken* tokens, size_t count, bool space_before) {
+	for (size_t i = 0; i < count; i++) {
+		PPToken token = tokens[i];
+		if (i == 0) token.space_before = space_before;
+		if (!push_token(out, token)) return false;
+	}
+	return true;
+}
+
+static bool expand_tokens(Preprocessor* preprocessor, const PPToken* input, size_t count, PPTokenList* out);
+
+// Expands one call whose arguments are the given ranges of input. Returns
+// false with nothing appended when the argument count is wrong.
+static bool expand_call(Preprocessor* preprocessor, Macro* macro, const PPToken* name, const PPToken* input,
+		const ArgumentRange* arguments, int argument_count, PPTokenList* out, bool* ok) {
+	MacroExpander* expander = &preprocessor->expander;
+	if (argument_count == 1 && arguments[0].start == arguments[0].end && macro->param_count == 0) argument_count = 0;
+	if (argument_count != macro->param_count) {
+		fprintf(stderr, "Error: Macro %s expects %d arguments, got %d\n", macro->name, macro->param_count,
+			argument_count);
+		preprocessor->error_count++;
+		return false;
+	}
+	expander->calls++;
+
+	unsigned char* key = NULL;
+	size_t key_length = 0;
+	uint64_t hash = 0;
+	if (memoize_expansions && name->hide == 0) {
+		key_length = build_memo_key(expander, macro, name, input, arguments, argument_count);
+		hash = hash_key(expander->key, key_length);
+		MacroMemo* memo = key_length ? find_memo(expander, expander->key, key_length, hash) : NULL;
+		if (memo && memo->key) {
+			expander->memo_hits++;
+			*ok = append_tokens(out, memo->tokens, memo->token_count, name->space_before);
+			return true;
+		}
+		key = key_length ? malloc(key_length) : NULL;
+		if (key) memcpy(key, expander->key, key_length);
+	}
+
+	PPTokenList* expanded = calloc(argument_count ? argument_count : 1, sizeof(PPTokenList));
+	PPTokenList substituted = {0};
+	PPTokenList result = {0};
+	uint32_t body_hide = 0;
+	*ok = expanded && hide_set_add(expander, name->hide, macro->name_id, &body_hide);
+
+	for (int i = 0; *ok && i < argument_count; i++) {
+		*ok = expand_tokens(preprocessor, input + arguments[i].start, arguments[i].end - arguments[i].start,
+			&expanded[i]);
+	}
+
+	for (int b = 0; *ok && b < macro->body_length; b++) {
+		const PPToken* token = &macro->body[b];
+		if (token->kind != PP_PARAM) {
+			PPToken copy = *token;
+			copy.hide = body_hide;
+			*ok = push_token(&substituted, copy);
+			continue;
+		}
+
+		const PPTokenList* argument = &expanded[token->u.id];
+		for (size_t a = 0; *ok && a < argument->count; a++) {
+			PPToken copy = argument->tokens[a];
+			if (a == 0) copy.space_before = token->space_before;
+			*ok = hide_set_add(expander, copy.hide, macro->name_id, &copy.hide) && push_token(&substituted, copy);
+		}
+	}
+
+	*ok = *ok && expand_tokens(preprocessor, substituted.tokens, substituted.count, &result);
+	if (*ok && key) {
+		store_memo(expander, key, key_length, hash, &result);
+		key = NULL;
+	}
+	*ok = *ok && append_tokens(out, result.tokens, result.count, name->space_before);
+
+	for (int i = 0; expanded && i < argument_count; i++) {
+		free(expanded[i].tokens);
+	}
+	free(expanded);
+	free(substituted.tokens);
+	free(result.tokens);
+	free(key);
+	return true;
+}
+
+static bool expand_tokens(Preprocessor* preprocessor, const PPToken* input, size_t count, PPTokenList* out) {
+	MacroExpander* expander = &preprocessor->expander;
+	ArgumentRange* arguments = NULL;
+	size_t argument_capacity = 0;
+	bool ok = true;
+
+	for (size_t i = 0; ok && i < count; i++) {
+		const PPToken* token = &input[i];
+		Macro* macro = token->kind == PP_WORD ? find_macro(preprocessor->macros, token->u.id) : NULL;
+
+		if (macro && !macro->function_like) {
+			if (macro->has_value) {
+				PPToken number = { .kind = PP_NUMBER, .space_before = token->space_before, .u.value = macro->u.value };
+				ok = push_token(out, number);
+			}
+			continue;
+		}
+
+		if (!macro || hide_set_contains(expander, token->hide, macro->name_id) ||
+			i + 1 >= count || !is_text(&input[i + 1], '(')) {
+			ok = push_token(out, *token);
+			continue;
+		}
+
+		// split the call's arguments at top-level commas
+		int argument_count = 0;
+		int depth = 0;
+		size_t close = 0;
+		size_t start = i + 2;
+		for (size_t t = i + 1; t < count && !close; t++) {
+			bool split = (depth == 1 && is_text(&input[t], ',')) || (depth == 1 && is_text(&input[t], ')'));
+			if (is_text(&input[t], '(')) depth++;
+			if (is_text(&input[t], ')')) depth--;
+			if (!split) continue;
+
+			if ((size_t)argument_count == argument_capacity) {
+				argument_capacity = argument_capacity ? argument_capacity * 2 : 8;
+				ArgumentRange* grown = realloc(arguments, argument_capacity * sizeof(ArgumentRange));
+				if (!grown) {
+					ok = false;
+					break;
+				}
+				arguments = grown;
+			}
+			arguments[argument_count++] = (ArgumentRange){ .start = start, .end = t };
+			start = t + 1;
+			if (depth == 0) close = t;
+		}
+
+		if (ok && close && expand_call(preprocessor, macro, token, input, arguments, argument_count, out, &ok)) {
+			i = close;
+		} else if (ok) {
+			ok = push_token(out, *token);
+		}
+	}
+
+	free(arguments);
+	return ok;
+}
+
+static bool write_tokens(Preprocessor* preprocessor, const PPTokenList* list) {
+	char digits[16];
+	for (size_t i = 0; i < list->count; i++) {
+		const PPToken* token = &list->tokens[i];
+		if (i > 0 && token->space_before && !append_output(preprocessor, " ", 1)) return false;
+
+		bool ok;
+		switch (token->kind) {
+			case PP_WORD:
+				ok = append_output(preprocessor, intern_name(token->u.id), intern_length(token->u.id));
+				break;
+			case PP_NUMBER:
+				ok = append_output(preprocessor, digits, snprintf(digits, sizeof(digits), "%d", token->u.value));
+				break;
+			default:
+				ok = append_output(preprocessor, token->u.text, token->length);
+				break;
+		}
+		if (!ok) return false;
+	}
+	return true;
+}
+
+char* expand_macro(Preprocessor* preprocessor, Macro* macro, char* word_end) {
+	if (!macro->function_like) {
+		char digits[16];
+		if (macro->has_value &&
+			!append_output(preprocessor, digits, snprintf(digits, sizeof(digits), "%d", macro->u.value))) {
+			return NULL;
+		}
+		return word_end;
+	}
+
+	char* p = word_end;
+	while (p < preprocessor->limit && (is_blank(*p) || *p == '\n')) p++;
+	if (p >= preprocessor->limit || *p != '(') return NULL;
+
+	MacroExpander* expander = &preprocessor->expander;
+	if (expander->memo_generation != preprocessor->macros->generation) {
+		clear_memo(expander);
+		expander->memo_generation = preprocessor->macros->generation;
+	}
+
+	PPTokenList input = {0};
+	PPTokenList output = {0};
+	PPToken name = { .kind = PP_WORD, .u.id = macro->name_id };
+	const char* end = push_token(&input, name) ? tokenize(p, preprocessor->limit, &input, true) : NULL;
+	if (!end) {
+		fprintf(stderr, "Error: Unterminated call to macro %s on line %d\n", macro->name, preprocessor->line);
+		preprocessor->error_count++;
+		free(input.tokens);
+		return NULL;
+	}
+
+	bool ok = expand_tokens(preprocessor, input.tokens, input.count, &output) && write_tokens(preprocessor, &output);
+	free(input.tokens);
+	free(output.tokens);
+	return ok ? (char*)end : NULL;
+}
+
+void free_macro_expander(MacroExpander* expander) {
+	clear_memo(expander);
+	free(expander->memo);
+	free(expander->nodes);
+	free(expander->node_slots);
+	free(expander->key);
+}
@@ -0,0 +1,585 @@
+#include <unistd.h>
+#include <sys/stat.h>
+#include "preprocessor.h"
+
+// A snapshot is what preprocessing a prefix header left behind, in one file
+// that is mapped and used in place:
+//
+//   header, files, search paths, includes, segments, names, macros, body tokens,
+//   output, strings
+//
+// Every record is a multiple of 8 bytes, so each array stays aligned in the
+// mapping. Names are stored as text and interned again on load because ids
+// differ between processes. Include guards need nothing of their own: a
+// guarded header is skipped because its guard macro is defined. Headers that
+// use #pragma once are marked as included instead.
+//
+// The snapshot is checked in full when it is mapped. A later preprocess()
+// compares each file's mtime and size, and rehashes a file only when those
+// moved. It also needs the same -I directories and repeats every #include
+// lookup, so a header added earlier on the search path is noticed too.
+
+#define SNAPSHOT_MAGIC "ZPCH\0\0\0\2"
+#define NO_LOOKUP UINT32_MAX
+
+typedef struct {
+	char magic[8];
+	uint32_t prefix;        // string offset of the prefix header's path
+	uint32_t file_count;
+	uint32_t include_count;
+	uint32_t segment_count;
+	uint32_t name_count;
+	uint32_t macro_count;
+	uint32_t token_count;
+	uint32_t search_path_count;
+	uint64_t output_length;
+	uint64_t string_length;
+} SnapshotHeader;
+
+typedef struct {
+	uint32_t path;
+	uint32_t once;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+	uint64_t hash;
+} SnapshotFile;
+
+// one -I directory, in search order
+typedef struct {
+	uint32_t path;
+	uint32_t reserved;
+} SnapshotSearchPath;
+
+typedef struct {
+	uint32_t path;
+	uint32_t name;        // the #include name, NO_LOOKUP for a file included by path
+	uint32_t including;   // the file whose #include it was
+	uint32_t angled;
+	uint64_t start_pos;
+	uint64_t end_pos;
+	uint64_t content_length;
+} SnapshotInclude;
+
+typedef struct {
+	uint32_t file; // 0 is the prefix header, i + 1 the i-th include
+	int32_t line;
+	uint64_t output_start;
+} SnapshotSegment;
+
+typedef struct {
+	uint32_t offset;
+	uint32_t length;
+} SnapshotName;
+
+typedef struct {
+	uint32_t name;
+	uint8_t has_value;
+	uint8_t function_like;
+	uint16_t reserved;
+	int32_t value;
+	int32_t param_count;
+	uint32_t first_token;
+	uint32_t token_count;
+	uint32_t body_text;
+	uint32_t body_length;
+} SnapshotMacro;
+
+typedef struct {
+	uint8_t kind;
+	uint8_t space_before;
+	uint16_t reserved;
+	int32_t length;
+	uint32_t payload; // name index, parameter index, value, or offset in body_text
+	uint32_t reserved2;
+} SnapshotToken;
+
+typedef struct {
+	const SnapshotHeader* header;
+	const SnapshotFile* files;
+	const SnapshotSearchPath* search_paths;
+	const SnapshotInclude* includes;
+	const SnapshotSegment* segments;
+	const SnapshotName* names;
+	const SnapshotMacro* macros;
+	const SnapshotToken* tokens;
+	const char* output;
+	const char* strings;
+} SnapshotView;
+
+static SourceFile* snapshot_file = NULL;
+static SnapshotView snapshot = {0};
+
+typedef struct {
+	char* data;
+	size_t length;
+	size_t capacity;
+} StringTable;
+
+static bool add_string(StringTable* table, const char* text, size_t length, uint32_t* offset) {
+	if (table->length + length + 1 > table->capacity) {
+		size_t new_capacity = table->capacity ? table->capacity * 2 : INITIAL_BUFFER_SIZE;
+		while (new_capacity < table->length + length + 1) new_capacity *= 2;
+		char* data = realloc(table->data, new_capacity);
+		if (!data) return false;
+		table->data = data;
+		table->capacity = new_capacity;
+	}
+
+	*offset = table->length;
+	memcpy(table->data + table->length, text, length);
+	table->data[table->length + length] = '\0';
+	table->length += length + 1;
+	return true;
+}
+
+// Gives name_id its index in the name table, adding it on first use.
+static bool add_name(uint32_t name_id, uint32_t* name_index, SnapshotName** names, uint32_t* name_count,
+		StringTable* strings, uint32_t* index) {
+	if (name_index[name_id]) {
+		*index = name_index[name_id] - 1;
+		return true;
+	}
+
+	SnapshotName* grown = realloc(*names, (*name_count + 1) * sizeof(SnapshotName));
+	if (!grown) return false;
+	*names = grown;
+
+	SnapshotName* name = &grown[*name_count];
+	name->length = intern_length(name_id);
+	if (!add_string(strings, intern_name(name_id), name->length, &name->offset)) return false;
+
+	*index = (*name_count)++;
+	name_index[name_id] = *index + 1;
+	return true;
+}
+
+static bool describe_file(const char* path, StringTable* strings, SnapshotFile* file) {
+	struct stat info;
+	if (stat(path, &info) != 0) {
+		fprintf(stderr, "Error: Failed to open file %s\n", path);
+		return false;
+	}
+
+	file->once = is_included_once(path);
+	file->mtime_sec = info.st_mtim.tv_sec;
+	file->mtime_nsec = info.st_mtim.tv_nsec;
+	file->size = info.st_size;
+	file->hash = hash_file(path);
+	return add_string(strings, path, strlen(path), &file->path);
+}
+
+static bool write_records(FILE* file, const void* data, size_t size, size_t count) {
+	return count == 0 || fwrite(data, size, count, file) == count;
+}
+
+bool write_macro_snapshot(Preprocessor* preprocessor, const char* path) {
+	if (!preprocessor->file_path || !preprocessor->output || !preprocessor->includes) return false;
+
+	IncludeList* list = preprocessor->includes;
+	MacroList* macro_list = preprocessor->macros;
+	StringTable strings = {0};
+	SnapshotHeader header = {
+		.search_path_count = get_include_path_count(),
+		.include_count = list->include_count,
+		.segment_count = preprocessor->segment_count,
+		.macro_count = macro_list->macro_count,
+		.output_length = preprocessor->output_length,
+	};
+	memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+
+	SnapshotFile* files = calloc(list->include_count + 1, sizeof(SnapshotFile));
+	SnapshotSearchPath* search_paths = calloc(header.search_path_count + 1, sizeof(SnapshotSearchPath));
+	SnapshotInclude* includes = calloc(list->include_count + 1, sizeof(SnapshotInclude));
+	SnapshotSegment* segments = calloc(preprocessor->segment_count + 1, sizeof(SnapshotSegment));
+	SnapshotMacro* macros = calloc(macro_list->macro_count + 1, sizeof(SnapshotMacro));
+	uint32_t* name_index = calloc(intern_count() + 1, sizeof(uint32_t));
+	SnapshotName* names = NULL;
+	SnapshotToken* tokens = NULL;
+	bool ok = files && search_paths && includes && segments && macros && name_index &&
+		add_string(&strings, preprocessor->file_path, strlen(preprocessor->file_path), &header.prefix);
+
+	// the prefix header and each distinct include
+	ok = ok && describe_file(preprocessor->file_path, &strings, &files[header.file_count++]);
+	for (struct IncludeNode* node = list->head; ok && node; node = node->next) {
+		bool repeated = strcmp(node->file_path, preprocessor->file_path) == 0;
+		for (struct IncludeNode* earlier = node->prev; earlier && !repeated; earlier = earlier->prev) {
+			repeated = strcmp(earlier->file_path, node->file_path) == 0;
+		}
+		if (!repeated) ok = describe_file(node->file_path, &strings, &files[header.file_count++]);
+	}
+
+	for (uint32_t i = 0; ok && i < header.search_path_count; i++) {
+		ok = add_string(&strings, get_include_path(i), strlen(get_include_path(i)), &search_paths[i].path);
+	}
+
+	size_t index = 0;
+	for (struct IncludeNode* node = list->head; ok && node; node = node->next, index++) {
+		SnapshotInclude* include = &includes[index];
+		*include = (SnapshotInclude){
+			.name = NO_LOOKUP,
+			.angled = node->angled,
+			.start_pos = node->start_pos,
+			.end_pos = node->end_pos,
+			.content_length = node->content_length,
+		};
+		ok = add_string(&strings, node->file_path, strlen(node->file_path), &include->path);
+		if (ok && node->name) {
+			ok = add_string(&strings, node->name, strlen(node->name), &include->name) &&
+				add_string(&strings, node->including_path, strlen(node->including_path), &include->including);
+		}
+	}
+
+	for (size_t i = 0; ok && i < preprocessor->segment_count; i++) {
+		const SourceSegment* segment = &preprocessor->segments[i];
+		uint32_t file = 0;
+		if (segment->file_path != preprocessor->file_path) {
+			uint32_t position = 1;
+			for (struct IncludeNode* node = list->head; node; node = node->next, position++) {
+				if (node->file_path == segment->file_path) file = position;
+			}
+		}
+		segments[i] = (SnapshotSegment){
+			.file = file,
+			.line = segment->line,
+			.output_start = segment->output_start,
+		};
+	}
+
+	for (size_t i = 0; ok && i < macro_list->macro_count; i++) {
+		const Macro* macro = &macro_list->macro[i];
+		SnapshotMacro* record = &macros[i];
+		*record = (SnapshotMacro){
+			.has_value = macro->has_value,
+			.function_like = macro->function_like,
+			.value = macro->u.value,
+			.param_count = macro->param_count,
+			.first_token = header.token_count,
+		};
+		ok = add_name(macro->name_id, name_index, &names, &header.name_count, &strings, &record->name);
+		if (!ok || !macro->function_like) continue;
+
+		record->token_count = macro->body_length;
+		record->body_length = strlen(macro->body_text);
+		ok = add_string(&strings, macro->body_text, record->body_length, &record->body_text);
+
+		SnapshotToken* grown = ok ? realloc(tokens, (header.token_count + macro->body_length + 1) * sizeof(SnapshotToken)) : NULL;
+		ok = grown != NULL;
+		if (ok) tokens = grown;
+
+		for (int k = 0; ok && k < macro->body_length; k++) {
+			const PPToken* token = &macro->body[k];
+			SnapshotToken* out = &tokens[header.token_count++];
+			*out = (SnapshotToken){
+				.kind = token->kind,
+				.space_before = token->space_before,
+				.length = token->length,
+			};
+			if (token->kind == PP_WORD) {
+				ok = add_name(token->u.id, name_index, &names, &header.name_count, &strings, &out->payload);
+			} else if (token->kind == PP_TEXT) {
+				out->payload = token->u.text - macro->body_text;
+			} else if (token->kind == PP_NUMBER) {
+				out->payload = (uint32_t)token->u.value;
+			} else {
+				out->payload = token->u.id;
+			}
+		}
+	}
+	header.string_length = strings.length;
+
+	char temporary[4096];
+	snprintf(temporary, sizeof(temporary), "%s.%ld.tmp", path, (long)getpid());
+	FILE* file = ok ? fopen(temporary, "wb") : NULL;
+	ok = file && write_records(file, &header, sizeof(header), 1) &&
+		write_records(file, files, sizeof(SnapshotFile), header.file_count) &&
+		write_records(file, search_paths, sizeof(SnapshotSearchPath), header.search_path_count) &&
+		write_records(file, includes, sizeof(SnapshotInclude), header.include_count) &&
+		write_records(file, segments, sizeof(SnapshotSegment), header.segment_count) &&
+		write_records(file, names, sizeof(SnapshotName), header.name_count) &&
+		write_records(file, macros, sizeof(SnapshotMacro), header.macro_count) &&
+		write_records(file, tokens, sizeof(SnapshotToken), header.token_count) &&
+		write_records(file, preprocessor->output, 1, header.output_length) &&
+		write_records(file, strings.data, 1, header.string_length);
+	if (file && fclose(file) != 0) ok = false;
+	if (ok && rename(temporary, path) != 0) ok = false;
+	if (!ok) {
+		fprintf(stderr, "Error: Failed to write snapshot %s\n", path);
+		if (file) unlink(temporary);
+	}
+
+	free(files);
+	free(search_paths);
+	free(includes);
+	free(segments);
+	free(macros);
+	free(name_index);
+	free(names);
+	free(tokens);
+	free(strings.data);
+	return ok;
+}
+
+static bool valid_string(const SnapshotView* view, uint32_t offset) {
+	return offset < view->header->string_length &&
+		memchr(view->strings + offset, '\0', view->header->string_length - offset) != NULL;
+}
+
+static bool valid_range(const SnapshotView* view, uint32_t offset, uint32_t length) {
+	return (uint64_t)offset + length < view->header->string_length && view->strings[offset + length] == '\0';
+}
+
+// Lays the arrays over the mapping and checks every count and offset.
+static bool view_snapshot(const SourceFile* file, SnapshotView* view) {
+	if (file->length < sizeof(SnapshotHeader)) return false;
+	const SnapshotHeader* header = (const SnapshotHeader*)file->data;
+	if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) return false;
+
+	// each part is taken from what is left, so no length can wrap the sum
+	uint64_t parts[] = {
+		(uint64_t)header->file_count * sizeof(SnapshotFile),
+		(uint64_t)header->search_path_count * sizeof(SnapshotSearchPath),
+		(uint64_t)header->include_count * sizeof(SnapshotInclude),
+		(uint64_t)header->segment_count * sizeof(SnapshotSegment),
+		(uint64_t)header->name_count * sizeof(SnapshotName),
+		(uint64_t)header->macro_count * sizeof(SnapshotMacro),
+		(uint64_t)header->token_count * sizeof(SnapshotToken),
+		header->output_length,
+		header->string_length,
+	};
+	uint64_t remaining = file->length - sizeof(SnapshotHeader);
+	for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+		if (parts[i] > remaining) return false;
+		remaining -= parts[i];
+	}
+	if (remaining != 0) return false;
+
+	const char* cursor = file->data + sizeof(SnapshotHeader);
+	view->header = header;
+	view->files = (const SnapshotFile*)cursor;
+	cursor += header->file_count * sizeof(SnapshotFile);
+	view->search_paths = (const SnapshotSearchPath*)cursor;
+	cursor += header->search_path_count * sizeof(SnapshotSearchPath);
+	view->includes = (const SnapshotInclude*)cursor;
+	cursor += header->include_count * sizeof(SnapshotInclude);
+	view->segments = (const SnapshotSegment*)cursor;
+	cursor += header->segment_count * sizeof(SnapshotSegment);
+	view->names = (const SnapshotName*)cursor;
+	cursor += header->name_count * sizeof(SnapshotName);
+	view->macros = (const SnapshotMacro*)cursor;
+	cursor += header->macro_count * sizeof(SnapshotMacro);
+	view->tokens = (const SnapshotToken*)cursor;
+	cursor += header->token_count * sizeof(SnapshotToken);
+	view->output = cursor;
+	view->strings = cursor + header->output_length;
+
+	if (header->file_count == 0 || !valid_string(view, header->prefix)) return false;
+	for (uint32_t i = 0; i < header->file_count; i++) {
+		if (!valid_string(view, view->files[i].path)) return false;
+	}
+	for (uint32_t i = 0; i < header->search_path_count; i++) {
+		if (!valid_string(view, view->search_paths[i].path)) return false;
+	}
+	for (uint32_t i = 0; i < header->include_count; i++) {
+		const SnapshotInclude* include = &view->includes[i];
+		if (!valid_string(view, include->path)) return false;
+		if (include->name != NO_LOOKUP && (!valid_string(view, include->name) || !valid_string(view, include->including))) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->segment_count; i++) {
+		if (view->segments[i].file > header->include_count || view->segments[i].output_start > header->output_length) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header->name_count; i++) {
+		if (view->names[i].length == 0 || !valid_range(view, view->names[i].offset, view->names[i].length)) return false;
+	}
+	for (uint32_t i = 0; i < header->macro_count; i++) {
+		const SnapshotMacro* macro = &view->macros[i];
+		if (macro->name >= header->name_count) return false;
+		if (!macro->function_like) continue;
+
+		if (macro->param_count < 0 || (uint64_t)macro->first_token + macro->token_count > header->token_count ||
+			!valid_range(view, macro->body_text, macro->body_length)) {
+			return false;
+		}
+		for (uint32_t k = 0; k < macro->token_count; k++) {
+			const SnapshotToken* token = &view->tokens[macro->first_token + k];
+			bool valid = token->kind == PP_WORD ? token->payload < header->name_count :
+				token->kind == PP_TEXT ? token->length >= 0 && (uint64_t)token->payload + token->length <= macro->body_length :
+				token->kind == PP_PARAM ? token->payload < (uint32_t)macro->param_count :
+				token->kind == PP_NUMBER;
+			if (!valid) return false;
+		}
+	}
+	return true;
+}
+
+bool set_macro_snapshot(const char* path) {
+	free_source(snapshot_file);
+	snapshot_file = NULL;
+	memset(&snapshot, 0, sizeof(snapshot));
+	if (!path) return true;
+
+	SourceFile* file = load_source(path);
+	if (!file) return false;
+	if (!view_snapshot(file, &snapshot)) {
+		fprintf(stderr, "Error: %s is not a valid snapshot\n", path);
+		free_source(file);
+		memset(&snapshot, 0, sizeof(snapshot));
+		return false;
+	}
+	snapshot_file = file;
+	return true;
+}
+
+static bool file_unchanged(const SnapshotFile* file) {
+	struct stat info;
+	const char* path = snapshot.strings + file->path;
+	if (stat(path, &info) != 0 || info.st_size != file->size) return false;
+	if (info.st_mtim.tv_sec == file->mtime_sec && info.st_mtim.tv_nsec == file->mtime_nsec) return true;
+	return hash_file(path) == file->hash;
+}
+
+// The same -I directories in the same order, and every #include finding
+// the file it found when the snapshot was written.
+static bool lookups_unchanged() {
+	const SnapshotHeader* header = snapshot.header;
+	if (header->search_path_count != get_include_path_count()) return false;
+	for (uint32_t i = 0; i < header->search_path_count; i++) {
+		if (strcmp(snapshot.strings + snapshot.search_paths[i].path, get_include_path(i)) != 0) return false;
+	}
+
+	for (uint32_t i = 0; i < header->include_count; i++) {
+		const SnapshotInclude* include = &snapshot.includes[i];
+		if (include->name != NO_LOOKUP && !include_lookup_unchanged(snapshot.strings + include->name, include->angled,
+				snapshot.strings + include->including, snapshot.strings + include->path)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool load_macros(Preprocessor* preprocessor, const uint32_t* name_ids) {
+	for (uint32_t i = 0; i < snapshot.header->macro_count; i++) {
+		const SnapshotMacro* record = &snapshot.macros[i];
+		Macro macro = {
+			.name_id = name_ids[record->name],
+			.has_value = record->has_value,
+			.u.value = record->value,
+		};
+
+		if (record->function_like) {
+			macro.function_like = true;
+			macro.param_count = record->param_count;
+			macro.body_length = record->token_count;
+			macro.body_text = strndup(snapshot.strings + record->body_text, record->body_length);
+			macro.body = malloc((record->token_count + 1) * sizeof(PPToken));
+			if (!macro.body_text || !macro.body) {
+				free(macro.body_text);
+				free(macro.body);
+				return false;
+			}
+
+			for (uint32_t k = 0; k < record->token_count; k++) {
+				const SnapshotToken* token = &snapshot.tokens[record->first_token + k];
+				PPToken* out = &macro.body[k];
+				*out = (PPToken){
+					.kind = token->kind,
+					.space_before = token->space_before,
+					.length = token->length,
+				};
+				if (token->kind == PP_WORD) {
+					out->u.id = name_ids[token->payload];
+				} else if (token->kind == PP_TEXT) {
+					out->u.text = macro.body_text + token->payload;
+				} else if (token->kind == PP_NUMBER) {
+					out->u.value = (int32_t)token->payload;
+				} else {
+					out->u.id = token->payload;
+				}
+			}
+		}
+
+		if (!insert_macro(preprocessor->macros, macro)) {
+			free(macro.body);
+			free(macro.body_text);
+		}
+	}
+	return true;
+}
+
+bool apply_macro_snapshot(Preprocessor* preprocessor) {
+	if (!snapshot_file || !preprocessor->macros || !preprocessor->includes) return false;
+	const SnapshotHeader* header = snapshot.header;
+	char* prefix = (char*)snapshot.strings + header->prefix;
+
+	bool unchanged = lookups_unchanged();
+	for (uint32_t i = 0; unchanged && i < header->file_count; i++) {
+		unchanged = file_unchanged(&snapshot.files[i]);
+	}
+	if (!unchanged) {
+		include_file(preprocessor, prefix, 0, 0);
+		return true;
+	}
+
+	uint32_t* name_ids = malloc((header->name_count + 1) * sizeof(uint32_t));
+	struct IncludeNode** nodes = malloc((header->include_count + 1) * sizeof(struct IncludeNode*));
+	bool ok = name_ids && nodes;
+
+	for (uint32_t i = 0; ok && i < header->name_count; i++) {
+		name_ids[i] = intern(snapshot.strings + snapshot.names[i].offset, snapshot.names[i].length);
+	}
+
+	// the prefix header is recorded like an #include at the top of the file
+	size_t include_count = preprocessor->includes->include_count;
+	if (ok) add_include_node(preprocessor->includes, prefix, 0, 0);
+	ok = ok && preprocessor->includes->include_count == include_count + 1;
+	struct IncludeNode* prefix_node = ok ? preprocessor->includes->tail : NULL;
+	if (ok) prefix_node->content_length = header->output_length;
+
+	for (uint32_t i = 0; ok && i < header->include_count; i++) {
+		const SnapshotInclude* include = &snapshot.includes[i];
+		add_include_node(preprocessor->includes, (char*)snapshot.strings + include->path, include->start_pos, include->end_pos);
+		ok = preprocessor->includes->include_count == include_count + i + 2 &&
+			(include->name == NO_LOOKUP || set_include_lookup(preprocessor->includes->tail, snapshot.strings + include->name,
+				strlen(snapshot.strings + include->name), include->angled, snapshot.strings + include->including));
+		if (ok) {
+			nodes[i] = preprocessor->includes->tail;
+			nodes[i]->content_length = include->content_length;
+		}
+	}
+
+	size_t output_start = preprocessor->output_length;
+	size_t segment_count = preprocessor->segment_count + header->segment_count;
+	if (ok && segment_count > preprocessor->segment_capacity) {
+		SourceSegment* grown = realloc(preprocessor->segments, segment_count * sizeof(SourceSegment));
+		ok = grown != NULL;
+		if (grown) {
+			preprocessor->segments = grown;
+			preprocessor->segment_capacity = segment_count;
+		}
+	}
+	for (uint32_t i = 0; ok && i < header->segment_count; i++) {
+		const SnapshotSegment* segment = &snapshot.segments[i];
+		preprocessor->segments[preprocessor->segment_count++] = (SourceSegment){
+			.file_path = segment->file ? nodes[segment->file - 1]->file_path : prefix_node->file_path,
+			.output_start = output_start + segment->output_start,
+			.line = segment->line,
+		};
+	}
+
+	ok = ok && append_output(preprocessor, snapshot.output, header->output_length);
+	if (ok) preprocessor->output[preprocessor->output_length] = '\0';
+	ok = ok && load_macros(preprocessor, name_ids);
+
+	for (uint32_t i = 0; ok && i < header->file_count; i++) {
+		if (snapshot.files[i].once) assume_included(preprocessor, snapshot.strings + snapshot.files[i].path, true);
+	}
+
+	free(name_ids);
+	free(nodes);
+	if (!ok) fprintf(stderr, "Error: Failed to load snapshot\n");
+	return ok;
+}
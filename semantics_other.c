@@ -5,22 +5,17 @@
 
 static struct decl* current_function = NULL;
 
-struct symbol* create_symbol(symbol_t kind, struct type* t, char* name) {
-	struct symbol* symbol = malloc(sizeof(struct symbol));
+struct symbol* create_symbol(symbol_t kind, struct type* t, uint32_t name_id) {
+	struct symbol* symbol = node_alloc(sizeof(struct symbol), ARENA_SYMBOL);
 	if (!symbol) return NULL;
 
 	symbol->kind = kind;
 	symbol->type = type_copy(t);
-	if (!symbol->type) {
-		free(symbol);
-		return NULL;
-	}
+	if (!symbol->type) return NULL;
 
-	symbol->name = strdup(name);
-	if (!symbol->name) {
-		free(symbol->type);
-		free(symbol);
-	}
+	symbol->name_id = name_id;
+	symbol->name = intern_name(name_id);
+	if (!symbol->name) return NULL;
 
 	return symbol;
 }
@@ -109,10 +104,10 @@ int scope_level(struct stack* stack) {
 	return stack->top + 1;
 }
 
-bool is_symbol_redeclared(struct symbol_table* table, char* name) {
+bool is_symbol_redeclared(struct symbol_table* table, uint32_t name_id) {
 	struct symbol* symbol = table->symbol;
 	while (symbol) {
-		if (strcmp(symbol->name, name) == 0) {
+		if (symbol->name_id == name_id) {
 			return true;
 		}
 		symbol = symbol->next;
@@ -121,8 +116,8 @@ bool is_symbol_redeclared(struct symbol_table* table, char* name) {
 	return false;
 }
 
-struct symbol* scope_lookup(struct stack* stack, char* name, int* found_scope) {
-	if (!stack || !name || !found_scope) return NULL;
+struct symbol* scope_lookup(struct stack* stack, uint32_t name_id, int* found_scope) {
+	if (!stack || name_id == INTERN_NONE || !found_scope) return NULL;
 
 	if (stack->top < 0) return NULL;
 
@@ -134,7 +129,7 @@ struct symbol* scope_lookup(struct stack* stack, char* name, int* found_scope) {
 
 		struct symbol* current = stack->symbol_tables[i]->symbol;
 		while (current) {
-			if (strcmp(current->name, name) == 0) {
+			if (current->name_id == name_id) {
 				if (found_scope) *found_scope = i;
 				return current;
 			}
@@ -144,14 +139,14 @@ struct symbol* scope_lookup(struct stack* stack, char* name, int* found_scope) {
 	return NULL;
 }
 
-struct symbol* scope_lookup_current(struct stack* stack, char* name) {
-	if (!stack || !name) return NULL;
+struct symbol* scope_lookup_current(struct stack* stack, uint32_t name_id) {
+	if (!stack || name_id == INTERN_NONE) return NULL;
 
 	struct symbol* current = stack->symbol_tables[stack->top]->symbol;
 	if (!current) return NULL;
 
 	while (current) {
-		if (strcmp(current->name, name) == 0) {
+		if (current->name_id == name_id) {
 			return current;
 		}
 		current = current->next;
@@ -283,7 +278,7 @@ void param_list_resolve(struct param_list* params, struct stack* stack) {
 
 	while (params) {
 		symbol_t kind = SYMBOL_PARAM;
-		params->symbol = create_symbol(kind, params->type, params->name);
+		params->symbol = create_symbol(kind, params->type, params->name_id);
 		if (params->symbol){
 			scope_bind(stack, params->symbol);
 			params->symbol->s.param_index = param_index++;
@@ -300,7 +295,7 @@ void expr_resolve(struct expr* e, struct stack* stack) {
 	switch (e->kind) {
 		case EXPR_ARRAY:
 		case EXPR_NAME: {
-			struct symbol* symbol = scope_lookup(stack, e->name, &found_scope);
+			struct symbol* symbol = scope_lookup(stack, e->name_id, &found_scope);
 			e->symbol = symbol;
 			break;		
 		}
@@ -443,7 +438,7 @@ void decl_resolve(struct decl* d, struct stack* stack) {
 		}
 
 		symbol_t kind = scope_level(stack) > 1 ? SYMBOL_LOCAL: SYMBOL_GLOBAL;
-		struct symbol* existing_symbol = scope_lookup_current(stack, d->name);
+		struct symbol* existing_symbol = scope_lookup_current(stack, d->name_id);
 
 		if (existing_symbol) {
 			d->symbol = existing_symbol;
@@ -453,7 +448,7 @@ void decl_resolve(struct decl* d, struct stack* stack) {
 
 		size_t bytes = get_num_bytes(d, d->type);
 
-		d->symbol = create_symbol(kind, d->type, d->name);
+		d->symbol = create_symbol(kind, d->type, d->name_id);
 		if (!d->symbol) {
 			d = d->next;
 			continue;
@@ -481,7 +476,7 @@ void decl_resolve(struct decl* d, struct stack* stack) {
 			param_list_resolve(d->type->params, stack);
 
 			scope_enter(stack, NULL);
-			stmt_resolve(d->code, stack);
+			stmt_resolve(decl_code(d), stack);
 
 			size_t total_local_bytes = 0;
 			struct symbol_table* local_scope = stack->symbol_tables[stack->top];
@@ -530,15 +525,18 @@ void decl_resolve(struct decl* d, struct stack* stack) {
 void program_resolve(struct program* p, struct stack* stack) {
 	if (!p || !stack) return;
 
+	// symbols are referred to from the tree, so they live as long as it does
+	Arena* previous = set_node_arena(arena_create_child(p->arena, "resolve"));
 	printf("About to resolve program\n");
 	if (p->declaration) {
 		decl_resolve(p->declaration, stack);
 	}
 	printf("\nFinished resolving program\n");
+	set_node_arena(previous);
 }
 
 struct type* type_create(type_t kind, struct type* subtype, struct param_list* params) {
-	struct type* t = malloc(sizeof(struct type));
+	struct type* t = node_alloc(sizeof(struct type), ARENA_TYPE);
 	if (!t) {
 		fprintf(stderr, "Error: Memory allocation failed in type_create\n");
 		return NULL;
@@ -551,42 +549,12 @@ struct type* type_create(type_t kind, struct type* subtype, struct param_list* p
 	return t;
 }
 
-void type_delete(struct type* t) {
-	if (!t) return;
-
-	struct param_list* param = t->params;
-	while (param) {
-		free(param->name);
-		type_delete(param->type);
-		free(param);
-		param = param->next;
-	}	
-
-	type_delete(t->subtype);
-
-	free(t);
-}
-
-void free_symbol(struct symbol* symbol) {
-	if (!symbol) return;
-
-	free(symbol->name);
-	if (symbol->type) type_delete(symbol->type);
-	free(symbol);
-}
-
 void free_stack(struct stack* stack) {
 	if (!stack) return;
 
 	for (int i = stack->top; i >= 0; i--) {
-		struct symbol_table* current_table = stack->symbol_tables[i];
-		struct symbol* current_symbol = current_table->symbol;
-
-		while (current_symbol) {
-			free_symbol(current_symbol);
-			current_symbol = current_symbol->next;
-		}
-		free(current_table);
+		// the symbols belong to the program's arena
+		free(stack->symbol_tables[i]);
 	}
 	free(stack->symbol_tables);
 	free(stack);
@@ -633,7 +601,7 @@ bool type_equals(struct type* a, struct type* b) {
 struct type* type_copy(struct type* t) {
 	if (!t) return NULL;
 
-	struct type* t_copy = malloc(sizeof(struct type));
+	struct type* t_copy = node_alloc(sizeof(struct type), ARENA_TYPE);
 	if (!t_copy) return NULL;
 
 	t_copy->kind = t->kind;
@@ -645,8 +613,10 @@ struct type* type_copy(struct type* t) {
 		struct param_list* first_copy = NULL;
 
 		while (current) {
-			struct param_list* param_copy = malloc(sizeof(struct param_list));
-			param_copy->name = strdup(current->name);
+			struct param_list* param_copy = node_alloc(sizeof(struct param_list), ARENA_PARAM);
+			if (!param_copy) return NULL;
+			param_copy->name = current->name;
+			param_copy->name_id = current->name_id;
 			param_copy->type = type_copy(current->type);
 			param_copy->next = NULL;
 
@@ -680,7 +650,7 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
         	printf("In expr_typecheck with\n");
             // Lookup the symbol in current scope stack
             int found_scope;
-            struct symbol* sym = scope_lookup(stack, e->name, &found_scope);
+            struct symbol* sym = scope_lookup(stack, e->name_id, &found_scope);
             if (!sym) {
                 fprintf(stderr, "Error: Symbol '%s' not found in current scope\n", e->name);
                 return type_create(TYPE_UNKNOWN, NULL, NULL);
@@ -712,7 +682,7 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
             break;
 
         case EXPR_ARRAY: {
-            struct symbol* sym = scope_lookup(stack, e->name, NULL);
+            struct symbol* sym = scope_lookup(stack, e->name_id, NULL);
             if (!sym) {
                 fprintf(stderr, "Error: Array '%s' not found\n", e->name);
                 return type_create(TYPE_UNKNOWN, NULL, NULL);
@@ -726,7 +696,6 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
                 if (index_type->kind != TYPE_INTEGER) {
                     fprintf(stderr, "Error: Array index must be integer type\n");
                 }
-                type_delete(index_type);
             }
             
             result = type_copy(sym->type->subtype);
@@ -790,7 +759,7 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
 
         case EXPR_CALL: {
             // Typecheck function name
-            struct symbol* sym = scope_lookup(stack, e->name, NULL);
+            struct symbol* sym = scope_lookup(stack, e->name_id, NULL);
             if (!sym || sym->type->kind != TYPE_FUNCTION) {
                 fprintf(stderr, "Error: '%s' is not a function\n", e->name);
                 return type_create(TYPE_UNKNOWN, NULL, NULL);
@@ -805,7 +774,6 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
                 if (!type_equals(arg_type, param->type)) {
                     fprintf(stderr, "Error: Argument type mismatch in function call\n");
                 }
-                type_delete(arg_type);
                 arg = arg->right;
                 param = param->next;
             }
@@ -824,8 +792,6 @@ struct type* expr_typecheck(struct expr* e, struct stack* stack) {
             break;
     }
 
-    if (lt) type_delete(lt);
-    if (rt) type_delete(rt);
     return result;
 }
 
@@ -839,7 +805,7 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
                     // Create and bind symbol for the declaration
                     if (!s->decl->symbol) {
                         symbol_t kind = scope_level(stack) > 1 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
-                        s->decl->symbol = create_symbol(kind, s->decl->type, s->decl->name);
+                        s->decl->symbol = create_symbol(kind, s->decl->type, s->decl->name_id);
                         if (s->decl->symbol) {
                             scope_bind(stack, s->decl->symbol);
                         }
@@ -851,8 +817,7 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
             // Rest of the cases remain the same
             case STMT_EXPR:
                 if (s->expr) {
-                    struct type* t = expr_typecheck(s->expr, stack);
-                    type_delete(t);
+                    expr_typecheck(s->expr, stack);
                 }
                 break;
 
@@ -863,7 +828,6 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
                     if (!t || t->kind != TYPE_BOOLEAN) {
                         fprintf(stderr, "Error: If condition must be boolean type\n");
                     }
-                    type_delete(t);
                 }
 
                 if (s->body) {
@@ -881,8 +845,7 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
 
             case STMT_FOR:
                 if (s->init_expr) {
-                    struct type* t_init = expr_typecheck(s->init_expr, stack);
-                    type_delete(t_init);
+                    expr_typecheck(s->init_expr, stack);
                 }
 
                 if (s->expr) {
@@ -890,12 +853,10 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
                     if (!t_cond || t_cond->kind != TYPE_BOOLEAN) {
                         fprintf(stderr, "Error: For loop condition must be boolean type\n");
                     }
-                    type_delete(t_cond);
                 }
 
                 if (s->next_expr) {
-                    struct type* t_next = expr_typecheck(s->next_expr, stack);
-                    type_delete(t_next);
+                    expr_typecheck(s->next_expr, stack);
                 }
 
                 if (s->body) {
@@ -911,7 +872,6 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
                     if (!t || t->kind != TYPE_BOOLEAN) {
                         fprintf(stderr, "Error: While condition must be boolean type\n");
                     }
-                    type_delete(t);
                 }
 
                 if (s->body) {
@@ -939,7 +899,6 @@ void stmt_typecheck(struct stmt* s, struct stack* stack) {
                         fprintf(stderr, "Error: Return type mismatch in function '%s'\n", 
                                 current_function->name);
                     }
-                    type_delete(return_type);
                 } else if (current_function->type->subtype->kind != TYPE_VOID) {
                     fprintf(stderr, "Error: Non-void function '%s' missing return value\n",
                             current_function->name);
@@ -969,7 +928,7 @@ void decl_typecheck(struct decl* d, struct stack* stack) {
                 param = param->next;
             }
 
-            if (d->code) {
+            if (decl_code(d)) {
                 scope_enter(stack, NULL);  
                 struct stmt* s = d->code;
 
@@ -998,7 +957,6 @@ void decl_typecheck(struct decl* d, struct stack* stack) {
                         if (size_type->kind != TYPE_INTEGER) {
                             fprintf(stderr, "Error: Array size must be integer\n");
                         }
-                        type_delete(size_type);
                     }
 
                     if (d->value->right) {
@@ -1009,7 +967,6 @@ void decl_typecheck(struct decl* d, struct stack* stack) {
                             if (!type_equals(value_type, d->type->subtype)) {
                                 fprintf(stderr, "Error: Array initialization value type mismatch\n");
                             }
-                            type_delete(value_type);
                             init_value = init_value->right;
                         }
                     }
@@ -1020,7 +977,6 @@ void decl_typecheck(struct decl* d, struct stack* stack) {
                 if (!type_equals(value_type, d->type)) {
                     fprintf(stderr, "Error: Type mismatch in declaration of '%s'\n", d->name);
                 }
-                type_delete(value_type);
             }
         }
         
@@ -1031,6 +987,7 @@ void decl_typecheck(struct decl* d, struct stack* stack) {
 void program_typecheck(struct program* p, struct stack* stack) {
     if (!p) return;
     
+    Arena* previous = set_node_arena(arena_create_child(p->arena, "typecheck"));
     debug_print_scope_stack(stack, "Start of program_typecheck");
     
     if (p->declaration) {
@@ -1038,4 +995,5 @@ void program_typecheck(struct program* p, struct stack* stack) {
     }
     
     debug_print_scope_stack(stack, "End of program_typecheck");
+    set_node_arena(previous);
 }
\ No newline at end of file
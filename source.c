@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source.h"
+
+static bool mapping_enabled = true;
+static SourceStats stats = {0};
+
+void set_source_mapping(bool enabled) {
+    mapping_enabled = enabled;
+}
+
+const SourceStats* get_source_stats() {
+    return &stats;
+}
+
+static bool map_source(SourceFile* source, int fd, size_t length) {
+    void* data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return false;
+
+    // The whole file is consumed front to back.
+    madvise(data, length, MADV_SEQUENTIAL);
+
+    source->data = data;
+    source->length = length;
+    source->mapped = true;
+    stats.files_mapped++;
+    stats.bytes_mapped += length;
+    return true;
+}
+
+static bool read_source(SourceFile* source, int fd, size_t size_hint) {
+    size_t capacity = size_hint ? size_hint + 1 : SOURCE_READ_CHUNK;
+    size_t length = 0;
+    char* data = malloc(capacity);
+    if (!data) return false;
+
+    for (;;) {
+        if (capacity - length < 2) {
+            char* grown = realloc(data, capacity * 2);
+            if (!grown) {
+                free(data);
+                return false;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+
+        ssize_t count = read(fd, data + length, capacity - length - 1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            free(data);
+            return false;
+        }
+        if (count == 0) break;
+        length += count;
+    }
+    data[length] = '\0';
+
+    source->data = data;
+    source->length = length;
+    source->mapped = false;
+    stats.files_read++;
+    stats.bytes_read += length;
+    return true;
+}
+
+SourceFile* load_source(const char* path) {
+    bool is_stdin = strcmp(path, "-") == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Failed to open file %s\n", path);
+        return NULL;
+    }
+
+    SourceFile* source = malloc(sizeof(SourceFile));
+    if (!source) {
+        if (!is_stdin) close(fd);
+        return NULL;
+    }
+
+    struct stat info;
+    bool regular = fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+    size_t size = regular ? (size_t)info.st_size : 0;
+
+    bool loaded = mapping_enabled && regular && size > 0 && map_source(source, fd, size);
+    if (!loaded) loaded = read_source(source, fd, size);
+
+    if (!is_stdin) close(fd);
+    if (!loaded) {
+        fprintf(stderr, "Error: Failed to read file %s\n", path);
+        free(source);
+        return NULL;
+    }
+    return source;
+}
+
+void free_source(SourceFile* source) {
+    if (!source) return;
+
+    if (source->mapped) {
+        munmap(source->data, source->length);
+    } else {
+        free(source->data);
+    }
+    free(source);
+}
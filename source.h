@@ -0,0 +1,32 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SOURCE_READ_CHUNK 65536
+
+// An input file held in memory. Mapped files are scanned in place and are
+// NOT NUL-terminated: scanners must stop at data + length.
+typedef struct {
+    char* data;
+    size_t length;
+    bool mapped;
+} SourceFile;
+
+typedef struct {
+    size_t files_mapped;
+    size_t bytes_mapped;
+    size_t files_read;
+    size_t bytes_read;
+} SourceStats;
+
+// path "-" reads stdin. Regular files are mmap'd; pipes, ttys and empty files
+// fall back to read(), which does NUL-terminate its buffer.
+SourceFile* load_source(const char* path);
+void free_source(SourceFile* source);
+
+// Turns mapping off so every file goes through the read() path.
+void set_source_mapping(bool enabled);
+const SourceStats* get_source_stats();
+
+#endif